@@ -0,0 +1,153 @@
+#!/bin/sh
+# Benchmark harness for restoration
+#
+# Usage: ./benchmark.sh [SIZE_MB [MODE...]]
+#
+# Generates a corrupted input of SIZE_MB megabytes (default: twice the
+# machine's RAM, so the input cannot stay in the page cache) and restores
+# it once per read mode (default: stdio block cold direct uring). For each mode
+# it reports wall time, throughput, and how much the page cache grew,
+# which is what the cold and direct modes are meant to keep down.
+# Run as root to drop the page cache between runs.
+#
+# It then restores the input once per allocation mode (BENCH_ALLOC,
+# default: default huge) with BENCH_THREADS parsing threads (default 1)
+# and reports wall time, peak RSS, and dTLB load misses when perf is
+# installed, which is what --alloc huge is meant to keep down.
+#
+# Finally it restores the input with eager and --lazy digit parsing and
+# reports wall time and peak RSS; junk-heavy inputs are where --lazy,
+# which parses only the target's rows, pays off.
+#
+# Last, it generates an input of narrow rows where nearly every line has
+# its own infusion (BENCH_DISTINCT_MB megabytes, default 200: millions
+# of groups) and restores it with one line per line table insertion and
+# with batched, prefetched insertions (--insert-batch).
+#
+# It then pipes the first input into restoration (through cat) with
+# stdio and block reads; block reads of a pipe go straight into the
+# reader's mirrored ring instead of through a copying thread.
+
+make restoration gen_corrupted || exit 1
+
+mem_kb() {
+        awk -v key="$1:" '$1 == key { print $2 }' /proc/meminfo
+}
+
+now() {
+        date +%s.%N
+}
+
+size_mb=${1:-$(( $(mem_kb MemTotal) * 2 / 1024 ))}
+[ $# -gt 0 ] && shift
+modes=${*:-"stdio block cold direct uring"}
+input=${BENCH_INPUT:-bench_input.txt}
+
+if [ ! -f "$input" ] || \
+   [ "$(( $(wc -c < "$input") / 1048576 ))" -lt "$size_mb" ]; then
+        echo "generating ${size_mb} MB input in $input"
+        ./gen_corrupted $(( size_mb * 1048576 )) > "$input" || exit 1
+fi
+bytes=$(wc -c < "$input")
+
+printf "%-8s %10s %10s %14s\n" mode seconds MB/s cache_growth_MB
+for mode in $modes; do
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null
+        cached_before=$(mem_kb Cached)
+        start=$(now)
+        ./restoration --read-mode "$mode" "$input" > /dev/null || exit 1
+        end=$(now)
+        cached_after=$(mem_kb Cached)
+        awk -v m="$mode" -v s="$start" -v e="$end" -v b="$bytes" \
+            -v c0="$cached_before" -v c1="$cached_after" 'BEGIN {
+                t = e - s
+                printf "%-8s %10.2f %10.1f %14.1f\n", m, t, b / t / 1048576,
+                       (c1 - c0) / 1024
+        }'
+done
+
+alloc_modes=${BENCH_ALLOC:-"default huge"}
+threads=${BENCH_THREADS:-1}
+perf_events=""
+if command -v perf >/dev/null 2>&1 && \
+   perf stat -e dTLB-load-misses true >/dev/null 2>&1; then
+        perf_events="dTLB-load-misses"
+fi
+
+echo
+printf "%-8s %8s %10s %12s %16s\n" alloc threads seconds peak_rss_MB \
+       dTLB_misses
+for alloc in $alloc_modes; do
+        start=$(now)
+        if [ -n "$perf_events" ]; then
+                report=$(perf stat -x, -e "$perf_events" ./restoration \
+                         --stats --alloc "$alloc" --threads "$threads" \
+                         --read-mode block "$input" 2>&1 > /dev/null) \
+                         || exit 1
+        else
+                report=$(./restoration --stats --alloc "$alloc" \
+                         --threads "$threads" --read-mode block "$input" \
+                         2>&1 > /dev/null) || exit 1
+        fi
+        end=$(now)
+        rss_kb=$(echo "$report" | awk '$1 == "peak_rss_kb" { print $2 }')
+        misses=$(echo "$report" | awk -F, '$3 ~ /dTLB/ { print $1 }')
+        awk -v a="$alloc" -v n="$threads" -v s="$start" -v e="$end" \
+            -v r="${rss_kb:-0}" -v m="${misses:-n/a}" 'BEGIN {
+                printf "%-8s %8d %10.2f %12.1f %16s\n", a, n, e - s,
+                       r / 1024, m
+        }'
+done
+
+echo
+printf "%-8s %10s %12s\n" parsing seconds peak_rss_MB
+for parsing in eager lazy; do
+        flag=""
+        [ "$parsing" = lazy ] && flag="--lazy"
+        start=$(now)
+        report=$(./restoration --stats $flag --threads "$threads" \
+                 --read-mode block "$input" 2>&1 > /dev/null) || exit 1
+        end=$(now)
+        rss_kb=$(echo "$report" | awk '$1 == "peak_rss_kb" { print $2 }')
+        awk -v p="$parsing" -v s="$start" -v e="$end" -v r="${rss_kb:-0}" \
+            'BEGIN { printf "%-8s %10.2f %12.1f\n", p, e - s, r / 1024 }'
+done
+
+distinct_mb=${BENCH_DISTINCT_MB:-200}
+distinct=${BENCH_DISTINCT_INPUT:-bench_distinct.txt}
+if [ ! -f "$distinct" ] || \
+   [ "$(( $(wc -c < "$distinct") / 1048576 ))" -lt "$distinct_mb" ]; then
+        echo "generating ${distinct_mb} MB distinct-infusion input in $distinct"
+        ./gen_corrupted $(( distinct_mb * 1048576 )) 8 20 > "$distinct" \
+                || exit 1
+fi
+
+echo
+printf "%-8s %8s %10s\n" parsing batch seconds
+for parsing in eager lazy; do
+        flag=""
+        [ "$parsing" = lazy ] && flag="--lazy"
+        for batch in 1 8 32 64; do
+                start=$(now)
+                ./restoration $flag --insert-batch "$batch" \
+                        --read-mode block "$distinct" > /dev/null || exit 1
+                end=$(now)
+                awk -v p="$parsing" -v n="$batch" -v s="$start" \
+                    -v e="$end" 'BEGIN {
+                        printf "%-8s %8d %10.2f\n", p, n, e - s
+                }'
+        done
+done
+
+echo
+printf "%-8s %10s %10s\n" piped seconds MB/s
+for mode in stdio block; do
+        start=$(now)
+        cat "$input" | ./restoration --read-mode "$mode" > /dev/null || exit 1
+        end=$(now)
+        awk -v m="$mode" -v s="$start" -v e="$end" -v b="$bytes" 'BEGIN {
+                t = e - s
+                printf "%-8s %10.2f %10.1f\n", m, t, b / t / 1048576
+        }'
+done
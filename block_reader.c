@@ -0,0 +1,893 @@
+/*
+ *     block_reader.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements BlockReader. The reader keeps one buffer holding the
+ *     unread tail of the previous block followed by the next block. Lines
+ *     are found with memchr and returned as pointers into that buffer, so
+ *     a line is only copied when it straddles two blocks (once, when the
+ *     tail is moved to the front of the buffer).
+ *
+ *     Every read starts at an aligned buffer address, has an aligned
+ *     length, and, since only the final read can come up short, starts at
+ *     an aligned file offset. That is what O_DIRECT requires; the other
+ *     modes simply share the same layout.
+ *
+ *     When built with HAVE_LIBURING, READ_URING mode keeps a ring of
+ *     queue_depth block buffers, each with a read in flight at the next
+ *     file offset. Blocks are consumed strictly in file order: the reader
+ *     waits for the oldest slot, copies its block after the unread tail,
+ *     and immediately reuses the slot for the next offset, so the device
+ *     stays busy while lines are parsed.
+ *
+ *     Pipes, which cannot be read at aligned offsets anyway, are read into
+ *     a ring instead: one memfd mapped twice, back to back, so the bytes
+ *     just past the end of the ring are the bytes at its start. A line that
+ *     wraps around is still contiguous in memory and is handed out in place
+ *     like any other; nothing is ever moved to the front.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "block_reader.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+/* Alignment of buffers and read sizes (O_DIRECT needs the block size) */
+#define READ_ALIGN 4096
+
+/* Cold mode: how far ahead to ask for readahead, and how many consumed
+ * bytes to let pile up before dropping them from the page cache */
+#define READAHEAD_WINDOW (8 << 20)
+#define DROP_BEHIND_BYTES (8 << 20)
+
+#ifdef HAVE_LIBURING
+/* Ring of block reads in flight (READ_URING mode) */
+struct read_ring {
+        struct io_uring ring;
+        int depth;
+        size_t block_size;
+        char **blocks;          /* one aligned buffer per slot */
+        long long *offsets;     /* file offset each slot was read from */
+        ssize_t *results;       /* bytes read (or -errno) once done */
+        int *done;              /* nonzero once a slot's read completed */
+        int next_slot;          /* slot holding the next block in order */
+        long long next_offset;  /* file offset of the next read to submit */
+        int stop_submitting;    /* end of file seen: no more reads */
+};
+#endif
+
+/* Struct Definition */
+struct BlockReader {
+        int fd;
+        read_mode_t mode;
+        char *buffer;
+        size_t capacity;        /* multiple of READ_ALIGN */
+        size_t start;           /* first unread byte in buffer */
+        size_t end;             /* one past the last valid byte in buffer */
+        int mirrored;           /* buffer is a ring mapped twice (pipes) */
+        size_t scanned;         /* bytes past start known to hold no '\n' */
+        long long file_offset;  /* file offset of the next read */
+        long long dropped;      /* file bytes already dropped from cache */
+        int eof;
+        int failed;
+#ifdef HAVE_LIBURING
+        struct read_ring *ring; /* READ_URING mode only */
+#endif
+};
+
+/*------------------------Helpers-------------------------*/
+
+static void fill_mirror(BlockReader *reader);
+#ifdef HAVE_LIBURING
+static void fill_buffer_from_ring(BlockReader *reader);
+#endif
+
+/********** align_up ********
+ *
+ * Round n up to a multiple of READ_ALIGN.
+ ************************/
+static size_t align_up(size_t n)
+{
+        return (n + READ_ALIGN - 1) / READ_ALIGN * READ_ALIGN;
+}
+
+/********** allocate_aligned ********
+ *
+ * Allocate a READ_ALIGN-aligned buffer.
+ *
+ * Parameters:
+ *      size_t capacity: bytes to allocate (multiple of READ_ALIGN)
+ *
+ * Return: new buffer, or NULL if allocation fails
+ ************************/
+static char *allocate_aligned(size_t capacity)
+{
+        void *buffer;
+        if (posix_memalign(&buffer, READ_ALIGN, capacity) != 0) {
+                return NULL;
+        }
+        return buffer;
+}
+
+/********** give_cache_hints ********
+ *
+ * Tell the kernel how a cold-mode input will be read.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader in READ_COLD mode (not NULL)
+ *
+ * Notes:
+ *      Hints are advisory; failures (e.g. on pipes) are ignored.
+ ************************/
+static void give_cache_hints(BlockReader *reader)
+{
+        posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(reader->fd, 0, 0, POSIX_FADV_NOREUSE);
+}
+
+/********** read_ahead_and_drop_behind ********
+ *
+ * After a cold-mode read, request the next window and release pages the
+ * reader has already copied into its buffer.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader in READ_COLD mode (not NULL)
+ ************************/
+static void read_ahead_and_drop_behind(BlockReader *reader)
+{
+        posix_fadvise(reader->fd, reader->file_offset, READAHEAD_WINDOW,
+                      POSIX_FADV_WILLNEED);
+
+        long long consumed = reader->file_offset / READ_ALIGN * READ_ALIGN;
+        if (consumed - reader->dropped >= DROP_BEHIND_BYTES) {
+                posix_fadvise(reader->fd, reader->dropped,
+                              consumed - reader->dropped,
+                              POSIX_FADV_DONTNEED);
+                reader->dropped = consumed;
+        }
+}
+
+/********** leave_direct_mode ********
+ *
+ * Turn O_DIRECT back off after the file system rejected it.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader in READ_DIRECT mode (not NULL)
+ *
+ * Return: 1 if reads can continue in READ_COLD mode, 0 otherwise
+ ************************/
+static int leave_direct_mode(BlockReader *reader)
+{
+        int flags = fcntl(reader->fd, F_GETFL);
+        if (flags < 0 || fcntl(reader->fd, F_SETFL, flags & ~O_DIRECT) < 0) {
+                return 0;
+        }
+        reader->mode = READ_COLD;
+        give_cache_hints(reader);
+        return 1;
+}
+
+/********** make_room ********
+ *
+ * Move the unread tail so the next read lands on an aligned address,
+ * growing the buffer if the tail leaves less than room bytes after it.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader (not NULL)
+ *      size_t room:         bytes needed after the tail (> 0)
+ *
+ * Return:
+ *      Buffer offset at which to read next, or 0 if allocation fails
+ ************************/
+static size_t make_room(BlockReader *reader, size_t room)
+{
+        size_t tail = reader->end - reader->start;
+        size_t target = align_up(tail);
+        if (target == 0) {
+                target = READ_ALIGN;
+        }
+
+        char *buffer = reader->buffer;
+        if (target + room > reader->capacity) {
+                size_t capacity = reader->capacity * 2;
+                while (target + room > capacity) {
+                        capacity *= 2;
+                }
+                buffer = allocate_aligned(capacity);
+                if (buffer == NULL) {
+                        return 0;
+                }
+                reader->capacity = capacity;
+        }
+        memmove(buffer + target - tail, reader->buffer + reader->start, tail);
+        if (buffer != reader->buffer) {
+                free(reader->buffer);
+                reader->buffer = buffer;
+        }
+        reader->start = target - tail;
+        reader->end = target;
+        return target;
+}
+
+/********** fill_buffer ********
+ *
+ * Read the next block after the unread tail.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader not at EOF (not NULL)
+ *
+ * Effects:
+ *      Appends up to one block to the buffer. Sets reader->eof at end of
+ *      input and reader->failed on a read or allocation error.
+ ************************/
+static void fill_buffer(BlockReader *reader)
+{
+#ifdef HAVE_LIBURING
+        if (reader->mode == READ_URING) {
+                fill_buffer_from_ring(reader);
+                return;
+        }
+#endif
+        if (reader->mirrored) {
+                fill_mirror(reader);
+                return;
+        }
+        size_t target = make_room(reader, READ_ALIGN);
+        if (target == 0) {
+                reader->failed = 1;
+                return;
+        }
+        size_t len = (reader->capacity - target) / READ_ALIGN * READ_ALIGN;
+
+        ssize_t n;
+        for (;;) {
+                n = read(reader->fd, reader->buffer + target, len);
+                if (n >= 0) {
+                        break;
+                }
+                if (errno == EINTR) {
+                        continue;
+                }
+                if (errno == EINVAL && reader->mode == READ_DIRECT &&
+                    leave_direct_mode(reader)) {
+                        continue;
+                }
+                reader->failed = 1;
+                return;
+        }
+
+        if (n == 0) {
+                reader->eof = 1;
+                return;
+        }
+        reader->end = target + (size_t)n;
+        reader->file_offset += n;
+        if (reader->mode == READ_COLD) {
+                read_ahead_and_drop_behind(reader);
+        }
+}
+
+/*------------------------Pipe ring-------------------------*/
+
+/********** map_mirror ********
+ *
+ * Map a ring buffer twice, back to back.
+ *
+ * Parameters:
+ *      size_t size: bytes in the ring (multiple of the page size)
+ *
+ * Return:
+ *      Start of a 2 * size mapping whose halves are the same memory, or
+ *      NULL if memfd or mmap fail
+ ************************/
+static char *map_mirror(size_t size)
+{
+        int fd = memfd_create("block_reader", MFD_CLOEXEC);
+        if (fd < 0) {
+                return NULL;
+        }
+        char *base = MAP_FAILED;
+        if (ftruncate(fd, size) == 0) {
+                /* Reserve both halves so nothing else lands in between */
+                base = mmap(NULL, 2 * size, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        for (int half = 0; base != MAP_FAILED && half < 2; half++) {
+                if (mmap(base + half * size, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                        munmap(base, 2 * size);
+                        base = MAP_FAILED;
+                }
+        }
+        close(fd);
+        return base == MAP_FAILED ? NULL : base;
+}
+
+/********** grow_mirror ********
+ *
+ * Double a full ring, for a line longer than the ring.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader with a mirrored buffer (not NULL)
+ *
+ * Return: 1 on success, 0 if the larger ring cannot be mapped
+ ************************/
+static int grow_mirror(BlockReader *reader)
+{
+        size_t used = reader->end - reader->start;
+        char *buffer = map_mirror(2 * reader->capacity);
+        if (buffer == NULL) {
+                return 0;
+        }
+        memcpy(buffer, reader->buffer + reader->start, used);
+        munmap(reader->buffer, 2 * reader->capacity);
+        reader->buffer = buffer;
+        reader->capacity *= 2;
+        reader->start = 0;
+        reader->end = used;
+        return 1;
+}
+
+/********** fill_mirror ********
+ *
+ * Read as much of a pipe as the ring has room for.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader with a mirrored buffer, not at EOF
+ *
+ * Effects:
+ *      Same as fill_buffer. The read lands right after the unread bytes;
+ *      it may run past the end of the ring into the mirror.
+ ************************/
+static void fill_mirror(BlockReader *reader)
+{
+        if (reader->end - reader->start == reader->capacity &&
+            !grow_mirror(reader)) {
+                reader->failed = 1;
+                return;
+        }
+        size_t room = reader->capacity - (reader->end - reader->start);
+        ssize_t n;
+        do {
+                n = read(reader->fd, reader->buffer + reader->end, room);
+        } while (n < 0 && errno == EINTR);
+
+        if (n < 0) {
+                reader->failed = 1;
+        } else if (n == 0) {
+                reader->eof = 1;
+        } else {
+                reader->end += (size_t)n;
+                reader->file_offset += n;
+        }
+}
+
+/********** use_mirror ********
+ *
+ * Give a reader a ring buffer if it reads from a pipe.
+ *
+ * Parameters:
+ *      BlockReader *reader: new reader without a buffer (not NULL)
+ *      size_t block_size:   requested bytes per read
+ *
+ * Return: 1 if reader->buffer is now a ring, 0 otherwise
+ ************************/
+static int use_mirror(BlockReader *reader, size_t block_size)
+{
+        struct stat st;
+        if (fstat(reader->fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+                return 0;
+        }
+        long page = sysconf(_SC_PAGESIZE);
+        size_t size = page > 0 ? (size_t)page : READ_ALIGN;
+        while (size < block_size) {
+                size *= 2;
+        }
+        reader->buffer = map_mirror(size);
+        if (reader->buffer == NULL) {
+                return 0;
+        }
+        reader->capacity = size;
+        reader->mirrored = 1;
+        /* Direct, cold and io_uring reads do not apply to pipes */
+        reader->mode = READ_BLOCK;
+        return 1;
+}
+
+#ifdef HAVE_LIBURING
+/*------------------------io_uring-------------------------*/
+
+/********** submit_slot ********
+ *
+ * Queue a read of the next block into a ring slot.
+ *
+ * Parameters:
+ *      struct read_ring *rr: ring (not NULL)
+ *      int fd:               descriptor being read
+ *      int slot:             free slot to read into
+ *
+ * Return: 1 if the read was queued, 0 if no submission entry was free
+ *
+ * Notes:
+ *      Queued reads reach the kernel on the next io_uring_submit.
+ ************************/
+static int submit_slot(struct read_ring *rr, int fd, int slot)
+{
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&rr->ring);
+        if (sqe == NULL) {
+                io_uring_submit(&rr->ring);
+                sqe = io_uring_get_sqe(&rr->ring);
+                if (sqe == NULL) {
+                        return 0;
+                }
+        }
+        rr->offsets[slot] = rr->next_offset;
+        rr->done[slot] = 0;
+        io_uring_prep_read(sqe, fd, rr->blocks[slot], rr->block_size,
+                           rr->offsets[slot]);
+        io_uring_sqe_set_data(sqe, &rr->done[slot]);
+        rr->next_offset += rr->block_size;
+        return 1;
+}
+
+/********** wait_for_slot ********
+ *
+ * Reap completions until the given slot's read has finished.
+ *
+ * Parameters:
+ *      struct read_ring *rr: ring (not NULL)
+ *      int fd:               descriptor being read
+ *      int slot:             slot to wait for
+ *
+ * Return: 1 once the slot is done, 0 on a ring error
+ *
+ * Notes:
+ *      Reads the kernel asks to retry (-EAGAIN, -EINTR) are resubmitted
+ *      at their original offset.
+ ************************/
+static int wait_for_slot(struct read_ring *rr, int fd, int slot)
+{
+        while (!rr->done[slot]) {
+                struct io_uring_cqe *cqe;
+                int ret = io_uring_wait_cqe(&rr->ring, &cqe);
+                if (ret == -EINTR) {
+                        continue;
+                }
+                if (ret < 0) {
+                        return 0;
+                }
+                int *flag = io_uring_cqe_get_data(cqe);
+                int done_slot = (int)(flag - rr->done);
+                int res = cqe->res;
+                io_uring_cqe_seen(&rr->ring, cqe);
+
+                if (res == -EAGAIN || res == -EINTR) {
+                        long long next_offset = rr->next_offset;
+                        rr->next_offset = rr->offsets[done_slot];
+                        int queued = submit_slot(rr, fd, done_slot);
+                        rr->next_offset = next_offset;
+                        if (!queued || io_uring_submit(&rr->ring) < 0) {
+                                return 0;
+                        }
+                        continue;
+                }
+                rr->results[done_slot] = res;
+                *flag = 1;
+        }
+        return 1;
+}
+
+/********** finish_short_read ********
+ *
+ * Complete a block whose read returned fewer bytes than requested.
+ *
+ * Parameters:
+ *      struct read_ring *rr: ring (not NULL)
+ *      int fd:               descriptor being read
+ *      int slot:             done slot with 0 < result < block_size
+ *
+ * Effects:
+ *      Reads the rest of the block synchronously. If the file ends inside
+ *      the block, stops further submissions; reads already in flight past
+ *      the end will complete with 0.
+ ************************/
+static void finish_short_read(struct read_ring *rr, int fd, int slot)
+{
+        while ((size_t)rr->results[slot] < rr->block_size) {
+                ssize_t got = rr->results[slot];
+                ssize_t n = pread(fd, rr->blocks[slot] + got,
+                                  rr->block_size - got,
+                                  rr->offsets[slot] + got);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        rr->stop_submitting = 1;
+                        if (n < 0) {
+                                rr->results[slot] = -errno;
+                        }
+                        return;
+                }
+                rr->results[slot] += n;
+        }
+}
+
+/********** fill_buffer_from_ring ********
+ *
+ * Append the next block, in file order, from the ring.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader in READ_URING mode (not NULL)
+ *
+ * Effects:
+ *      Copies the block after the unread tail and queues the next read
+ *      into the freed slot. Sets reader->eof at end of input and
+ *      reader->failed on a read, ring or allocation error.
+ ************************/
+static void fill_buffer_from_ring(BlockReader *reader)
+{
+        struct read_ring *rr = reader->ring;
+        int slot = rr->next_slot;
+        if (!wait_for_slot(rr, reader->fd, slot)) {
+                reader->failed = 1;
+                return;
+        }
+        if (rr->results[slot] > 0 && !rr->stop_submitting) {
+                finish_short_read(rr, reader->fd, slot);
+        }
+        ssize_t n = rr->results[slot];
+        if (n < 0) {
+                reader->failed = 1;
+                return;
+        }
+        if (n == 0) {
+                reader->eof = 1;
+                return;
+        }
+
+        size_t target = make_room(reader, (size_t)n);
+        if (target == 0) {
+                reader->failed = 1;
+                return;
+        }
+        memcpy(reader->buffer + target, rr->blocks[slot], (size_t)n);
+        reader->end = target + (size_t)n;
+        reader->file_offset += n;
+
+        rr->next_slot = (slot + 1) % rr->depth;
+        if (!rr->stop_submitting) {
+                if (!submit_slot(rr, reader->fd, slot) ||
+                    io_uring_submit(&rr->ring) < 0) {
+                        reader->failed = 1;
+                }
+        } else {
+                /* Nothing more to read: leave the slot done and empty */
+                rr->results[slot] = 0;
+        }
+}
+
+/********** free_read_ring ********
+ *
+ * Tear down a ring and free its buffers.
+ *
+ * Parameters:
+ *      struct read_ring *rr: ring to free (may be NULL)
+ *      int initialized:      nonzero if rr->ring was set up
+ ************************/
+static void free_read_ring(struct read_ring *rr, int initialized)
+{
+        if (rr == NULL) {
+                return;
+        }
+        if (initialized) {
+                /* Waits for reads still in flight before buffers go */
+                io_uring_queue_exit(&rr->ring);
+        }
+        if (rr->blocks != NULL) {
+                for (int i = 0; i < rr->depth; i++) {
+                        free(rr->blocks[i]);
+                }
+        }
+        free(rr->blocks);
+        free(rr->offsets);
+        free(rr->results);
+        free(rr->done);
+        free(rr);
+}
+
+/********** create_read_ring ********
+ *
+ * Set up an io_uring with queue_depth block reads in flight.
+ *
+ * Parameters:
+ *      int fd:            regular file to read from its start
+ *      size_t block_size: bytes per read (multiple of READ_ALIGN)
+ *      int queue_depth:   number of reads kept in flight (> 0)
+ *
+ * Return:
+ *      New ring with the first queue_depth reads submitted, or NULL if
+ *      io_uring is unavailable or allocation fails
+ ************************/
+static struct read_ring *create_read_ring(int fd, size_t block_size,
+                                          int queue_depth)
+{
+        struct read_ring *rr = calloc(1, sizeof *rr);
+        if (rr == NULL) {
+                return NULL;
+        }
+        rr->depth = queue_depth;
+        rr->block_size = block_size;
+        rr->blocks = calloc(queue_depth, sizeof *rr->blocks);
+        rr->offsets = calloc(queue_depth, sizeof *rr->offsets);
+        rr->results = calloc(queue_depth, sizeof *rr->results);
+        rr->done = calloc(queue_depth, sizeof *rr->done);
+        if (rr->blocks == NULL || rr->offsets == NULL ||
+            rr->results == NULL || rr->done == NULL) {
+                free_read_ring(rr, 0);
+                return NULL;
+        }
+        for (int i = 0; i < queue_depth; i++) {
+                rr->blocks[i] = allocate_aligned(block_size);
+                if (rr->blocks[i] == NULL) {
+                        free_read_ring(rr, 0);
+                        return NULL;
+                }
+        }
+        if (io_uring_queue_init(queue_depth, &rr->ring, 0) < 0) {
+                free_read_ring(rr, 0);
+                return NULL;
+        }
+
+        for (int i = 0; i < queue_depth; i++) {
+                if (!submit_slot(rr, fd, i)) {
+                        free_read_ring(rr, 1);
+                        return NULL;
+                }
+        }
+        if (io_uring_submit(&rr->ring) < 0) {
+                free_read_ring(rr, 1);
+                return NULL;
+        }
+        return rr;
+}
+#endif /* HAVE_LIBURING */
+
+/*------------------------Interface-------------------------*/
+
+/********** create_block_reader ********
+ *
+ * Create a line reader over a file descriptor.
+ *
+ * Parameters:
+ *      int fd:            open descriptor positioned at the start of input;
+ *                         not closed by the reader
+ *      read_mode_t mode:  READ_BLOCK, READ_COLD, READ_DIRECT or READ_URING
+ *      size_t block_size: bytes per read (rounded up to the alignment)
+ *      int queue_depth:   reads kept in flight in READ_URING mode (> 0)
+ *
+ * Return: new reader, or NULL if allocation fails
+ *
+ * Effects:
+ *      If fd is a pipe, every mode reads it into a mirrored ring in
+ *      READ_BLOCK mode. Otherwise READ_DIRECT sets O_DIRECT on fd; if
+ *      that is refused the reader starts in READ_COLD mode instead.
+ *      READ_COLD gives the kernel sequential-access hints for fd.
+ *      READ_URING submits its first queue_depth reads, or starts in
+ *      READ_BLOCK mode if it cannot.
+ *
+ * Notes:
+ *      Caller must free with free_block_reader
+ ************************/
+BlockReader *create_block_reader(int fd, read_mode_t mode, size_t block_size,
+                                 int queue_depth)
+{
+        BlockReader *reader = malloc(sizeof *reader);
+        if (reader == NULL) {
+                return NULL;
+        }
+        *reader = (struct BlockReader){0};
+        reader->fd = fd;
+        reader->mode = mode;
+        if (use_mirror(reader, block_size)) {
+                return reader;
+        }
+        /* Leave room for one aligned unit of carried-over line */
+        reader->capacity = align_up(block_size) + READ_ALIGN;
+        reader->buffer = allocate_aligned(reader->capacity);
+        if (reader->buffer == NULL) {
+                free(reader);
+                return NULL;
+        }
+
+        if (mode == READ_DIRECT) {
+                int flags = fcntl(fd, F_GETFL);
+                if (flags < 0 || fcntl(fd, F_SETFL, flags | O_DIRECT) < 0) {
+                        reader->mode = READ_COLD;
+                }
+        }
+        if (reader->mode == READ_COLD) {
+                give_cache_hints(reader);
+        }
+        if (mode == READ_URING) {
+                reader->mode = READ_BLOCK;
+#ifdef HAVE_LIBURING
+                /* io_uring reads need explicit offsets: regular files only */
+                struct stat st;
+                if (queue_depth > 0 && fstat(fd, &st) == 0 &&
+                    S_ISREG(st.st_mode)) {
+                        reader->ring = create_read_ring(
+                                fd, align_up(block_size), queue_depth);
+                        if (reader->ring != NULL) {
+                                reader->mode = READ_URING;
+                        }
+                }
+#else
+                (void)queue_depth;
+#endif
+        }
+        return reader;
+}
+
+/********** block_reader_next_line ********
+ *
+ * Return the next line of input, in place.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader (not NULL)
+ *      char **linep:        out; start of the line inside the reader's
+ *                           buffer, or NULL at end of input
+ *
+ * Return:
+ *      Number of bytes in the line including its final '\n' (a last line
+ *      without '\n' is returned as is), or 0 at end of input or on error.
+ *      Matches readaline's line boundaries.
+ *
+ * Notes:
+ *      The line stays valid, and may be modified, until the next call.
+ *      Check block_reader_failed once 0 is returned.
+ ************************/
+size_t block_reader_next_line(BlockReader *reader, char **linep)
+{
+        for (;;) {
+                char *from = reader->buffer + reader->start;
+                size_t avail = reader->end - reader->start;
+                char *newline = memchr(from + reader->scanned, '\n',
+                                       avail - reader->scanned);
+                if (newline != NULL) {
+                        size_t len = (size_t)(newline - from) + 1;
+                        reader->start += len;
+                        reader->scanned = 0;
+                        if (reader->mirrored && 
+                            reader->start >= reader->capacity) {
+                                /* Same bytes, seen through the first
+                                 * mapping */
+                                reader->start -= reader->capacity;
+                                reader->end -= reader->capacity;
+                        }
+                        *linep = from;
+                        return len;
+                }
+                reader->scanned = avail;
+
+                if (reader->eof || reader->failed) {
+                        /* Final line without '\n', or nothing left */
+                        reader->start = reader->end;
+                        reader->scanned = 0;
+                        *linep = avail > 0 && !reader->failed ? from : NULL;
+                        return *linep != NULL ? avail : 0;
+                }
+                fill_buffer(reader);
+        }
+}
+
+/********** block_reader_reset ********
+ *
+ * Point a reader at another input, keeping its buffer.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader (not NULL)
+ *      int fd:              open descriptor; reading starts at its current
+ *                           position, and it is not closed by the reader
+ *
+ * Return:
+ *      1 on success, 0 if the reader is in READ_DIRECT or READ_URING mode,
+ *      whose setup belongs to the descriptor it was created for
+ *
+ * Notes:
+ *      Lets one reader serve many inputs in turn without reallocating.
+ *      READ_COLD does not drop the previous input's cached pages here.
+ ************************/
+int block_reader_reset(BlockReader *reader, int fd)
+{
+        if (reader->mode != READ_BLOCK && reader->mode != READ_COLD) {
+                return 0;
+        }
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        reader->fd = fd;
+        reader->start = 0;
+        reader->end = 0;
+        reader->scanned = 0;
+        reader->file_offset = offset > 0 ? offset : 0;
+        reader->dropped = reader->file_offset / READ_ALIGN * READ_ALIGN;
+        reader->eof = 0;
+        reader->failed = 0;
+        if (reader->mode == READ_COLD) {
+                give_cache_hints(reader);
+        }
+        return 1;
+}
+
+/********** block_reader_prime ********
+ *
+ * Put bytes already taken from the descriptor back in front of the input.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader no line has been read from (not NULL)
+ *      const void *data:    bytes to read first (e.g. sniffed magic bytes
+ *                           that a pipe cannot take back)
+ *      size_t len:          number of bytes in data
+ *
+ * Return: 1 on success, 0 if the buffer has no room for len bytes
+ ************************/
+int block_reader_prime(BlockReader *reader, const void *data, size_t len)
+{
+        if (len > reader->capacity - reader->end) {
+                return 0;
+        }
+        memcpy(reader->buffer + reader->end, data, len);
+        reader->end += len;
+        return 1;
+}
+
+/********** block_reader_failed ********
+ *
+ * Report whether a read or allocation error stopped the reader.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader (not NULL)
+ *
+ * Return: nonzero if an error occurred
+ ************************/
+int block_reader_failed(BlockReader *reader)
+{
+        return reader->failed;
+}
+
+/********** free_block_reader ********
+ *
+ * Free a reader. In READ_COLD mode, also drops any remaining cached
+ * pages of the input. The descriptor stays open.
+ *
+ * Parameters:
+ *      BlockReader *reader: reader to free (may be NULL)
+ ************************/
+void free_block_reader(BlockReader *reader)
+{
+        if (reader == NULL) {
+                return;
+        }
+        if (reader->mode == READ_COLD) {
+                posix_fadvise(reader->fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#ifdef HAVE_LIBURING
+        free_read_ring(reader->ring, 1);
+#endif
+        if (reader->mirrored) {
+                munmap(reader->buffer, 2 * reader->capacity);
+        } else {
+                free(reader->buffer);
+        }
+        free(reader);
+}
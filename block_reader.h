@@ -0,0 +1,62 @@
+/*
+ *     block_reader.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for BlockReader, a line reader that pulls its input from a
+ *     file descriptor in large blocks and hands out lines in place, instead
+ *     of reading one character at a time through stdio like readaline.
+ *     Read modes control how the blocks interact with the page cache.
+ *     Pipes are read into a mirrored ring, so lines are never copied.
+ */
+
+#ifndef BLOCK_READER_H
+#define BLOCK_READER_H
+
+#include <stddef.h>
+
+/* Default size of one block read */
+#define BLOCK_READER_SIZE (1 << 20)
+
+/* Default number of block reads kept in flight in READ_URING mode */
+#define BLOCK_READER_QUEUE_DEPTH 8
+
+/********** read_mode_t ********
+ * How restoration reads its input.
+ *      READ_STDIO:  readaline over a FILE (fopen + fgetc), no BlockReader
+ *      READ_BLOCK:  plain read(2) of whole blocks
+ *      READ_COLD:   like READ_BLOCK, plus sequential/no-reuse and
+ *                   readahead hints, dropping pages behind the cursor so
+ *                   a read-once input does not fill the page cache
+ *      READ_DIRECT: O_DIRECT reads into aligned buffers, bypassing the
+ *                   page cache; falls back to READ_COLD where the file
+ *                   system does not support O_DIRECT
+ *      READ_URING:  keeps several block reads in flight with io_uring
+ *                   while earlier blocks are parsed; falls back to
+ *                   READ_BLOCK when built without liburing, when the
+ *                   kernel refuses io_uring, or for non-regular files
+ ************************/
+typedef enum read_mode {
+        READ_STDIO,
+        READ_BLOCK,
+        READ_COLD,
+        READ_DIRECT,
+        READ_URING
+} read_mode_t;
+
+/********** BlockReader ********
+ * Abstract type representing a block-buffered line reader.
+ ************************/
+typedef struct BlockReader BlockReader;
+
+/* Functions */
+BlockReader *create_block_reader(int fd, read_mode_t mode, size_t block_size,
+                                 int queue_depth);
+size_t block_reader_next_line(BlockReader *reader, char **linep);
+int block_reader_prime(BlockReader *reader, const void *data, size_t len);
+int block_reader_failed(BlockReader *reader);
+int block_reader_reset(BlockReader *reader, int fd);
+void free_block_reader(BlockReader *reader);
+
+#endif /* BLOCK_READER_H */
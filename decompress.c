@@ -0,0 +1,524 @@
+/*
+ *     decompress.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements Decompressor. A worker thread reads the raw input in large
+ *     chunks, decodes them with zlib or libzstd, and writes the plain bytes
+ *     into a pipe; the read end is handed back as a FILE, so readaline and
+ *     BlockReader consume it like any other input while the next chunk is
+ *     decoded. Codecs are compiled in only where their library is found
+ *     (HAVE_ZLIB, HAVE_ZSTD).
+ *
+ *     The same thread also replays bytes consumed while sniffing a
+ *     non-seekable input, splicing the rest of it through unchanged.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "decompress.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Size of one raw read and of one decoded chunk */
+#define DECOMPRESS_CHUNK (1 << 20)
+
+/* Requested capacity of the pipe between the thread and the reader */
+#define DECOMPRESS_PIPE_SIZE (1 << 20)
+
+/* Struct Definition */
+struct Decompressor {
+        compression_t kind;
+        FILE *raw;              /* compressed input */
+        int close_raw;          /* fclose raw in finish_decompressor */
+        unsigned char prefix[COMPRESSION_MAGIC_MAX];
+        size_t prefix_len;      /* bytes already taken from raw */
+        FILE *stream;           /* read end of the pipe */
+        int pipe_write;         /* write end, owned by the thread */
+        pthread_t thread;
+        int failed;             /* read or decode error in the thread */
+        int reader_gone;        /* stream was closed before the end */
+};
+
+/*------------------------Helpers-------------------------*/
+
+/********** read_raw ********
+ *
+ * Read the next compressed bytes: first the sniffed prefix, then raw.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: running decompressor (not NULL)
+ *      unsigned char *buffer:      destination of at least
+ *                                  DECOMPRESS_CHUNK bytes
+ *
+ * Return: bytes read, 0 at end of input, -1 on a read error
+ ************************/
+static ssize_t read_raw(Decompressor *decompressor, unsigned char *buffer)
+{
+        if (decompressor->prefix_len > 0) {
+                size_t len = decompressor->prefix_len;
+                memcpy(buffer, decompressor->prefix, len);
+                decompressor->prefix_len = 0;
+                return (ssize_t)len;
+        }
+        for (;;) {
+                ssize_t n = read(fileno(decompressor->raw), buffer,
+                                 DECOMPRESS_CHUNK);
+                if (n >= 0 || errno != EINTR) {
+                        return n;
+                }
+        }
+}
+
+/********** emit ********
+ *
+ * Write decoded bytes into the pipe, retrying short writes.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: running decompressor (not NULL)
+ *      const unsigned char *data:  decoded bytes
+ *      size_t len:                 number of bytes in data
+ *
+ * Return: 1 if every byte was written, 0 otherwise
+ *
+ * Notes:
+ *      Sets reader_gone when the reader closed its end early (EPIPE)
+ ************************/
+static int emit(Decompressor *decompressor, const unsigned char *data,
+                size_t len)
+{
+        while (len > 0) {
+                ssize_t n = write(decompressor->pipe_write, data, len);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno == EPIPE) {
+                                decompressor->reader_gone = 1;
+                        }
+                        return 0;
+                }
+                data += n;
+                len -= (size_t)n;
+        }
+        return 1;
+}
+
+#ifdef HAVE_ZLIB
+/********** inflate_gzip ********
+ *
+ * Decode a gzip input, including concatenated members, into the pipe.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: running decompressor (not NULL)
+ *      unsigned char *in:          raw buffer of DECOMPRESS_CHUNK bytes
+ *      unsigned char *out:         decode buffer of DECOMPRESS_CHUNK bytes
+ *
+ * Return: 1 if the input was a complete gzip stream, 0 otherwise
+ ************************/
+static int inflate_gzip(Decompressor *decompressor, unsigned char *in,
+                        unsigned char *out)
+{
+        z_stream strm;
+        memset(&strm, 0, sizeof strm);
+        /* 16 + window bits: expect a gzip wrapper */
+        if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
+                return 0;
+        }
+
+        int ok = 0;
+        int member_done = 0;
+        int output_full = 0;
+        for (;;) {
+                /* A full output buffer may hide more output, so drain
+                 * it before reading on */
+                if (strm.avail_in == 0 && !output_full) {
+                        ssize_t n = read_raw(decompressor, in);
+                        if (n <= 0) {
+                                ok = n == 0 && member_done;
+                                break;
+                        }
+                        strm.next_in = in;
+                        strm.avail_in = (uInt)n;
+                }
+                if (member_done) {
+                        /* Another member follows */
+                        inflateReset(&strm);
+                        member_done = 0;
+                }
+                strm.next_out = out;
+                strm.avail_out = DECOMPRESS_CHUNK;
+                int status = inflate(&strm, Z_NO_FLUSH);
+                if (status != Z_OK && status != Z_STREAM_END &&
+                    status != Z_BUF_ERROR) {
+                        break;
+                }
+                size_t produced = DECOMPRESS_CHUNK - strm.avail_out;
+                if (produced > 0 && !emit(decompressor, out, produced)) {
+                        break;
+                }
+                member_done = status == Z_STREAM_END;
+                output_full = strm.avail_out == 0;
+        }
+        inflateEnd(&strm);
+        return ok;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/********** decompress_zstd ********
+ *
+ * Decode a zstd input, including concatenated frames, into the pipe.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: running decompressor (not NULL)
+ *      unsigned char *in:          raw buffer of DECOMPRESS_CHUNK bytes
+ *      unsigned char *out:         decode buffer of DECOMPRESS_CHUNK bytes
+ *
+ * Return: 1 if the input ended on a frame boundary, 0 otherwise
+ ************************/
+static int decompress_zstd(Decompressor *decompressor, unsigned char *in,
+                           unsigned char *out)
+{
+        ZSTD_DStream *stream = ZSTD_createDStream();
+        if (stream == NULL) {
+                return 0;
+        }
+        ZSTD_initDStream(stream);
+
+        ZSTD_inBuffer input = { in, 0, 0 };
+        int ok = 0;
+        size_t hint = 1;        /* 0 once a frame is completely flushed */
+        int output_full = 0;
+        for (;;) {
+                if (input.pos == input.size && !output_full) {
+                        ssize_t n = read_raw(decompressor, in);
+                        if (n <= 0) {
+                                ok = n == 0 && hint == 0;
+                                break;
+                        }
+                        input.size = (size_t)n;
+                        input.pos = 0;
+                }
+                ZSTD_outBuffer output = { out, DECOMPRESS_CHUNK, 0 };
+                hint = ZSTD_decompressStream(stream, &output, &input);
+                if (ZSTD_isError(hint)) {
+                        break;
+                }
+                if (output.pos > 0 && !emit(decompressor, out, output.pos)) {
+                        break;
+                }
+                output_full = output.pos == output.size;
+        }
+        ZSTD_freeDStream(stream);
+        return ok;
+}
+#endif
+
+/********** pass_through ********
+ *
+ * Replay the sniffed prefix, then move the rest of raw into the pipe
+ * unchanged, with splice(2) where the kernel allows it.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: running decompressor (not NULL)
+ *      unsigned char *buffer:      bounce buffer of DECOMPRESS_CHUNK bytes
+ *
+ * Return: 1 if all of raw was passed on, 0 otherwise
+ ************************/
+static int pass_through(Decompressor *decompressor, unsigned char *buffer)
+{
+        if (!emit(decompressor, decompressor->prefix,
+                  decompressor->prefix_len)) {
+                return 0;
+        }
+        decompressor->prefix_len = 0;
+
+        for (;;) {
+                ssize_t n = splice(fileno(decompressor->raw), NULL,
+                                   decompressor->pipe_write, NULL,
+                                   DECOMPRESS_CHUNK, SPLICE_F_MOVE);
+                if (n > 0 || (n < 0 && errno == EINTR)) {
+                        continue;
+                }
+                if (n == 0) {
+                        return 1;
+                }
+                if (errno == EPIPE) {
+                        decompressor->reader_gone = 1;
+                        return 0;
+                }
+                if (errno != EINVAL) {
+                        return 0;
+                }
+                /* Neither end is a pipe the kernel can splice */
+                break;
+        }
+
+        ssize_t n;
+        while ((n = read_raw(decompressor, buffer)) > 0) {
+                if (!emit(decompressor, buffer, (size_t)n)) {
+                        return 0;
+                }
+        }
+        return n == 0;
+}
+
+/********** decompress_thread ********
+ *
+ * Thread body: decode all of raw into the pipe, then close the pipe.
+ *
+ * Parameters:
+ *      void *arg: the Decompressor
+ *
+ * Return: NULL
+ *
+ * Notes:
+ *      SIGPIPE is blocked on this thread, so a reader that stops early
+ *      turns into EPIPE here instead of killing the process
+ ************************/
+static void *decompress_thread(void *arg)
+{
+        Decompressor *decompressor = arg;
+        sigset_t pipe_signal;
+        sigemptyset(&pipe_signal);
+        sigaddset(&pipe_signal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+        unsigned char *in = malloc(DECOMPRESS_CHUNK);
+        unsigned char *out = malloc(DECOMPRESS_CHUNK);
+        int ok = 0;
+        if (in != NULL && out != NULL) {
+                switch (decompressor->kind) {
+#ifdef HAVE_ZLIB
+                case COMPRESSION_GZIP:
+                        ok = inflate_gzip(decompressor, in, out);
+                        break;
+#endif
+#ifdef HAVE_ZSTD
+                case COMPRESSION_ZSTD:
+                        ok = decompress_zstd(decompressor, in, out);
+                        break;
+#endif
+                case COMPRESSION_NONE:
+                        ok = pass_through(decompressor, in);
+                        break;
+                default:
+                        break;
+                }
+        }
+        decompressor->failed = !ok && !decompressor->reader_gone;
+        free(in);
+        free(out);
+        close(decompressor->pipe_write);
+        return NULL;
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** peek_compression ********
+ *
+ * Sniff the magic number at the start of an input descriptor.
+ *
+ * Parameters:
+ *      int fd:                nothing has been read from fd yet
+ *      unsigned char *prefix: out; COMPRESSION_MAGIC_MAX bytes
+ *      size_t *prefix_len:    out; number of sniffed bytes left in prefix
+ *
+ * Return: the encoding the magic number names, COMPRESSION_NONE if none
+ *
+ * Notes:
+ *      Seekable inputs are rewound and *prefix_len is 0. On pipes and
+ *      terminals the sniffed bytes are gone from fd and are returned in
+ *      prefix instead; the caller must replay them (start_decompressor
+ *      does, for any kind).
+ ************************/
+compression_t peek_compression(int fd, unsigned char *prefix,
+                               size_t *prefix_len)
+{
+        static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+        static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+        size_t len = 0;
+        while (len < COMPRESSION_MAGIC_MAX) {
+                ssize_t n = read(fd, prefix + len,
+                                 COMPRESSION_MAGIC_MAX - len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        break;
+                }
+                len += (size_t)n;
+        }
+
+        compression_t kind = COMPRESSION_NONE;
+        if (len >= sizeof gzip_magic &&
+            memcmp(prefix, gzip_magic, sizeof gzip_magic) == 0) {
+                kind = COMPRESSION_GZIP;
+        } else if (len >= sizeof zstd_magic &&
+                   memcmp(prefix, zstd_magic, sizeof zstd_magic) == 0) {
+                kind = COMPRESSION_ZSTD;
+        }
+
+        if (len > 0 && lseek(fd, -(off_t)len, SEEK_CUR) >= 0) {
+                len = 0;
+        }
+        *prefix_len = len;
+        return kind;
+}
+
+/********** compression_supported ********
+ *
+ * Report whether this build can decode an encoding.
+ *
+ * Parameters:
+ *      compression_t kind: encoding from peek_compression
+ *
+ * Return: 1 if start_decompressor accepts kind, 0 otherwise
+ ************************/
+int compression_supported(compression_t kind)
+{
+        switch (kind) {
+        case COMPRESSION_NONE:
+                return 1;
+        case COMPRESSION_GZIP:
+#ifdef HAVE_ZLIB
+                return 1;
+#else
+                return 0;
+#endif
+        case COMPRESSION_ZSTD:
+#ifdef HAVE_ZSTD
+                return 1;
+#else
+                return 0;
+#endif
+        }
+        return 0;
+}
+
+/********** start_decompressor ********
+ *
+ * Start a thread that decodes raw into a pipe.
+ *
+ * Parameters:
+ *      FILE *raw:                   input to decode; nothing may have been
+ *                                   read from it through stdio
+ *      int close_raw:               nonzero to fclose raw when finished
+ *      compression_t kind:          encoding of raw; COMPRESSION_NONE
+ *                                   only replays prefix and copies raw
+ *      const unsigned char *prefix: bytes already taken from raw's
+ *                                   descriptor by peek_compression
+ *      size_t prefix_len:           number of bytes in prefix
+ *                                   (<= COMPRESSION_MAGIC_MAX)
+ *
+ * Return:
+ *      new decompressor, or NULL if kind is not supported by this build
+ *      or a pipe, stream or thread cannot be created. On NULL, raw is
+ *      left open for the caller.
+ *
+ * Notes:
+ *      Caller must read decompressor_stream and then call
+ *      finish_decompressor. The thread blocks while the pipe is full, so
+ *      at most DECOMPRESS_CHUNK plus a pipe's worth of decoded bytes are
+ *      ahead of the reader.
+ ************************/
+Decompressor *start_decompressor(FILE *raw, int close_raw, compression_t kind,
+                                 const unsigned char *prefix,
+                                 size_t prefix_len)
+{
+        if (!compression_supported(kind) ||
+            prefix_len > COMPRESSION_MAGIC_MAX) {
+                return NULL;
+        }
+        Decompressor *decompressor = malloc(sizeof *decompressor);
+        if (decompressor == NULL) {
+                return NULL;
+        }
+        *decompressor = (struct Decompressor){0};
+        decompressor->kind = kind;
+        decompressor->raw = raw;
+        decompressor->close_raw = close_raw;
+        memcpy(decompressor->prefix, prefix, prefix_len);
+        decompressor->prefix_len = prefix_len;
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+                free(decompressor);
+                return NULL;
+        }
+        /* Best effort: fewer wakeups per decoded chunk */
+        fcntl(fds[1], F_SETPIPE_SZ, DECOMPRESS_PIPE_SIZE);
+        decompressor->pipe_write = fds[1];
+        decompressor->stream = fdopen(fds[0], "rb");
+        if (decompressor->stream == NULL) {
+                close(fds[0]);
+                close(fds[1]);
+                free(decompressor);
+                return NULL;
+        }
+        if (pthread_create(&decompressor->thread, NULL, decompress_thread,
+                           decompressor) != 0) {
+                fclose(decompressor->stream);
+                close(fds[1]);
+                free(decompressor);
+                return NULL;
+        }
+        return decompressor;
+}
+
+/********** decompressor_stream ********
+ *
+ * Get the stream of decoded bytes.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: running decompressor (not NULL)
+ *
+ * Return:
+ *      read end of the pipe, owned by the decompressor. Its descriptor
+ *      may be read directly as long as stdio has not read from it.
+ ************************/
+FILE *decompressor_stream(Decompressor *decompressor)
+{
+        return decompressor->stream;
+}
+
+/********** finish_decompressor ********
+ *
+ * Close the decoded stream, wait for the thread, and free everything.
+ *
+ * Parameters:
+ *      Decompressor *decompressor: decompressor to finish (not NULL)
+ *
+ * Return:
+ *      1 if the whole input decoded cleanly (or the reader stopped
+ *      early), 0 on a read error, a truncated input or corrupt data
+ *
+ * Notes:
+ *      Closes raw if start_decompressor was asked to. A reader that stops
+ *      early unblocks the thread, which then sees EPIPE and exits.
+ ************************/
+int finish_decompressor(Decompressor *decompressor)
+{
+        fclose(decompressor->stream);
+        pthread_join(decompressor->thread, NULL);
+        int ok = !decompressor->failed;
+        if (decompressor->close_raw) {
+                fclose(decompressor->raw);
+        }
+        free(decompressor);
+        return ok;
+}
@@ -0,0 +1,49 @@
+/*
+ *     decompress.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for Decompressor, which turns a gzip- or zstd-compressed
+ *     input into a plain stream. Decompression runs on its own thread and
+ *     feeds a pipe, so the line reader parses one block while the next is
+ *     being inflated. Provides magic-byte detection, startup, and teardown.
+ */
+
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Longest magic number peek_compression looks at */
+#define COMPRESSION_MAGIC_MAX 4
+
+/********** compression_t ********
+ * Input encodings recognized by their leading magic bytes.
+ *      COMPRESSION_NONE: plain corrupted PGM
+ *      COMPRESSION_GZIP: gzip (1f 8b), decoded with zlib
+ *      COMPRESSION_ZSTD: zstd frame (28 b5 2f fd), decoded with libzstd
+ ************************/
+typedef enum compression {
+        COMPRESSION_NONE,
+        COMPRESSION_GZIP,
+        COMPRESSION_ZSTD
+} compression_t;
+
+/********** Decompressor ********
+ * Abstract type representing a decompression thread and its pipe.
+ ************************/
+typedef struct Decompressor Decompressor;
+
+/* Functions */
+compression_t peek_compression(int fd, unsigned char *prefix,
+                               size_t *prefix_len);
+int compression_supported(compression_t kind);
+Decompressor *start_decompressor(FILE *raw, int close_raw, compression_t kind,
+                                 const unsigned char *prefix,
+                                 size_t prefix_len);
+FILE *decompressor_stream(Decompressor *decompressor);
+int finish_decompressor(Decompressor *decompressor);
+
+#endif /* DECOMPRESS_H */
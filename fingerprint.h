@@ -0,0 +1,77 @@
+/*
+ *     fingerprint.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for infusion fingerprints: a CRC32C of the bytes, mixed
+ *     with the length into the 64 bits LineTable hashes on. The CRC can
+ *     be taken a byte at a time while a line is being split, so the
+ *     infusion is hashed in the same pass that finds it, or over a whole
+ *     string at once; both give the same fingerprint.
+ *
+ *     Built with SSE4.2 the steps are the crc32 instruction; elsewhere
+ *     they look the same CRC up in a table, so fingerprints do not depend
+ *     on how the program was built.
+ */
+
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stdint.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+/* CRC state before the first byte */
+#define FINGERPRINT_SEED 0xFFFFFFFFu
+
+/* CRC32C (Castagnoli) of every byte value, for builds without SSE4.2 */
+extern const uint32_t fingerprint_crc_table[256];
+
+/********** fingerprint_step ********
+ *
+ * Add one byte to a running CRC.
+ *
+ * Parameters:
+ *      uint32_t crc:    FINGERPRINT_SEED or the result of the last step
+ *      unsigned char c: next byte
+ *
+ * Return: CRC of the bytes so far
+ ************************/
+static inline uint32_t fingerprint_step(uint32_t crc, unsigned char c)
+{
+#if defined(__SSE4_2__)
+        return _mm_crc32_u8(crc, c);
+#else
+        return fingerprint_crc_table[(crc ^ c) & 0xFF] ^ (crc >> 8);
+#endif
+}
+
+/********** fingerprint_finish ********
+ *
+ * Turn a running CRC into a fingerprint.
+ *
+ * Parameters:
+ *      uint32_t crc: CRC of all len bytes
+ *      int len:      number of bytes
+ *
+ * Return: the 64-bit fingerprint
+ *
+ * Notes:
+ *      The multiply spreads the CRC and length over the high bits and
+ *      the shift brings them back down, since LineTable picks stripes
+ *      by the low bits and chains by the ones above.
+ ************************/
+static inline uint64_t fingerprint_finish(uint32_t crc, int len)
+{
+        uint64_t h = ((uint64_t)(uint32_t)len << 32 | crc) *
+                     0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+}
+
+/* Functions */
+uint64_t fingerprint_bytes(const char *s, int len);
+
+#endif /* FINGERPRINT_H */
@@ -0,0 +1,1000 @@
+/*
+ *     fuzz_restoration.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Differential fuzz harness for restoration's fast paths. Every input
+ *     is restored once by a reference built from the original scalar
+ *     pieces (readaline, break_line_down, and a plain scan for the target
+ *     infusion), then once per fast path: block reads in every read mode,
+ *     parsing threads, huge-page tables, rasters written with pwrite on
+ *     several threads however small, speculative output, --batch with
+ *     chunks small enough to split every input, and thumbnails. Each
+ *     output must be byte-identical to the reference's (box-filtered, for
+ *     a thumbnail); a mismatch aborts, so fuzzers report it as a crash.
+ *     Last, a run with --index leaves a row index, and --rows runs must
+ *     then read the whole image, and all but its first row, through it;
+ *     and a run with --cache must leave an entry that a second run hits,
+ *     writing the same bytes, though not one with --index, which must
+ *     read the input to index it.
+ *     The one allowance is speculative output, whose header pads the
+ *     height with spaces by design: its header is rewritten in the usual
+ *     form before comparing.
+ *
+ *     Inputs outside the spec are skipped: those with a target row that
+ *     has fewer integers than the target width, or a number too long for
+ *     an int.
+ *     Restoration's behavior there is undefined, not a fast-path bug.
+ *
+ *     Usage:
+ *       fuzz_restoration FILE...          check each file (AFL: @@)
+ *       fuzz_restoration --random N [SEED]
+ *                                         check N generated inputs; the
+ *                                         same SEED gives the same inputs
+ *     Built with -DFUZZ_LIBFUZZER, the file has no main and libFuzzer
+ *     drives LLVMFuzzerTestOneInput instead.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "restoration.h"
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* Longest digit run that surely fits in an int */
+#define MAX_NUMBER_DIGITS 9
+
+/* Input sizes for --random */
+#define RANDOM_MAX_LINES 200
+#define RANDOM_MAX_INFUSIONS 6
+#define RANDOM_LONG_INFUSION 300        /* past KEY_BUFFER_SIZE */
+#define RANDOM_WIDE_INFUSION 126        /* 127 pixels, which thumb-wide
+                                           splits into uneven boxes */
+
+/* Where a failing --random input is saved */
+#define FAILURE_PATH "fuzz-failure.txt"
+
+/* One way of running restoration, compared against the reference */
+struct variant {
+        const char *name;
+        read_mode_t read_mode;
+        int threads;
+        alloc_mode_t alloc_mode;
+        long speculate_lines;
+        long long batch_chunk_bytes;    /* run through --batch if > 0 */
+        int lazy_digits;
+        int insert_batch;               /* 0 for the default */
+        int thumbnail;                  /* --thumbnail NxN if > 0 */
+        long long positional_min_bytes; /* 0 for the default */
+};
+
+static const struct variant variants[] = {
+        { "stdio",          READ_STDIO,  0, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "unbatched",      READ_STDIO,  0, ALLOC_DEFAULT, 0,  0,  0, 1, 0, 0 },
+        { "block",          READ_BLOCK,  0, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "cold",           READ_COLD,   0, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "direct",         READ_DIRECT, 0, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "uring",          READ_URING,  0, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "stdio-threads",  READ_STDIO,  4, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "block-threads",  READ_BLOCK,  4, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 0 },
+        { "huge-threads",   READ_BLOCK,  4, ALLOC_HUGE,    0,  0,  0, 0, 0, 0 },
+        { "pwrite-threads", READ_STDIO,  4, ALLOC_DEFAULT, 0,  0,  0, 0, 0, 1 },
+        { "speculate",      READ_STDIO,  0, ALLOC_DEFAULT, 2,  0,  0, 0, 0, 0 },
+        { "spec-block",     READ_BLOCK,  0, ALLOC_DEFAULT, 16, 0,  0, 0, 0, 0 },
+        { "batch",          READ_BLOCK,  3, ALLOC_DEFAULT, 0,  61, 0, 0, 0, 0 },
+        { "lazy",           READ_STDIO,  0, ALLOC_DEFAULT, 0,  0,  1, 0, 0, 0 },
+        { "lazy-threads",   READ_BLOCK,  4, ALLOC_DEFAULT, 0,  0,  1, 0, 0, 0 },
+        { "lazy-batch",     READ_BLOCK,  3, ALLOC_DEFAULT, 0,  61, 1, 0, 0, 0 },
+        { "lazy-unbatched", READ_BLOCK,  0, ALLOC_DEFAULT, 0,  0,  1, 1, 0, 0 },
+        { "thumbnail",      READ_STDIO,  0, ALLOC_DEFAULT, 0,  0,  0, 0, 3, 0 },
+        { "thumb-block",    READ_BLOCK,  4, ALLOC_DEFAULT, 0,  0,  1, 0, 7, 0 },
+        { "thumb-wide",     READ_STDIO,  0, ALLOC_DEFAULT, 0,  0,  1, 0, 8, 0 },
+};
+
+/* Scratch files shared by every check, input_path's row index, and an
+ * image cache directory */
+static char input_path[PATH_MAX];
+static char output_path[PATH_MAX];
+static char list_path[PATH_MAX];
+static char index_path[PATH_MAX + sizeof ROW_INDEX_SUFFIX];
+static char cache_path[PATH_MAX];
+
+/* One line as the reference sees it */
+struct ref_line {
+        char *chars;
+        int char_count;
+        digit_array_t digits;
+        int longest_number;     /* digits in its longest number */
+};
+
+static unsigned long long rng_state;
+
+/*------------------------Helpers-------------------------*/
+
+/********** next_random ********
+ *
+ * Return the next value of a xorshift64 generator.
+ ************************/
+static unsigned long long next_random(void)
+{
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        return rng_state;
+}
+
+/********** random_below ********
+ *
+ * Return a random number in [0, n).
+ ************************/
+static size_t random_below(size_t n)
+{
+        return (size_t)(next_random() % n);
+}
+
+/********** need ********
+ *
+ * Abort if an allocation failed.
+ ************************/
+static void need(void *pointer)
+{
+        if (pointer == NULL) {
+                perror("fuzz_restoration");
+                abort();
+        }
+}
+
+/********** make_scratch_file ********
+ *
+ * Create an empty scratch file and remember its path.
+ *
+ * Parameters:
+ *      char *path: out; PATH_MAX bytes
+ ************************/
+static void make_scratch_file(char *path)
+{
+        const char *dir = getenv("TMPDIR");
+        snprintf(path, PATH_MAX, "%s/fuzz_restoration.XXXXXX",
+                 dir != NULL ? dir : "/tmp");
+        int fd = mkstemp(path);
+        if (fd < 0) {
+                perror("mkstemp");
+                exit(EXIT_FAILURE);
+        }
+        close(fd);
+}
+
+/********** make_scratch_dir ********
+ *
+ * Create an empty scratch directory and remember its path.
+ *
+ * Parameters:
+ *      char *path: out; PATH_MAX bytes
+ ************************/
+static void make_scratch_dir(char *path)
+{
+        const char *dir = getenv("TMPDIR");
+        snprintf(path, PATH_MAX, "%s/fuzz_restoration.XXXXXX",
+                 dir != NULL ? dir : "/tmp");
+        if (mkdtemp(path) == NULL) {
+                perror("mkdtemp");
+                exit(EXIT_FAILURE);
+        }
+}
+
+/********** empty_cache_dir ********
+ *
+ * Delete every entry of the scratch image cache.
+ ************************/
+static void empty_cache_dir(void)
+{
+        DIR *dir = opendir(cache_path);
+        if (dir == NULL) {
+                return;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+                char path[2 * PATH_MAX];
+                if (entry->d_name[0] == '.' && 
+                    (entry->d_name[1] == '\0' || 
+                     strcmp(entry->d_name, "..") == 0)) {
+                        continue;
+                }
+                snprintf(path, sizeof path, "%s/%s", cache_path, 
+                         entry->d_name);
+                unlink(path);
+        }
+        closedir(dir);
+}
+
+/********** remove_scratch_files ********
+ *
+ * atexit handler: delete the scratch files.
+ ************************/
+static void remove_scratch_files(void)
+{
+        unlink(input_path);
+        unlink(output_path);
+        unlink(list_path);
+        unlink(index_path);
+        empty_cache_dir();
+        rmdir(cache_path);
+}
+
+/********** write_whole_file ********
+ *
+ * Replace a file's contents.
+ *
+ * Parameters:
+ *      const char *path: file to write
+ *      const void *data: new contents
+ *      size_t size:      bytes in data
+ ************************/
+static void write_whole_file(const char *path, const void *data, size_t size)
+{
+        FILE *file = open_file(path, "wb");
+        if (fwrite(data, 1, size, file) != size || fclose(file) != 0) {
+                perror(path);
+                abort();
+        }
+}
+
+/********** read_whole_file ********
+ *
+ * Read a file into a heap buffer.
+ *
+ * Parameters:
+ *      const char *path: file to read
+ *      size_t *size:     out; bytes read
+ *
+ * Return: malloc'd contents (caller frees)
+ ************************/
+static unsigned char *read_whole_file(const char *path, size_t *size)
+{
+        FILE *file = open_file(path, "rb");
+        size_t capacity = 4096;
+        unsigned char *data = malloc(capacity);
+        need(data);
+        *size = 0;
+        size_t n;
+        while ((n = fread(data + *size, 1, capacity - *size, file)) > 0) {
+                *size += n;
+                if (*size == capacity) {
+                        capacity *= 2;
+                        data = realloc(data, capacity);
+                        need(data);
+                }
+        }
+        fclose(file);
+        return data;
+}
+
+/********** longest_number ********
+ *
+ * Length of the longest run of digits in a line.
+ ************************/
+static int longest_number(const char *line, size_t line_len)
+{
+        int longest = 0;
+        int run = 0;
+        for (size_t i = 0; i < line_len; i++) {
+                run = isdigit(line[i]) ? run + 1 : 0;
+                if (run > longest) {
+                        longest = run;
+                }
+        }
+        return longest;
+}
+
+/********** same_infusion ********
+ *
+ * Report whether two reference lines have the same infusion.
+ ************************/
+static int same_infusion(struct ref_line *a, struct ref_line *b)
+{
+        return a->char_count == b->char_count &&
+               memcmp(a->chars, b->chars, a->char_count) == 0;
+}
+
+/********** free_ref_lines ********
+ *
+ * Free the lines read by the reference.
+ ************************/
+static void free_ref_lines(Seq_T *lines)
+{
+        for (int i = 0; i < Seq_length(*lines); i++) {
+                struct ref_line *line = Seq_get(*lines, i);
+                free(line->chars);
+                free(line->digits->digits);
+                free(line->digits);
+                free(line);
+        }
+        Seq_free(lines);
+}
+
+/********** restore_reference ********
+ *
+ * Restore input_path with the original scalar code and no LineTable.
+ *
+ * Parameters:
+ *      size_t *size: out; bytes in the result
+ *
+ * Return:
+ *      malloc'd P5 image (NULL with *size 0 if no infusion repeats), or
+ *      NULL with *size SIZE_MAX if the input is outside the spec
+ *
+ * Notes:
+ *      Lines are split as process_image_file always has: the final byte
+ *      becomes '\0' and stays part of the infusion. The target is the
+ *      infusion of the latest line that repeats an earlier one; its width
+ *      is that line's number count.
+ ************************/
+static unsigned char *restore_reference(size_t *size)
+{
+        FILE *input = open_file(input_path, "rb");
+        Seq_T lines = Seq_new(0);
+        char *text;
+        size_t text_len;
+        while ((text_len = readaline(input, &text)) > 0) {
+                struct ref_line *line = malloc(sizeof *line);
+                need(line);
+                line->longest_number = longest_number(text, text_len);
+                text[text_len - 1] = '\0';
+                break_line_down(text, text_len, &line->chars,
+                                &line->char_count, &line->digits);
+                Seq_addhi(lines, line);
+                free(text);
+        }
+        fclose(input);
+
+        /* Find the latest line that repeats an earlier infusion */
+        int count = Seq_length(lines);
+        int target = -1;
+        for (int i = count - 1; i > 0 && target < 0; i--) {
+                for (int j = 0; j < i && target < 0; j++) {
+                        if (same_infusion(Seq_get(lines, i),
+                                          Seq_get(lines, j))) {
+                                target = i;
+                        }
+                }
+        }
+        *size = 0;
+        if (target < 0) {
+                free_ref_lines(&lines);
+                return NULL;
+        }
+
+        struct ref_line *latest = Seq_get(lines, target);
+        int width = latest->digits->length;
+        int rows = 0;
+        int in_spec = 1;
+        for (int i = 0; i < count; i++) {
+                struct ref_line *line = Seq_get(lines, i);
+                if (same_infusion(line, latest)) {
+                        rows++;
+                        in_spec = in_spec && line->digits->length >= width &&
+                                  line->longest_number <= MAX_NUMBER_DIGITS;
+                }
+        }
+        if (!in_spec) {
+                *size = SIZE_MAX;
+                free_ref_lines(&lines);
+                return NULL;
+        }
+
+        unsigned char *image = malloc(PGM_HEADER_MAX +
+                                      (size_t)rows * width);
+        need(image);
+        *size = snprintf((char *)image, PGM_HEADER_MAX, "P5\n%d %d\n%d\n",
+                         width, rows, MAXVAL);
+        for (int i = 0; i < count; i++) {
+                struct ref_line *line = Seq_get(lines, i);
+                if (!same_infusion(line, latest)) {
+                        continue;
+                }
+                /* Pixels above MAXVAL are clamped, not wrapped */
+                for (int j = 0; j < width; j++) {
+                        int pixel = line->digits->digits[j];
+                        image[(*size)++] = pixel > MAXVAL ? MAXVAL : pixel;
+                }
+        }
+        free_ref_lines(&lines);
+        return image;
+}
+
+/********** unpad_header ********
+ *
+ * Rewrite a P5 header whose fields are padded with extra whitespace in
+ * the form write_pgm_header uses, keeping the raster after it.
+ *
+ * Parameters:
+ *      unsigned char *image: in/out; a P5 image
+ *      size_t *size:         in/out; bytes in image
+ *
+ * Notes:
+ *      Leaves anything that does not parse as a P5 header alone.
+ ************************/
+static void unpad_header(unsigned char *image, size_t *size)
+{
+        char text[PGM_HEADER_MAX];
+        size_t len = *size < PGM_HEADER_MAX - 1 ? *size : PGM_HEADER_MAX - 1;
+        memcpy(text, image, len);
+        text[len] = '\0';
+
+        int fields[3];
+        char *p = text + 2;
+        if (len < 2 || memcmp(text, "P5", 2) != 0) {
+                return;
+        }
+        for (int i = 0; i < 3; i++) {
+                char *end;
+                fields[i] = (int)strtol(p, &end, 10);
+                if (end == p) {
+                        return;
+                }
+                p = end;
+        }
+        /* One whitespace byte ends the header */
+        size_t header_len = (size_t)(p - text) + 1;
+        if (header_len > len) {
+                return;
+        }
+        char canonical[PGM_HEADER_MAX];
+        int canonical_len = snprintf(canonical, sizeof canonical,
+                                     "P5\n%d %d\n%d\n", fields[0],
+                                     fields[1], fields[2]);
+        memmove(image + canonical_len, image + header_len,
+                *size - header_len);
+        memcpy(image, canonical, canonical_len);
+        *size = *size - header_len + canonical_len;
+}
+
+/********** shrink_reference ********
+ *
+ * Box-filter a reference image the way --thumbnail NxN should.
+ *
+ * Parameters:
+ *      const unsigned char *image: P5 image from restore_reference
+ *      size_t size:                bytes in image (0 for no image)
+ *      int n:                      thumbnail width and height bound
+ *      size_t *thumb_size:         out; bytes in the result
+ *
+ * Return: malloc'd P5 thumbnail, or NULL with *thumb_size 0 if there is
+ *         no image
+ *
+ * Notes:
+ *      Every image pixel is added to one thumbnail pixel: column c goes
+ *      to the last thumbnail column x with x * width / tw <= c (rounded
+ *      down), and rows likewise. Each thumbnail pixel is then the
+ *      rounded mean of the pixels it was given, so none is left out.
+ ************************/
+static unsigned char *shrink_reference(const unsigned char *image,
+                                       size_t size, int n,
+                                       size_t *thumb_size)
+{
+        int width, height, maxval, header_len;
+        *thumb_size = 0;
+        if (size == 0 || sscanf((const char *)image, "P5\n%d %d\n%d%n",
+                                &width, &height, &maxval,
+                                &header_len) != 3) {
+                return NULL;
+        }
+        /* Not "\n%n": a format's whitespace would eat raster bytes too */
+        const unsigned char *raster = image + header_len + 1;
+        int tw = width < n ? width : n;
+        int th = height < n ? height : n;
+        unsigned char *thumb = malloc(PGM_HEADER_MAX + (size_t)tw * th);
+        need(thumb);
+        *thumb_size = snprintf((char *)thumb, PGM_HEADER_MAX,
+                               "P5\n%d %d\n%d\n", tw, th, maxval);
+        if (tw == 0) {
+                return thumb;
+        }
+        long *sums = calloc((size_t)tw * th, sizeof *sums);
+        long *counts = calloc((size_t)tw * th, sizeof *counts);
+        need(sums);
+        need(counts);
+        int y = 0;
+        for (int row = 0; row < height; row++) {
+                while ((long long)(y + 1) * height / th <= row) {
+                        y++;
+                }
+                int x = 0;
+                for (int col = 0; col < width; col++) {
+                        while ((long long)(x + 1) * width / tw <= col) {
+                                x++;
+                        }
+                        sums[(long)y * tw + x] += 
+                                raster[(long)row * width + col];
+                        counts[(long)y * tw + x]++;
+                }
+        }
+        for (long i = 0; i < (long)tw * th; i++) {
+                thumb[(*thumb_size)++] = (sums[i] + counts[i] / 2) / 
+                                         counts[i];
+        }
+        free(sums);
+        free(counts);
+        return thumb;
+}
+
+/********** slice_reference ********
+ *
+ * Cut a reference image down to the rows --rows FIRST:M should keep,
+ * for any M past its last row.
+ *
+ * Parameters:
+ *      const unsigned char *image: P5 image from restore_reference
+ *      size_t size:                bytes in image (0 for no image)
+ *      int first:                  first row kept
+ *      size_t *slice_size:         out; bytes in the result
+ *
+ * Return: malloc'd P5 image, or NULL with *slice_size 0 if there is no
+ *         image
+ ************************/
+static unsigned char *slice_reference(const unsigned char *image,
+                                      size_t size, int first,
+                                      size_t *slice_size)
+{
+        int width, height, maxval, header_len;
+        *slice_size = 0;
+        if (size == 0 || sscanf((const char *)image, "P5\n%d %d\n%d%n",
+                                &width, &height, &maxval,
+                                &header_len) != 3) {
+                return NULL;
+        }
+        const unsigned char *raster = image + header_len + 1;
+        int rows = height > first ? height - first : 0;
+        unsigned char *slice = malloc(PGM_HEADER_MAX + (size_t)width * rows);
+        need(slice);
+        *slice_size = snprintf((char *)slice, PGM_HEADER_MAX,
+                               "P5\n%d %d\n%d\n", width, rows, maxval);
+        memcpy(slice + *slice_size, raster + (size_t)width * (height - rows),
+               (size_t)width * rows);
+        *slice_size += (size_t)width * rows;
+        return slice;
+}
+
+/********** restore_with_options ********
+ *
+ * Restore input_path as options ask.
+ *
+ * Parameters:
+ *      restore_options_t options: run options; --batch if
+ *                                 options->batch_chunk_bytes > 0
+ *      restore_stats_t stats:     in/out; counters the run adds to, or
+ *                                 NULL
+ *      size_t *size:              out; bytes in the result
+ *
+ * Return: malloc'd output, or NULL if restoration failed
+ ************************/
+static unsigned char *restore_with_options(restore_options_t options,
+                                           restore_stats_t stats,
+                                           size_t *size)
+{
+        struct restore_stats own = {0};
+        volatile int restored = 1;
+        if (stats == NULL) {
+                stats = &own;
+        }
+
+        /* Output of an earlier variant must not count */
+        write_whole_file(output_path, "", 0);
+        TRY
+                if (options->batch_chunk_bytes > 0) {
+                        char list[2 * PATH_MAX + 2];
+                        int len = snprintf(list, sizeof list, "%s\t%s\n",
+                                           input_path, output_path);
+                        write_whole_file(list_path, list, len);
+                        options->batch_path = list_path;
+                        restored = restore_batch(options, stats) ==
+                                   EXIT_SUCCESS;
+                } else {
+                        options->output_path = output_path;
+                        restored = restore_image_status(input_path, options,
+                                                        stats) == RESTORE_OK;
+                }
+        EXCEPT(Checked_Runtime_Error)
+                restored = 0;
+        END_TRY;
+        free_restore_stats(stats);
+        if (!restored) {
+                return NULL;
+        }
+        unsigned char *output = read_whole_file(output_path, size);
+        if (options->speculate_lines > 0) {
+                unpad_header(output, size);
+        }
+        return output;
+}
+
+/********** restore_variant ********
+ *
+ * Restore input_path one fast way.
+ *
+ * Parameters:
+ *      const struct variant *v: how to restore
+ *      size_t *size:            out; bytes in the result
+ *
+ * Return: malloc'd output, or NULL if restoration failed
+ ************************/
+static unsigned char *restore_variant(const struct variant *v, size_t *size)
+{
+        struct restore_options options = {0};
+        options.cache_policy = CACHE_EVICT_LRU;
+        options.queue_depth = BLOCK_READER_QUEUE_DEPTH;
+        options.read_mode = v->read_mode;
+        options.threads = v->threads;
+        options.alloc_mode = v->alloc_mode;
+        options.speculate_lines = v->speculate_lines;
+        options.lazy_digits = v->lazy_digits;
+        options.insert_batch = v->insert_batch;
+        options.thumbnail_width = v->thumbnail;
+        options.thumbnail_height = v->thumbnail;
+        options.batch_chunk_bytes = v->batch_chunk_bytes;
+        options.positional_min_bytes = v->positional_min_bytes;
+        return restore_with_options(&options, NULL, size);
+}
+
+/********** expect_output ********
+ *
+ * Abort unless a restoration produced the expected bytes.
+ *
+ * Parameters:
+ *      const char *name:             what was restored, for the message
+ *      const unsigned char *actual:  its output, or NULL if it failed
+ *      size_t actual_size:           bytes in actual
+ *      const unsigned char *want:    expected output
+ *      size_t want_size:             bytes in want
+ ************************/
+static void expect_output(const char *name, const unsigned char *actual,
+                          size_t actual_size, const unsigned char *want,
+                          size_t want_size)
+{
+        if (actual == NULL || actual_size != want_size ||
+            (want_size > 0 && memcmp(actual, want, want_size) != 0)) {
+                fprintf(stderr, "%s: output differs from the "
+                        "reference (%zu bytes, expected %zu)\n",
+                        name, actual_size, want_size);
+                abort();
+        }
+}
+
+/********** check_row_index ********
+ *
+ * Write input_path's row index, then read row ranges through it.
+ *
+ * Parameters:
+ *      const unsigned char *expected: reference image
+ *      size_t expected_size:          bytes in expected (0 for no image)
+ *
+ * Effects:
+ *      Aborts if a run's output differs from the reference, or if an
+ *      image was restored but no index was left for the --rows runs.
+ ************************/
+static void check_row_index(const unsigned char *expected,
+                            size_t expected_size)
+{
+        struct restore_options options = {0};
+        size_t size = 0;
+        options.cache_policy = CACHE_EVICT_LRU;
+
+        /* The index must come from this input, not the last one */
+        unlink(index_path);
+        options.write_index = 1;
+        unsigned char *actual = restore_with_options(&options, NULL, &size);
+        expect_output("index", actual, size, expected, expected_size);
+        free(actual);
+        if (expected_size > 0 && access(index_path, F_OK) != 0) {
+                fprintf(stderr, "index: no row index was written\n");
+                abort();
+        }
+
+        options.write_index = 0;
+        options.rows_last = LONG_MAX;
+        actual = restore_with_options(&options, NULL, &size);
+        expect_output("rows", actual, size, expected, expected_size);
+        free(actual);
+
+        size_t want_size;
+        unsigned char *want = slice_reference(expected, expected_size, 1,
+                                              &want_size);
+        options.rows_first = 1;
+        actual = restore_with_options(&options, NULL, &size);
+        expect_output("rows-after-first", actual, size, want, want_size);
+        free(actual);
+        free(want);
+}
+
+/********** check_cache ********
+ *
+ * Restore input_path through an empty image cache, twice and then
+ * with --index.
+ *
+ * Parameters:
+ *      const unsigned char *expected: reference image
+ *      size_t expected_size:          bytes in expected (0 for no image)
+ *
+ * Effects:
+ *      Aborts if either run's output differs from the reference, or if
+ *      the first run is not a miss and the second a hit. A third run
+ *      with --index must not take the hit, and must leave a row index.
+ ************************/
+static void check_cache(const unsigned char *expected, size_t expected_size)
+{
+        struct restore_options options = {0};
+        struct restore_stats stats = {0};
+        size_t size = 0;
+        options.cache_policy = CACHE_EVICT_LRU;
+        options.cache_dir = cache_path;
+
+        /* The hit must come from this input's entry, not an older one */
+        empty_cache_dir();
+        unsigned char *actual = restore_with_options(&options, &stats, &size);
+        expect_output("cache-miss", actual, size, expected, expected_size);
+        free(actual);
+        actual = restore_with_options(&options, &stats, &size);
+        expect_output("cache-hit", actual, size, expected, expected_size);
+        free(actual);
+        if (stats.cache_misses != 1 || stats.cache_hits != 1) {
+                fprintf(stderr, "cache: %ld misses and %ld hits, expected "
+                        "1 of each\n", stats.cache_misses, stats.cache_hits);
+                abort();
+        }
+
+        unlink(index_path);
+        options.write_index = 1;
+        actual = restore_with_options(&options, &stats, &size);
+        expect_output("cache-index", actual, size, expected, expected_size);
+        free(actual);
+        if (expected_size > 0 && access(index_path, F_OK) != 0) {
+                fprintf(stderr, "cache-index: no row index was written\n");
+                abort();
+        }
+}
+
+/********** check_input ********
+ *
+ * Restore one input every way and compare each result to the reference.
+ *
+ * Parameters:
+ *      const uint8_t *data: the corrupted input
+ *      size_t size:         bytes in data
+ *
+ * Return: 1 if the input was checked, 0 if it is outside the spec
+ *
+ * Effects:
+ *      Prints the variant and aborts on the first mismatch.
+ ************************/
+static int check_input(const uint8_t *data, size_t size)
+{
+        if (input_path[0] == '\0') {
+                make_scratch_file(input_path);
+                make_scratch_file(output_path);
+                make_scratch_file(list_path);
+                make_scratch_dir(cache_path);
+                snprintf(index_path, sizeof index_path, "%s%s", input_path,
+                         ROW_INDEX_SUFFIX);
+                atexit(remove_scratch_files);
+        }
+        write_whole_file(input_path, data, size);
+
+        size_t expected_size;
+        unsigned char *expected = restore_reference(&expected_size);
+        if (expected_size == SIZE_MAX) {
+                return 0;
+        }
+        size_t nvariants = sizeof variants / sizeof variants[0];
+        for (size_t i = 0; i < nvariants; i++) {
+                size_t actual_size = 0;
+                unsigned char *actual = restore_variant(&variants[i],
+                                                        &actual_size);
+                unsigned char *want = expected;
+                size_t want_size = expected_size;
+                if (variants[i].thumbnail > 0) {
+                        want = shrink_reference(expected, expected_size,
+                                                variants[i].thumbnail,
+                                                &want_size);
+                }
+                expect_output(variants[i].name, actual, actual_size, want,
+                              want_size);
+                if (want != expected) {
+                        free(want);
+                }
+                free(actual);
+        }
+        check_row_index(expected, expected_size);
+        check_cache(expected, expected_size);
+        free(expected);
+        return 1;
+}
+
+/********** append_number ********
+ *
+ * Append a random pixel value, sometimes out of range or zero-padded.
+ ************************/
+static void append_number(char *buffer, size_t *len)
+{
+        unsigned value = (unsigned)random_below(random_below(8) == 0 ?
+                                                100000 : 256);
+        const char *format = random_below(10) == 0 ? "%03u" : "%u";
+        *len += sprintf(buffer + *len, format, value);
+}
+
+/********** random_infusion ********
+ *
+ * Fill an infusion with random non-digit, non-newline bytes.
+ *
+ * Parameters:
+ *      char *infusion: out; len bytes
+ *      size_t len:     infusion length
+ ************************/
+static void random_infusion(char *infusion, size_t len)
+{
+        static const char common[] = "abcxyz !#\t";
+        for (size_t i = 0; i < len; i++) {
+                char c;
+                do {
+                        c = random_below(4) == 0 ? (char)random_below(256) :
+                            common[random_below(sizeof common - 1)];
+                } while (isdigit(c) || c == '\n');
+                infusion[i] = c;
+        }
+}
+
+/********** random_input ********
+ *
+ * Generate one corrupted input: a few infusions used by many lines,
+ * each with a fixed set of gaps holding numbers, among unique junk lines.
+ *
+ * Parameters:
+ *      size_t *size: out; bytes generated
+ *
+ * Return: malloc'd input (caller frees)
+ ************************/
+static char *random_input(size_t *size)
+{
+        int ninfusions = 1 + (int)random_below(RANDOM_MAX_INFUSIONS);
+        size_t lens[RANDOM_MAX_INFUSIONS];
+        char *infusions[RANDOM_MAX_INFUSIONS];
+        unsigned masks[RANDOM_MAX_INFUSIONS];
+        for (int i = 0; i < ninfusions; i++) {
+                lens[i] = random_below(16) == 0 ? RANDOM_LONG_INFUSION :
+                          1 + random_below(12);
+                masks[i] = (unsigned)next_random();
+                if (i == 0 && random_below(8) == 0) {
+                        /* A number in every gap makes a wide target */
+                        lens[i] = RANDOM_WIDE_INFUSION;
+                        masks[i] = ~0u;
+                }
+                infusions[i] = malloc(lens[i]);
+                need(infusions[i]);
+                random_infusion(infusions[i], lens[i]);
+        }
+
+        size_t nlines = random_below(RANDOM_MAX_LINES);
+        /* Every byte of a line can carry a six-byte number before it */
+        size_t line_max = 7 * (RANDOM_LONG_INFUSION + 1) + 1;
+        char *buffer = malloc(nlines * line_max + 1);
+        need(buffer);
+        *size = 0;
+        for (size_t l = 0; l < nlines; l++) {
+                char junk[RANDOM_LONG_INFUSION];
+                int pick = (int)random_below(ninfusions + 2);
+                const char *infusion = junk;
+                size_t len = 1 + random_below(12);
+                unsigned mask = (unsigned)next_random();
+                if (pick < ninfusions) {
+                        infusion = infusions[pick];
+                        len = lens[pick];
+                        mask = masks[pick];
+                        if (random_below(20) == 0) {
+                                /* A stray row with other gaps filled */
+                                mask = (unsigned)next_random();
+                        }
+                } else {
+                        random_infusion(junk, len);
+                }
+                /* Gap g (before byte g) holds a number if bit g % 32 */
+                for (size_t g = 0; g < len; g++) {
+                        if (mask >> (g % 32) & 1) {
+                                append_number(buffer, size);
+                        }
+                        buffer[(*size)++] = infusion[g];
+                }
+                if (mask >> (len % 32) & 1) {
+                        append_number(buffer, size);
+                }
+                if (l + 1 < nlines || random_below(5) != 0) {
+                        buffer[(*size)++] = '\n';
+                }
+        }
+        for (int i = 0; i < ninfusions; i++) {
+                free(infusions[i]);
+        }
+        return buffer;
+}
+
+/********** check_random_inputs ********
+ *
+ * Check generated inputs.
+ *
+ * Parameters:
+ *      long count:              inputs to generate
+ *      unsigned long long seed: generator seed (not 0)
+ *
+ * Effects:
+ *      Prints how many inputs were in spec. Before checking each input,
+ *      saves it to FAILURE_PATH so a mismatch can be replayed; the file
+ *      is removed once every input passes.
+ ************************/
+static void check_random_inputs(long count, unsigned long long seed)
+{
+        long checked = 0;
+        rng_state = seed;
+        for (long i = 0; i < count; i++) {
+                size_t size;
+                char *input = random_input(&size);
+                write_whole_file(FAILURE_PATH, input, size);
+                checked += check_input((const uint8_t *)input, size);
+                free(input);
+        }
+        unlink(FAILURE_PATH);
+        printf("%ld inputs, %ld in spec, all fast paths match\n", count,
+               checked);
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** LLVMFuzzerTestOneInput ********
+ *
+ * libFuzzer entry point.
+ *
+ * Parameters:
+ *      const uint8_t *data: input from the fuzzer
+ *      size_t size:         bytes in data
+ *
+ * Return: 0, as libFuzzer expects; mismatches abort
+ ************************/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+        check_input(data, size);
+        return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+/**************** main *****************
+ *
+ * Check the inputs named on the command line, or generated ones.
+ *
+ * Return:
+ *      EXIT_SUCCESS if every output matched; a mismatch aborts.
+ ************************/
+int main(int argc, char *argv[])
+{
+        if (argc >= 3 && strcmp(argv[1], "--random") == 0) {
+                long count = strtol(argv[2], NULL, 10);
+                unsigned long long seed = argc > 3 ?
+                                          strtoull(argv[3], NULL, 10) : 40;
+                check_random_inputs(count, seed != 0 ? seed : 40);
+                return EXIT_SUCCESS;
+        }
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s FILE... | --random N [SEED]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+        for (int i = 1; i < argc; i++) {
+                size_t size;
+                unsigned char *data = read_whole_file(argv[i], &size);
+                if (!check_input(data, size)) {
+                        printf("%s: outside the spec, skipped\n", argv[i]);
+                }
+                free(data);
+        }
+        return EXIT_SUCCESS;
+}
+#endif /* FUZZ_LIBFUZZER */
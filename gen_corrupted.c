@@ -0,0 +1,133 @@
+/*
+ *     gen_corrupted.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Generates synthetic corrupted PGM input for benchmarking restoration.
+ *     Every line is a row of random pixels interleaved with an infusion
+ *     sequence. Real rows share one infusion; each junk row gets its own
+ *     random infusion, so only the real rows form a duplicate group.
+ *
+ *     Usage: gen_corrupted BYTES [WIDTH [JUNK_PER_ROW [SEED]]]
+ *     Writes at least BYTES bytes (whole lines) to standard output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defaults for the optional arguments */
+#define DEFAULT_WIDTH 500
+#define DEFAULT_JUNK_PER_ROW 3
+#define DEFAULT_SEED 40
+
+/* Worst case bytes per pixel: one infusion byte plus three digits */
+#define MAX_BYTES_PER_PIXEL 4
+
+static unsigned long long rng_state;
+
+/********** next_random ********
+ *
+ * Return the next value of a xorshift64 generator.
+ ************************/
+static unsigned long long next_random(void)
+{
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        return rng_state;
+}
+
+/********** make_infusion ********
+ *
+ * Fill infusion with len random letters.
+ *
+ * Parameters:
+ *      char *infusion: output buffer of at least len bytes
+ *      int len:        number of letters to generate
+ ************************/
+static void make_infusion(char *infusion, int len)
+{
+        static const char letters[] =
+                "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        for (int i = 0; i < len; i++) {
+                infusion[i] = letters[next_random() % (sizeof letters - 1)];
+        }
+}
+
+/********** format_row ********
+ *
+ * Format one corrupted row of random pixels.
+ *
+ * Parameters:
+ *      char *out:            output buffer, large enough for the row
+ *      const char *infusion: width + 1 infusion bytes
+ *      int width:            pixels in the row
+ *
+ * Return: number of bytes written, including the final '\n'
+ ************************/
+static size_t format_row(char *out, const char *infusion, int width)
+{
+        size_t len = 0;
+        for (int i = 0; i < width; i++) {
+                out[len++] = infusion[i];
+                len += sprintf(out + len, "%d", (int)(next_random() % 256));
+        }
+        out[len++] = infusion[width];
+        out[len++] = '\n';
+        return len;
+}
+
+/**************** main *****************
+ *
+ * Parse arguments and write rows until the requested size is reached.
+ *
+ * Return:
+ *      EXIT_SUCCESS, or EXIT_FAILURE on bad usage or a write error.
+ ************************/
+int main(int argc, char *argv[])
+{
+        if (argc < 2 || argc > 5) {
+                fprintf(stderr,
+                        "usage: %s BYTES [WIDTH [JUNK_PER_ROW [SEED]]]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+        long long target_bytes = atoll(argv[1]);
+        int width = argc > 2 ? atoi(argv[2]) : DEFAULT_WIDTH;
+        int junk_per_row = argc > 3 ? atoi(argv[3]) : DEFAULT_JUNK_PER_ROW;
+        rng_state = argc > 4 ? strtoull(argv[4], NULL, 10) : DEFAULT_SEED;
+        if (width <= 0 || junk_per_row < 0 || rng_state == 0) {
+                fprintf(stderr, "%s: bad WIDTH, JUNK_PER_ROW or SEED\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        char *target = malloc(width + 1);
+        char *junk = malloc(width + 1);
+        char *row = malloc((size_t)width * MAX_BYTES_PER_PIXEL + 2);
+        if (target == NULL || junk == NULL || row == NULL) {
+                return EXIT_FAILURE;
+        }
+        make_infusion(target, width + 1);
+
+        long long written = 0;
+        while (written < target_bytes) {
+                for (int j = 0; j < junk_per_row && written < target_bytes;
+                     j++) {
+                        make_infusion(junk, width + 1);
+                        size_t len = format_row(row, junk, width);
+                        fwrite(row, 1, len, stdout);
+                        written += len;
+                }
+                size_t len = format_row(row, target, width);
+                fwrite(row, 1, len, stdout);
+                written += len;
+        }
+
+        free(target);
+        free(junk);
+        free(row);
+        return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
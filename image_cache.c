@@ -0,0 +1,513 @@
+/*
+ *     image_cache.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements an on-disk cache of restored images. Each entry is a file
+ *     named after the 64-bit xxHash of the corrupted input (hashed over an
+ *     mmap of the file) and holds the exact P5 bytes restoration produced
+ *     for it. A hit lets restoration skip parsing entirely. Entries are
+ *     written to a temporary file and renamed into place, so readers never
+ *     see a partial entry. When the directory exceeds its entry or byte
+ *     limit, entries are evicted oldest-first by modification time; LRU
+ *     mode refreshes that time on every hit, FIFO mode does not.
+ *
+ *     Cache failures are never fatal: functions report them with NULL or
+ *     0 returns so that restoration can fall back to the uncached path.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image_cache.h"
+
+/* Seed mixed into every key; bump when the P5 output format changes
+ * (last: pixels above MAXVAL are clamped instead of wrapped) */
+#define CACHE_FORMAT_SEED 0x66696c65736f6671ULL
+
+/* Entry file names are 16 hex digits followed by this suffix */
+#define ENTRY_SUFFIX ".pgm"
+#define ENTRY_NAME_LEN (16 + sizeof(ENTRY_SUFFIX) - 1)
+
+/* Struct Definition */
+struct ImageCache {
+        char *dir;
+        long max_entries;
+        long long max_bytes;
+        cache_policy_t policy;
+        char *tmp_path;
+};
+
+/* One cache entry seen while scanning the directory for eviction */
+struct cache_entry {
+        char name[ENTRY_NAME_LEN + 1];
+        long long size;
+        time_t mtime;
+};
+
+/*------------------------xxHash64-------------------------*/
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+        return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+        uint64_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+        uint32_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+        acc += input * PRIME64_2;
+        acc = rotl64(acc, 31);
+        return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+        acc ^= xxh64_round(0, val);
+        return acc * PRIME64_1 + PRIME64_4;
+}
+
+/********** xxh64 ********
+ *
+ * Compute the 64-bit xxHash of a byte buffer.
+ *
+ * Parameters:
+ *      const void *data: bytes to hash (may be NULL if len is 0)
+ *      size_t len:       number of bytes in data
+ *      uint64_t seed:    hash seed
+ *
+ * Return: 64-bit hash of data
+ *
+ * Notes:
+ *      Reads the input as little-endian words, matching the reference
+ *      implementation on the x86-64 machines this runs on.
+ ************************/
+uint64_t xxh64(const void *data, size_t len, uint64_t seed)
+{
+        const unsigned char *p = data;
+        const unsigned char *end = p + len;
+        uint64_t h;
+
+        /* Bulk of the input: four independent lanes of 8 bytes each */
+        if (len >= 32) {
+                uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+                uint64_t v2 = seed + PRIME64_2;
+                uint64_t v3 = seed;
+                uint64_t v4 = seed - PRIME64_1;
+                const unsigned char *limit = end - 32;
+                do {
+                        v1 = xxh64_round(v1, read64(p));
+                        v2 = xxh64_round(v2, read64(p + 8));
+                        v3 = xxh64_round(v3, read64(p + 16));
+                        v4 = xxh64_round(v4, read64(p + 24));
+                        p += 32;
+                } while (p <= limit);
+                h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) +
+                    rotl64(v4, 18);
+                h = xxh64_merge(h, v1);
+                h = xxh64_merge(h, v2);
+                h = xxh64_merge(h, v3);
+                h = xxh64_merge(h, v4);
+        } else {
+                h = seed + PRIME64_5;
+        }
+        h += (uint64_t)len;
+
+        /* Tail: remaining 8-, 4- and 1-byte pieces */
+        for (; p + 8 <= end; p += 8) {
+                h ^= xxh64_round(0, read64(p));
+                h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        }
+        if (p + 4 <= end) {
+                h ^= (uint64_t)read32(p) * PRIME64_1;
+                h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+                p += 4;
+        }
+        for (; p < end; p++) {
+                h ^= (*p) * PRIME64_5;
+                h = rotl64(h, 11) * PRIME64_1;
+        }
+
+        /* Final avalanche */
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        return h;
+}
+
+/*------------------------Helpers-------------------------*/
+
+/********** make_entry_path ********
+ *
+ * Build the path "<dir>/<16 hex digits>.pgm" for a cache key.
+ *
+ * Parameters:
+ *      ImageCache *cache: cache (not NULL)
+ *      uint64_t key:      content hash of the input
+ *
+ * Return: malloc'd path, or NULL if allocation fails. Caller frees.
+ ************************/
+static char *make_entry_path(ImageCache *cache, uint64_t key)
+{
+        size_t len = strlen(cache->dir) + 1 + ENTRY_NAME_LEN + 1;
+        char *path = malloc(len);
+        if (path == NULL) {
+                return NULL;
+        }
+        snprintf(path, len, "%s/%016llx%s", cache->dir,
+                 (unsigned long long)key, ENTRY_SUFFIX);
+        return path;
+}
+
+/********** is_entry_name ********
+ *
+ * Check whether a directory entry name looks like a cache entry.
+ *
+ * Parameters:
+ *      const char *name: file name (not NULL)
+ *
+ * Return: nonzero if name is 16 hex digits followed by ENTRY_SUFFIX
+ ************************/
+static int is_entry_name(const char *name)
+{
+        if (strlen(name) != ENTRY_NAME_LEN) {
+                return 0;
+        }
+        for (int i = 0; i < 16; i++) {
+                char c = name[i];
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+                        return 0;
+                }
+        }
+        return strcmp(name + 16, ENTRY_SUFFIX) == 0;
+}
+
+/********** compare_entry_age ********
+ *
+ * qsort comparator ordering cache entries oldest first.
+ ************************/
+static int compare_entry_age(const void *a, const void *b)
+{
+        const struct cache_entry *x = a;
+        const struct cache_entry *y = b;
+        if (x->mtime != y->mtime) {
+                return x->mtime < y->mtime ? -1 : 1;
+        }
+        return strcmp(x->name, y->name);
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** create_image_cache ********
+ *
+ * Open (creating if needed) a cache directory.
+ *
+ * Parameters:
+ *      const char *dir:       cache directory path (not NULL)
+ *      long max_entries:      maximum number of entries, 0 for unlimited
+ *      long long max_bytes:   maximum total entry bytes, 0 for unlimited
+ *      cache_policy_t policy: eviction order once a limit is exceeded
+ *
+ * Return:
+ *      Pointer to new ImageCache, or NULL if the directory cannot be
+ *      created or allocation fails
+ *
+ * Notes:
+ *      Caller must free with free_image_cache
+ ************************/
+ImageCache *create_image_cache(const char *dir, long max_entries,
+                               long long max_bytes, cache_policy_t policy)
+{
+        if (mkdir(dir, 0777) != 0) {
+                struct stat st;
+                if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                        return NULL;
+                }
+        }
+
+        ImageCache *cache = malloc(sizeof *cache);
+        if (cache == NULL) {
+                return NULL;
+        }
+        *cache = (struct ImageCache){0};
+        cache->dir = malloc(strlen(dir) + 1);
+        if (cache->dir == NULL) {
+                free(cache);
+                return NULL;
+        }
+        strcpy(cache->dir, dir);
+        cache->max_entries = max_entries;
+        cache->max_bytes = max_bytes;
+        cache->policy = policy;
+        return cache;
+}
+
+/********** hash_image_file ********
+ *
+ * Compute the cache key of a file by hashing an mmap of its contents.
+ *
+ * Parameters:
+ *      const char *filename: path of the file to hash (not NULL)
+ *      uint64_t *key:        out; content hash of the file
+ *
+ * Return: 1 on success, 0 if the file cannot be opened or mapped
+ ************************/
+int hash_image_file(const char *filename, uint64_t *key)
+{
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+                return 0;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                return 0;
+        }
+
+        size_t len = (size_t)st.st_size;
+        if (len == 0) {
+                *key = xxh64(NULL, 0, CACHE_FORMAT_SEED);
+                close(fd);
+                return 1;
+        }
+        void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+                return 0;
+        }
+        posix_madvise(data, len, POSIX_MADV_SEQUENTIAL);
+        *key = xxh64(data, len, CACHE_FORMAT_SEED);
+        munmap(data, len);
+        return 1;
+}
+
+/********** image_cache_lookup ********
+ *
+ * Copy the cached output for key to output, if there is one.
+ *
+ * Parameters:
+ *      ImageCache *cache:  cache (not NULL)
+ *      uint64_t key:       content hash of the input
+ *      OutputSink *output: sink to receive the cached P5 bytes (not NULL)
+ *
+ * Return: 1 on a hit (output written), 0 on a miss
+ *
+ * Effects:
+ *      In LRU mode, refreshes the modification time of the hit entry.
+ *      Write errors on output are left for the caller's close of output.
+ ************************/
+int image_cache_lookup(ImageCache *cache, uint64_t key, OutputSink *output)
+{
+        char *path = make_entry_path(cache, key);
+        if (path == NULL) {
+                return 0;
+        }
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                free(path);
+                return 0;
+        }
+        sink_copy_from_fd(output, fd);
+        close(fd);
+        if (cache->policy == CACHE_EVICT_LRU) {
+                utime(path, NULL);
+        }
+        free(path);
+        return 1;
+}
+
+/********** image_cache_begin ********
+ *
+ * Open a temporary entry file that a miss can write its output into.
+ *
+ * Parameters:
+ *      ImageCache *cache: cache (not NULL)
+ *
+ * Return:
+ *      Descriptor opened for reading and writing, or -1 on failure. Pass
+ *      it to image_cache_commit once the output is complete.
+ ************************/
+int image_cache_begin(ImageCache *cache)
+{
+        const char *pattern = "/.tmp-XXXXXX";
+        free(cache->tmp_path);
+        cache->tmp_path = malloc(strlen(cache->dir) + strlen(pattern) + 1);
+        if (cache->tmp_path == NULL) {
+                return -1;
+        }
+        strcpy(cache->tmp_path, cache->dir);
+        strcat(cache->tmp_path, pattern);
+
+        int fd = mkstemp(cache->tmp_path);
+        if (fd < 0) {
+                free(cache->tmp_path);
+                cache->tmp_path = NULL;
+        }
+        return fd;
+}
+
+/********** image_cache_commit ********
+ *
+ * Publish a completed entry under key, or discard an incomplete one.
+ *
+ * Parameters:
+ *      ImageCache *cache: cache (not NULL)
+ *      uint64_t key:      content hash of the input
+ *      int entry_fd:      descriptor returned by image_cache_begin
+ *      int complete:      nonzero if the entry holds the full output
+ *
+ * Return: 1 if the entry was published, 0 otherwise
+ *
+ * Effects:
+ *      Closes entry_fd. Renames the entry into the cache if it is
+ *      complete, otherwise removes it.
+ ************************/
+int image_cache_commit(ImageCache *cache, uint64_t key, int entry_fd,
+                       int complete)
+{
+        char *path = complete ? make_entry_path(cache, key) : NULL;
+        int published = path != NULL && rename(cache->tmp_path, path) == 0;
+        if (!published) {
+                unlink(cache->tmp_path);
+        }
+        close(entry_fd);
+        free(path);
+        free(cache->tmp_path);
+        cache->tmp_path = NULL;
+        return published;
+}
+
+/********** image_cache_evict ********
+ *
+ * Remove entries until the cache is within its entry and byte limits.
+ *
+ * Parameters:
+ *      ImageCache *cache: cache (not NULL)
+ *
+ * Return: number of entries removed
+ ************************/
+long image_cache_evict(ImageCache *cache)
+{
+        if (cache->max_entries <= 0 && cache->max_bytes <= 0) {
+                return 0;
+        }
+        DIR *dir = opendir(cache->dir);
+        if (dir == NULL) {
+                return 0;
+        }
+
+        /* Collect every entry with its size and age */
+        size_t count = 0, capacity = 64;
+        long long total_bytes = 0;
+        struct cache_entry *entries = malloc(capacity * sizeof *entries);
+        struct dirent *de;
+        while (entries != NULL && (de = readdir(dir)) != NULL) {
+                if (!is_entry_name(de->d_name)) {
+                        continue;
+                }
+                char *path = malloc(strlen(cache->dir) + ENTRY_NAME_LEN + 2);
+                struct stat st;
+                if (path == NULL) {
+                        break;
+                }
+                sprintf(path, "%s/%s", cache->dir, de->d_name);
+                int found = stat(path, &st) == 0;
+                free(path);
+                if (!found) {
+                        continue;
+                }
+                if (count == capacity) {
+                        capacity *= 2;
+                        struct cache_entry *grown =
+                                realloc(entries, capacity * sizeof *entries);
+                        if (grown == NULL) {
+                                break;
+                        }
+                        entries = grown;
+                }
+                strcpy(entries[count].name, de->d_name);
+                entries[count].size = (long long)st.st_size;
+                entries[count].mtime = st.st_mtime;
+                total_bytes += entries[count].size;
+                count++;
+        }
+        closedir(dir);
+        if (entries == NULL) {
+                return 0;
+        }
+
+        /* Drop oldest entries first until both limits hold */
+        qsort(entries, count, sizeof *entries, compare_entry_age);
+        long evicted = 0;
+        for (size_t i = 0; i < count; i++) {
+                long remaining = (long)(count - i);
+                int over_entries = cache->max_entries > 0 &&
+                                   remaining > cache->max_entries;
+                int over_bytes = cache->max_bytes > 0 &&
+                                 total_bytes > cache->max_bytes;
+                if (!over_entries && !over_bytes) {
+                        break;
+                }
+                char *path = malloc(strlen(cache->dir) + ENTRY_NAME_LEN + 2);
+                if (path == NULL) {
+                        break;
+                }
+                sprintf(path, "%s/%s", cache->dir, entries[i].name);
+                if (unlink(path) == 0) {
+                        evicted++;
+                }
+                total_bytes -= entries[i].size;
+                free(path);
+        }
+        free(entries);
+        return evicted;
+}
+
+/********** free_image_cache ********
+ *
+ * Free all memory associated with an ImageCache. Entries stay on disk.
+ *
+ * Parameters:
+ *      ImageCache *cache: cache to free (may be NULL)
+ ************************/
+void free_image_cache(ImageCache *cache)
+{
+        if (cache == NULL) {
+                return;
+        }
+        if (cache->tmp_path != NULL) {
+                unlink(cache->tmp_path);
+                free(cache->tmp_path);
+        }
+        free(cache->dir);
+        free(cache);
+}
@@ -0,0 +1,48 @@
+/*
+ *     image_cache.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for ImageCache, an optional on-disk cache mapping the
+ *     content hash of a corrupted input file to its restored P5 output.
+ *     Provides hashing of input files, lookup, insertion of new results,
+ *     and size-bounded eviction.
+ */
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdint.h>
+#include "output_sink.h"
+
+/********** cache_policy_t ********
+ * Eviction order used once the cache exceeds its configured limits.
+ *      CACHE_EVICT_LRU:  evict the entry that was least recently hit
+ *      CACHE_EVICT_FIFO: evict the entry that was inserted first
+ ************************/
+typedef enum cache_policy {
+        CACHE_EVICT_LRU,
+        CACHE_EVICT_FIFO
+} cache_policy_t;
+
+/********** ImageCache ********
+ * Abstract type representing a cache directory and its limits.
+ ************************/
+typedef struct ImageCache ImageCache;
+
+/* Functions */
+ImageCache *create_image_cache(const char *dir, long max_entries,
+                               long long max_bytes, cache_policy_t policy);
+int hash_image_file(const char *filename, uint64_t *key);
+int image_cache_lookup(ImageCache *cache, uint64_t key, OutputSink *output);
+int image_cache_begin(ImageCache *cache);
+int image_cache_commit(ImageCache *cache, uint64_t key, int entry_fd,
+                       int complete);
+long image_cache_evict(ImageCache *cache);
+void free_image_cache(ImageCache *cache);
+
+/* Hashing helper */
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+#endif /* IMAGE_CACHE_H */
@@ -0,0 +1,574 @@
+/*
+ *     image_encoder.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements ImageEncoder. The writer copies each finished row into a
+ *     batch; full batches are queued in a small ring and a worker thread
+ *     compresses them into the destination sink, so row assembly and
+ *     compression overlap. The ring is bounded, so a slow compressor holds
+ *     the writer back instead of buffering the whole image.
+ *
+ *     PNG output uses zlib (HAVE_ZLIB) and unfiltered scanlines at a fast
+ *     deflate level; zstd output uses libzstd (HAVE_ZSTD) and wraps the
+ *     exact bytes the P5 writer would have produced.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_encoder.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Number of row batches queued between the writer and the thread */
+#define ENCODER_SLOTS 4
+
+/* Target size of one row batch */
+#define ENCODER_BATCH_BYTES (1 << 20)
+
+/* Size of one compressed chunk (and of the largest PNG IDAT chunk) */
+#define ENCODER_OUT_BYTES (1 << 18)
+
+/* Compression levels: favour speed, the output is recompressed anyway
+ * by anyone who wants it smaller */
+#define PNG_DEFLATE_LEVEL 1
+#define ZSTD_LEVEL 3
+
+/* Pixels are single bytes */
+#define ENCODER_MAXVAL 255
+
+/* Room for the P5 header inside a zstd frame */
+#define ENCODER_HEADER_MAX 64
+
+/* A run of whole rows queued for compression */
+struct batch {
+        unsigned char *data;
+        size_t len;
+};
+
+/* Struct Definition */
+struct ImageEncoder {
+        output_format_t format;
+        OutputSink *dest;
+        int width;
+        int height;
+        size_t row_bytes;       /* bytes per queued row */
+        size_t batch_capacity;  /* whole rows per batch, in bytes */
+        struct batch slots[ENCODER_SLOTS];
+        int tail;               /* slot the writer is filling */
+        int filling;            /* writer owns slots[tail] */
+
+        /* Guarded by lock */
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        int head;               /* oldest queued batch */
+        int count;              /* queued batches */
+        int finished;           /* no more rows will be queued */
+
+        /* Owned by the thread until it is joined */
+        pthread_t thread;
+        unsigned char *out;
+        int failed;
+#ifdef HAVE_ZLIB
+        z_stream deflater;
+#endif
+#ifdef HAVE_ZSTD
+        ZSTD_CStream *compressor;
+#endif
+};
+
+/*------------------------Helpers-------------------------*/
+
+#ifdef HAVE_ZLIB
+/********** put_be32 ********
+ *
+ * Store a 32-bit value in network byte order.
+ *
+ * Parameters:
+ *      unsigned char *p: destination of 4 bytes
+ *      unsigned long v:  value to store
+ ************************/
+static void put_be32(unsigned char *p, unsigned long v)
+{
+        p[0] = (unsigned char)(v >> 24);
+        p[1] = (unsigned char)(v >> 16);
+        p[2] = (unsigned char)(v >> 8);
+        p[3] = (unsigned char)v;
+}
+
+/********** write_png_chunk ********
+ *
+ * Write one PNG chunk: length, type, data and CRC.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder:     encoder (not NULL)
+ *      const char *type:          4-letter chunk type
+ *      const unsigned char *data: chunk data (may be NULL if len is 0)
+ *      size_t len:                bytes in data
+ ************************/
+static void write_png_chunk(ImageEncoder *encoder, const char *type,
+                            const unsigned char *data, size_t len)
+{
+        unsigned char word[4];
+        put_be32(word, len);
+        sink_write(encoder->dest, word, sizeof word);
+        sink_write(encoder->dest, type, 4);
+        uLong crc = crc32(0L, (const Bytef *)type, 4);
+        if (len > 0) {
+                sink_write(encoder->dest, data, len);
+                crc = crc32(crc, data, (uInt)len);
+        }
+        put_be32(word, crc);
+        sink_write(encoder->dest, word, sizeof word);
+}
+
+/********** png_deflate ********
+ *
+ * Deflate bytes into IDAT chunks.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder:     PNG encoder (not NULL)
+ *      const unsigned char *data: scanlines, each led by its filter byte
+ *      size_t len:                bytes in data
+ *      int flush:                 Z_NO_FLUSH, or Z_FINISH for the end
+ ************************/
+static void png_deflate(ImageEncoder *encoder, const unsigned char *data,
+                        size_t len, int flush)
+{
+        z_stream *strm = &encoder->deflater;
+        strm->next_in = (Bytef *)data;
+        strm->avail_in = (uInt)len;
+        for (;;) {
+                strm->next_out = encoder->out;
+                strm->avail_out = ENCODER_OUT_BYTES;
+                int status = deflate(strm, flush);
+                if (status == Z_STREAM_ERROR) {
+                        encoder->failed = 1;
+                        return;
+                }
+                size_t produced = ENCODER_OUT_BYTES - strm->avail_out;
+                if (produced > 0) {
+                        write_png_chunk(encoder, "IDAT", encoder->out,
+                                        produced);
+                }
+                if (flush == Z_FINISH ? status == Z_STREAM_END
+                                      : strm->avail_out != 0) {
+                        return;
+                }
+        }
+}
+
+/********** png_begin ********
+ *
+ * Write the PNG signature and IHDR, and start the deflate stream.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: PNG encoder (not NULL)
+ ************************/
+static void png_begin(ImageEncoder *encoder)
+{
+        static const unsigned char signature[8] = {
+                0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+        };
+        sink_write(encoder->dest, signature, sizeof signature);
+
+        /* 8-bit grayscale, deflate, no filter method extensions, no
+         * interlace */
+        unsigned char header[13] = {0};
+        put_be32(header, (unsigned long)encoder->width);
+        put_be32(header + 4, (unsigned long)encoder->height);
+        header[8] = 8;
+        write_png_chunk(encoder, "IHDR", header, sizeof header);
+
+        if (deflateInit(&encoder->deflater, PNG_DEFLATE_LEVEL) != Z_OK) {
+                encoder->failed = 1;
+        }
+}
+
+/********** png_end ********
+ *
+ * Finish the deflate stream and write IEND.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: PNG encoder (not NULL)
+ ************************/
+static void png_end(ImageEncoder *encoder)
+{
+        png_deflate(encoder, NULL, 0, Z_FINISH);
+        deflateEnd(&encoder->deflater);
+        write_png_chunk(encoder, "IEND", NULL, 0);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/********** zstd_compress ********
+ *
+ * Feed bytes to the zstd frame.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder:     zstd encoder (not NULL)
+ *      const unsigned char *data: P5 bytes
+ *      size_t len:                bytes in data
+ ************************/
+static void zstd_compress(ImageEncoder *encoder, const unsigned char *data,
+                          size_t len)
+{
+        ZSTD_inBuffer input = { data, len, 0 };
+        while (input.pos < input.size) {
+                ZSTD_outBuffer output = { encoder->out, ENCODER_OUT_BYTES, 0 };
+                size_t status = ZSTD_compressStream(encoder->compressor,
+                                                    &output, &input);
+                if (ZSTD_isError(status)) {
+                        encoder->failed = 1;
+                        return;
+                }
+                sink_write(encoder->dest, encoder->out, output.pos);
+        }
+}
+
+/********** zstd_begin ********
+ *
+ * Start the zstd frame and compress the P5 header into it.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: zstd encoder (not NULL)
+ ************************/
+static void zstd_begin(ImageEncoder *encoder)
+{
+        encoder->compressor = ZSTD_createCStream();
+        if (encoder->compressor == NULL ||
+            ZSTD_isError(ZSTD_initCStream(encoder->compressor, ZSTD_LEVEL))) {
+                encoder->failed = 1;
+                return;
+        }
+        char header[ENCODER_HEADER_MAX];
+        int len = snprintf(header, sizeof header, "P5\n%d %d\n%d\n",
+                           encoder->width, encoder->height, ENCODER_MAXVAL);
+        zstd_compress(encoder, (const unsigned char *)header, len);
+}
+
+/********** zstd_end ********
+ *
+ * Flush and close the zstd frame.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: zstd encoder (not NULL)
+ ************************/
+static void zstd_end(ImageEncoder *encoder)
+{
+        size_t remaining = 1;
+        while (!encoder->failed && remaining != 0) {
+                ZSTD_outBuffer output = { encoder->out, ENCODER_OUT_BYTES, 0 };
+                remaining = ZSTD_endStream(encoder->compressor, &output);
+                if (ZSTD_isError(remaining)) {
+                        encoder->failed = 1;
+                        break;
+                }
+                sink_write(encoder->dest, encoder->out, output.pos);
+        }
+        ZSTD_freeCStream(encoder->compressor);
+}
+#endif
+
+/********** encode_batch ********
+ *
+ * Compress one batch of rows in the encoder's format.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: encoder (not NULL)
+ *      struct batch *batch:   queued batch
+ ************************/
+static void encode_batch(ImageEncoder *encoder, struct batch *batch)
+{
+        if (encoder->failed) {
+                return;
+        }
+#ifdef HAVE_ZLIB
+        if (encoder->format == FORMAT_PNG) {
+                png_deflate(encoder, batch->data, batch->len, Z_NO_FLUSH);
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (encoder->format == FORMAT_ZSTD) {
+                zstd_compress(encoder, batch->data, batch->len);
+        }
+#endif
+        (void)batch;
+}
+
+/********** encode_thread ********
+ *
+ * Thread body: compress queued batches until the writer is finished.
+ *
+ * Parameters:
+ *      void *arg: the ImageEncoder
+ *
+ * Return: NULL
+ ************************/
+static void *encode_thread(void *arg)
+{
+        ImageEncoder *encoder = arg;
+#ifdef HAVE_ZLIB
+        if (encoder->format == FORMAT_PNG) {
+                png_begin(encoder);
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (encoder->format == FORMAT_ZSTD) {
+                zstd_begin(encoder);
+        }
+#endif
+
+        for (;;) {
+                pthread_mutex_lock(&encoder->lock);
+                while (encoder->count == 0 && !encoder->finished) {
+                        pthread_cond_wait(&encoder->changed, &encoder->lock);
+                }
+                if (encoder->count == 0) {
+                        pthread_mutex_unlock(&encoder->lock);
+                        break;
+                }
+                struct batch *batch = &encoder->slots[encoder->head];
+                pthread_mutex_unlock(&encoder->lock);
+
+                /* The writer does not touch queued slots */
+                encode_batch(encoder, batch);
+                batch->len = 0;
+
+                pthread_mutex_lock(&encoder->lock);
+                encoder->head = (encoder->head + 1) % ENCODER_SLOTS;
+                encoder->count--;
+                pthread_cond_broadcast(&encoder->changed);
+                pthread_mutex_unlock(&encoder->lock);
+        }
+
+#ifdef HAVE_ZLIB
+        if (encoder->format == FORMAT_PNG && !encoder->failed) {
+                png_end(encoder);
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (encoder->format == FORMAT_ZSTD) {
+                zstd_end(encoder);
+        }
+#endif
+        return NULL;
+}
+
+/********** queue_batch ********
+ *
+ * Hand the batch being filled to the thread.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: encoder whose writer owns slots[tail]
+ ************************/
+static void queue_batch(ImageEncoder *encoder)
+{
+        pthread_mutex_lock(&encoder->lock);
+        encoder->count++;
+        encoder->filling = 0;
+        pthread_cond_broadcast(&encoder->changed);
+        pthread_mutex_unlock(&encoder->lock);
+}
+
+/********** free_encoder ********
+ *
+ * Free an encoder's buffers and the encoder itself.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: encoder whose thread is not running
+ ************************/
+static void free_encoder(ImageEncoder *encoder)
+{
+        for (int i = 0; i < ENCODER_SLOTS; i++) {
+                free(encoder->slots[i].data);
+        }
+        free(encoder->out);
+        free(encoder);
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** output_format_supported ********
+ *
+ * Report whether this build can write a format.
+ *
+ * Parameters:
+ *      output_format_t format: format to check
+ *
+ * Return: 1 if create_image_encoder accepts format (or it is FORMAT_PGM)
+ ************************/
+int output_format_supported(output_format_t format)
+{
+        switch (format) {
+        case FORMAT_PGM:
+                return 1;
+        case FORMAT_PNG:
+#ifdef HAVE_ZLIB
+                return 1;
+#else
+                return 0;
+#endif
+        case FORMAT_ZSTD:
+#ifdef HAVE_ZSTD
+                return 1;
+#else
+                return 0;
+#endif
+        }
+        return 0;
+}
+
+/********** image_encoder_fits ********
+ *
+ * Report whether a format can hold an image of the given size.
+ *
+ * Parameters:
+ *      output_format_t format: FORMAT_PNG or FORMAT_ZSTD
+ *      int width:              pixels per row
+ *      int height:             number of rows
+ *
+ * Return: 1 if it can (PNG needs at least one pixel), 0 otherwise
+ ************************/
+int image_encoder_fits(output_format_t format, int width, int height)
+{
+        if (format == FORMAT_PGM || width < 0 || height < 0) {
+                return 0;
+        }
+        return format != FORMAT_PNG || (width > 0 && height > 0);
+}
+
+/********** create_image_encoder ********
+ *
+ * Start a thread that compresses an image into dest.
+ *
+ * Parameters:
+ *      OutputSink *dest:       sink receiving the compressed image
+ *      output_format_t format: FORMAT_PNG or FORMAT_ZSTD
+ *      int width:              pixels per row
+ *      int height:             number of rows that will be written
+ *
+ * Return:
+ *      new encoder, or NULL if this build cannot write format, the
+ *      dimensions do not fit it (PNG needs at least one pixel), or
+ *      memory or the thread cannot be had
+ *
+ * Notes:
+ *      dest belongs to the thread until close_image_encoder returns.
+ *      Caller must write exactly height rows and then close the encoder.
+ ************************/
+ImageEncoder *create_image_encoder(OutputSink *dest, output_format_t format,
+                                   int width, int height)
+{
+        if (!output_format_supported(format) ||
+            !image_encoder_fits(format, width, height)) {
+                return NULL;
+        }
+        ImageEncoder *encoder = calloc(1, sizeof *encoder);
+        if (encoder == NULL) {
+                return NULL;
+        }
+        encoder->format = format;
+        encoder->dest = dest;
+        encoder->width = width;
+        encoder->height = height;
+        /* PNG scanlines start with a filter-type byte */
+        encoder->row_bytes = (size_t)width + (format == FORMAT_PNG);
+        size_t rows = encoder->row_bytes == 0 ? 1
+                      : ENCODER_BATCH_BYTES / encoder->row_bytes;
+        encoder->batch_capacity = (rows > 0 ? rows : 1) * encoder->row_bytes;
+
+        int ok = (encoder->out = malloc(ENCODER_OUT_BYTES)) != NULL;
+        for (int i = 0; ok && i < ENCODER_SLOTS; i++) {
+                encoder->slots[i].data = malloc(encoder->batch_capacity + 1);
+                ok = encoder->slots[i].data != NULL;
+        }
+        if (!ok) {
+                free_encoder(encoder);
+                return NULL;
+        }
+
+        pthread_mutex_init(&encoder->lock, NULL);
+        pthread_cond_init(&encoder->changed, NULL);
+        if (pthread_create(&encoder->thread, NULL, encode_thread,
+                           encoder) != 0) {
+                pthread_cond_destroy(&encoder->changed);
+                pthread_mutex_destroy(&encoder->lock);
+                free_encoder(encoder);
+                return NULL;
+        }
+        return encoder;
+}
+
+/********** encoder_write_row ********
+ *
+ * Queue one finished row for compression.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder:    encoder (not NULL)
+ *      const unsigned char *row: width pixels; copied before returning
+ *
+ * Effects:
+ *      Waits while every batch slot is queued.
+ ************************/
+void encoder_write_row(ImageEncoder *encoder, const unsigned char *row)
+{
+        if (!encoder->filling) {
+                pthread_mutex_lock(&encoder->lock);
+                while (encoder->count == ENCODER_SLOTS) {
+                        pthread_cond_wait(&encoder->changed, &encoder->lock);
+                }
+                encoder->tail = (encoder->head + encoder->count) %
+                                ENCODER_SLOTS;
+                pthread_mutex_unlock(&encoder->lock);
+                encoder->filling = 1;
+        }
+
+        struct batch *batch = &encoder->slots[encoder->tail];
+        if (encoder->format == FORMAT_PNG) {
+                /* Filter type 0: the scanline as is */
+                batch->data[batch->len++] = 0;
+        }
+        memcpy(batch->data + batch->len, row, encoder->width);
+        batch->len += encoder->width;
+        if (batch->len + encoder->row_bytes > encoder->batch_capacity) {
+                queue_batch(encoder);
+        }
+}
+
+/********** close_image_encoder ********
+ *
+ * Compress the remaining rows, finish the format, and free the encoder.
+ *
+ * Parameters:
+ *      ImageEncoder *encoder: encoder to close (not NULL)
+ *
+ * Return:
+ *      1 if the image was compressed and written without error, else 0
+ ************************/
+int close_image_encoder(ImageEncoder *encoder)
+{
+        if (encoder->filling) {
+                queue_batch(encoder);
+        }
+        pthread_mutex_lock(&encoder->lock);
+        encoder->finished = 1;
+        pthread_cond_broadcast(&encoder->changed);
+        pthread_mutex_unlock(&encoder->lock);
+        pthread_join(encoder->thread, NULL);
+
+        int ok = !encoder->failed && !sink_failed(encoder->dest);
+        pthread_cond_destroy(&encoder->changed);
+        pthread_mutex_destroy(&encoder->lock);
+        free_encoder(encoder);
+        return ok;
+}
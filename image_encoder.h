@@ -0,0 +1,43 @@
+/*
+ *     image_encoder.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for ImageEncoder, which writes a restored raster to an
+ *     OutputSink in a compressed format instead of raw P5. Rows are handed
+ *     over as they are finalized and compressed on a separate thread, so
+ *     the uncompressed image never has to be written out and read back.
+ */
+
+#ifndef IMAGE_ENCODER_H
+#define IMAGE_ENCODER_H
+
+#include "output_sink.h"
+
+/********** output_format_t ********
+ * Formats restoration can write.
+ *      FORMAT_PGM:  raw P5, written directly (no ImageEncoder needed)
+ *      FORMAT_PNG:  8-bit grayscale PNG, deflated with zlib
+ *      FORMAT_ZSTD: the P5 image inside one zstd frame
+ ************************/
+typedef enum output_format {
+        FORMAT_PGM,
+        FORMAT_PNG,
+        FORMAT_ZSTD
+} output_format_t;
+
+/********** ImageEncoder ********
+ * Abstract type representing a compression thread for one image.
+ ************************/
+typedef struct ImageEncoder ImageEncoder;
+
+/* Functions */
+int output_format_supported(output_format_t format);
+int image_encoder_fits(output_format_t format, int width, int height);
+ImageEncoder *create_image_encoder(OutputSink *dest, output_format_t format,
+                                   int width, int height);
+void encoder_write_row(ImageEncoder *encoder, const unsigned char *row);
+int close_image_encoder(ImageEncoder *encoder);
+
+#endif /* IMAGE_ENCODER_H */
@@ -0,0 +1,397 @@
+/*
+ *     job_server.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements the job server. The parent binds the socket and forks a
+ *     fixed pool of workers; every worker accepts connections on the
+ *     shared socket and runs their jobs one at a time, keeping its heap
+ *     (and whatever the job callback caches) warm between jobs. The
+ *     parent only replaces workers that exit, and stops them all on
+ *     SIGINT or SIGTERM.
+ *
+ *     Workers are processes rather than threads because restoration
+ *     reports errors with CII exceptions, whose handler stack is global
+ *     to a process; each job still parses on its own threads when asked.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "job_server.h"
+
+/* Pending connections the socket queues */
+#define JOB_BACKLOG 128
+
+/* Room for a path like /proc/self/fd/N */
+#define FD_PATH_MAX 64
+
+/* One client connection, read line by line */
+struct connection {
+        int fd;
+        char buffer[JOB_LINE_MAX];
+        size_t len;             /* unread bytes in buffer */
+        int passed_fd;          /* descriptor received, or -1 */
+};
+
+/* Set by the signal handler in the parent */
+static volatile sig_atomic_t stopping = 0;
+
+/*------------------------Helpers-------------------------*/
+
+/********** request_stop ********
+ *
+ * Signal handler: ask the parent to shut the server down.
+ *
+ * Parameters:
+ *      int signo: unused
+ ************************/
+static void request_stop(int signo)
+{
+        (void)signo;
+        stopping = 1;
+}
+
+/********** receive ********
+ *
+ * Read more request bytes, keeping a descriptor sent along with them.
+ *
+ * Parameters:
+ *      struct connection *conn: connection with room left in its buffer
+ *
+ * Return: bytes read, 0 at end of connection, -1 on error
+ ************************/
+static ssize_t receive(struct connection *conn)
+{
+        union {
+                struct cmsghdr align;
+                char bytes[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = { conn->buffer + conn->len,
+                             sizeof conn->buffer - conn->len };
+        struct msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.bytes;
+        msg.msg_controllen = sizeof control.bytes;
+
+        ssize_t n;
+        do {
+                n = recvmsg(conn->fd, &msg, MSG_CMSG_CLOEXEC);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+                return n;
+        }
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL;
+             c = CMSG_NXTHDR(&msg, c)) {
+                if (c->cmsg_level == SOL_SOCKET &&
+                    c->cmsg_type == SCM_RIGHTS) {
+                        int fd;
+                        memcpy(&fd, CMSG_DATA(c), sizeof fd);
+                        if (conn->passed_fd >= 0) {
+                                close(conn->passed_fd);
+                        }
+                        conn->passed_fd = fd;
+                }
+        }
+        conn->len += n;
+        return n;
+}
+
+/********** read_request_line ********
+ *
+ * Read one request line.
+ *
+ * Parameters:
+ *      struct connection *conn: connection (not NULL)
+ *      char *line:              out; JOB_LINE_MAX bytes, NUL-terminated
+ *                               without its '\n'
+ *
+ * Return: 1 for a line, 0 at end of connection, -1 on error or an
+ *         overlong line
+ ************************/
+static int read_request_line(struct connection *conn, char *line)
+{
+        for (;;) {
+                char *end = memchr(conn->buffer, '\n', conn->len);
+                if (end != NULL) {
+                        size_t len = end - conn->buffer;
+                        memcpy(line, conn->buffer, len);
+                        line[len] = '\0';
+                        conn->len -= len + 1;
+                        memmove(conn->buffer, end + 1, conn->len);
+                        return 1;
+                }
+                if (conn->len == sizeof conn->buffer) {
+                        return -1;
+                }
+                ssize_t n = receive(conn);
+                if (n <= 0) {
+                        return n == 0 && conn->len == 0 ? 0 : -1;
+                }
+        }
+}
+
+/********** read_job ********
+ *
+ * Read the input and output lines of the next job.
+ *
+ * Parameters:
+ *      struct connection *conn: connection (not NULL)
+ *      char *input:             out; input path (JOB_LINE_MAX bytes)
+ *      char *output:            out; output path (JOB_LINE_MAX bytes)
+ *
+ * Return: 1 for a job, 0 at end of connection, -1 for a bad request
+ *
+ * Effects:
+ *      For "input-fd", sets input to a path naming the passed descriptor,
+ *      which stays open in conn->passed_fd for the job.
+ ************************/
+static int read_job(struct connection *conn, char *input, char *output)
+{
+        char line[JOB_LINE_MAX];
+        int got = read_request_line(conn, line);
+        if (got <= 0) {
+                return got;
+        }
+        if (strcmp(line, "input-fd") == 0) {
+                if (conn->passed_fd < 0) {
+                        return -1;
+                }
+                snprintf(input, FD_PATH_MAX, "/proc/self/fd/%d",
+                         conn->passed_fd);
+        } else if (strncmp(line, "input ", 6) == 0 && line[6] != '\0') {
+                strcpy(input, line + 6);
+        } else {
+                return -1;
+        }
+
+        if (read_request_line(conn, line) <= 0 ||
+            strncmp(line, "output ", 7) != 0 || line[7] == '\0') {
+                return -1;
+        }
+        strcpy(output, line + 7);
+        return 1;
+}
+
+/********** serve_connection ********
+ *
+ * Run every job a client sends until it hangs up or sends a bad request.
+ *
+ * Parameters:
+ *      int fd:               accepted connection
+ *      serve_job_fn run_job: job callback
+ *      void *cl:             passed to run_job
+ *
+ * Return: 1 if every job succeeded, 0 if one failed
+ ************************/
+static int serve_connection(int fd, serve_job_fn run_job, void *cl)
+{
+        int reply_fd = dup(fd);
+        FILE *reply = reply_fd >= 0 ? fdopen(reply_fd, "w") : NULL;
+        if (reply == NULL) {
+                if (reply_fd >= 0) {
+                        close(reply_fd);
+                }
+                return 1;
+        }
+        struct connection *conn = malloc(sizeof *conn);
+        if (conn == NULL) {
+                fclose(reply);
+                return 1;
+        }
+        conn->fd = fd;
+        conn->len = 0;
+        conn->passed_fd = -1;
+
+        char input[JOB_LINE_MAX];
+        char output[JOB_LINE_MAX];
+        int ok = 1;
+        int got;
+        while ((got = read_job(conn, input, output)) != 0) {
+                int done = got > 0 && run_job(input, output, reply, cl);
+                fputs(done ? "ok\n" : "error\n", reply);
+                fflush(reply);
+                if (conn->passed_fd >= 0) {
+                        close(conn->passed_fd);
+                        conn->passed_fd = -1;
+                }
+                if (got < 0) {
+                        /* The rest of the stream cannot be trusted */
+                        break;
+                }
+                ok = ok && done;
+        }
+        fclose(reply);
+        free(conn);
+        return ok;
+}
+
+/********** worker_main ********
+ *
+ * Body of a worker process: accept and serve connections until a job
+ * fails; the worker then exits once that connection is done.
+ *
+ * Parameters:
+ *      int listen_fd:        listening socket
+ *      serve_job_fn run_job: job callback
+ *      void *cl:             passed to run_job
+ ************************/
+static void worker_main(int listen_fd, serve_job_fn run_job, void *cl)
+{
+        /* A client that hangs up early must not kill the worker */
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        for (;;) {
+                int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (fd < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) {
+                                continue;
+                        }
+                        _exit(EXIT_FAILURE);
+                }
+                int ok = serve_connection(fd, run_job, cl);
+                close(fd);
+                if (!ok) {
+                        _exit(EXIT_FAILURE);
+                }
+        }
+}
+
+/********** start_worker ********
+ *
+ * Fork one worker process.
+ *
+ * Parameters:
+ *      int listen_fd:        listening socket
+ *      serve_job_fn run_job: job callback
+ *      void *cl:             passed to run_job
+ *
+ * Return: the worker's pid, or -1 if fork fails
+ ************************/
+static pid_t start_worker(int listen_fd, serve_job_fn run_job, void *cl)
+{
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0) {
+                worker_main(listen_fd, run_job, cl);
+        }
+        return pid;
+}
+
+/********** open_socket ********
+ *
+ * Bind and listen on a Unix domain socket, replacing a stale one.
+ *
+ * Parameters:
+ *      const char *socket_path: path to bind
+ *
+ * Return: listening socket, or -1 on failure
+ ************************/
+static int open_socket(const char *socket_path)
+{
+        struct sockaddr_un addr = {0};
+        if (strlen(socket_path) >= sizeof addr.sun_path) {
+                return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+                return -1;
+        }
+        unlink(socket_path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+            listen(fd, JOB_BACKLOG) != 0) {
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** serve_jobs ********
+ *
+ * Serve restoration jobs on a Unix domain socket until SIGINT or
+ * SIGTERM.
+ *
+ * Parameters:
+ *      const char *socket_path: socket to create (not NULL)
+ *      int workers:             number of worker processes (> 0)
+ *      serve_job_fn run_job:    runs one job (not NULL)
+ *      void *cl:                passed to run_job
+ *
+ * Return:
+ *      1 after a clean shutdown, 0 if the socket or the first workers
+ *      cannot be set up
+ *
+ * Effects:
+ *      Removes the socket on return. run_job only ever runs in worker
+ *      processes, one job at a time per worker.
+ ************************/
+int serve_jobs(const char *socket_path, int workers, serve_job_fn run_job,
+               void *cl)
+{
+        int listen_fd = open_socket(socket_path);
+        if (listen_fd < 0) {
+                return 0;
+        }
+        pid_t *pids = calloc(workers, sizeof *pids);
+        if (pids == NULL) {
+                close(listen_fd);
+                unlink(socket_path);
+                return 0;
+        }
+
+        /* No SA_RESTART: a signal must interrupt waitpid */
+        struct sigaction stop = {0};
+        stop.sa_handler = request_stop;
+        sigemptyset(&stop.sa_mask);
+        sigaction(SIGINT, &stop, NULL);
+        sigaction(SIGTERM, &stop, NULL);
+
+        int started = 1;
+        for (int i = 0; i < workers; i++) {
+                pids[i] = start_worker(listen_fd, run_job, cl);
+                started = started && pids[i] > 0;
+        }
+        while (started && !stopping) {
+                int status;
+                pid_t pid = waitpid(-1, &status, 0);
+                if (pid < 0) {
+                        if (errno != EINTR) {
+                                break;
+                        }
+                        continue;
+                }
+                /* Replace the worker that exited */
+                for (int i = 0; i < workers; i++) {
+                        if (pids[i] == pid) {
+                                pids[i] = start_worker(listen_fd, run_job,
+                                                       cl);
+                        }
+                }
+        }
+
+        for (int i = 0; i < workers; i++) {
+                if (pids[i] > 0) {
+                        kill(pids[i], SIGTERM);
+                        waitpid(pids[i], NULL, 0);
+                }
+        }
+        free(pids);
+        close(listen_fd);
+        unlink(socket_path);
+        return started;
+}
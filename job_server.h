@@ -0,0 +1,47 @@
+/*
+ *     job_server.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for the job server behind restoration --serve. It listens
+ *     on a Unix domain socket and runs restoration jobs in long-lived
+ *     worker processes, so a batch of small images does not pay for a
+ *     process start per image.
+ *
+ *     Protocol: a client sends one job as two lines,
+ *         input PATH        (or "input-fd", with the open input passed
+ *                            as SCM_RIGHTS data on the same message)
+ *         output PATH
+ *     and the server answers with whatever the job reports (one
+ *     "name value" line per counter), then "ok" or "error". A connection
+ *     may carry any number of jobs, one after another.
+ */
+
+#ifndef JOB_SERVER_H
+#define JOB_SERVER_H
+
+#include <stdio.h>
+
+/* Longest request line the server accepts */
+#define JOB_LINE_MAX 4096
+
+/********** serve_job_fn ********
+ * Callback run in a worker process for every job.
+ *      const char *input_path:  file to restore (a /proc/self/fd path for
+ *                               a passed descriptor)
+ *      const char *output_path: file to write
+ *      FILE *reply:             stream back to the client, for counters
+ *      void *cl:                closure given to serve_jobs
+ * Returns nonzero if the job succeeded. After a failed job the worker
+ * finishes the connection, then exits and is replaced, so state a
+ * failure leaves behind is not reused for long.
+ ************************/
+typedef int (*serve_job_fn)(const char *input_path, const char *output_path,
+                            FILE *reply, void *cl);
+
+/* Functions */
+int serve_jobs(const char *socket_path, int workers, serve_job_fn run_job,
+               void *cl);
+
+#endif /* JOB_SERVER_H */
@@ -8,64 +8,659 @@
  *     strings. The first duplicate occurrence of a string marks it as the
  *     "target" string. Clients can retrieve the arrays corresponding to
  *     that target for reconstruction.
+ *
+ *     Insertion is thread safe. Groups live in GROUP_STRIPES chained hash
+ *     tables, each behind its own mutex and picked by the low fingerprint
+ *     bits; the per-length counters are striped the same way. Locks are
+ *     taken in the order length stripe, group stripe, target lock. Every
+ *     row records the input line it came from, so the target does not
+ *     depend on which thread got there first: it is the repeated group
+ *     whose latest line is latest, which is the group of the last repeat
+ *     a sequential pass would see.
+ *
+ *     Keys of up to KEY_INLINE_MAX bytes (most infusions) are stored in
+ *     the group itself, so a lookup compares them without following a
+ *     pointer, and so is a group's first row: almost every group is a
+ *     junk line that never gets a second one. Later rows go into blocks
+ *     of doubling size. Groups, row blocks and longer keys are carved
+ *     out of an arena owned by the stripe that created them and are
+ *     freed with the table, so a group costs no allocation of its own.
+ *     Arena
+ *     chunks and hash chains come from page_alloc, so a table created in
+ *     ALLOC_HUGE mode keeps them on huge pages.
+ *
+ *     A table made by create_line_table_lazy stores each row as a copy
+ *     of its raw text in the same arenas and parses only the target's
+ *     rows, when get_reconstructed_digits asks for them; the lines of
+ *     junk infusions are never parsed at all.
+ *
+ *     Keys arrive with their fingerprint (see fingerprint.h), which the
+ *     tokenizer computes while it copies the infusion out of the line, so
+ *     the table never reads a key's bytes again except to compare them
+ *     with a group whose fingerprint matches.
+ *
+ *     add_batch_to_line_table prefetches the chains and groups of a batch
+ *     of lines before inserting any of them, so the cache misses of a
+ *     table with millions of groups overlap instead of stalling one
+ *     insertion after another.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "atom.h"
-#include "table.h"
+#include <string.h>
 #include "seq.h"
+#include "fingerprint.h"
 #include "line_table.h"
+#include "page_alloc.h"
+
+/* Independent hash tables (a power of two) */
+#define GROUP_STRIPES 256
+
+/* Initial chains per group stripe (a power of two) */
+#define INITIAL_STRIPE_BUCKETS 64
+
+/* Independent sets of per-length counters */
+#define LENGTH_STRIPES 64
+
+/* Initial number of per-length counters in each stripe */
+#define INITIAL_LENGTHS 4
+
+/* Longest key stored inline in its group */
+#define KEY_INLINE_MAX 23
+
+/* Size of one arena chunk (ALLOC_DEFAULT; ALLOC_HUGE uses huge pages) */
+#define ARENA_CHUNK_BYTES (1 << 16)
+
+/* Alignment of arena allocations */
+#define ARENA_ALIGN sizeof(void *)
+
+/* Rows in a group's first row block, and the most in any block */
+#define ROW_BLOCK_ROWS 4
+#define ROW_BLOCK_MAX_ROWS 256
+
+/* Hint that memory is about to be read */
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+/* One line's integers (or raw text) and its position in the input */
+struct row {
+        int *digits;            /* NULL until a lazy row is parsed */
+        const char *text;       /* raw line in an arena (lazy tables) */
+        long index;
+        int len;                /* integers in digits, else bytes of text */
+};
+
+/* Rows of a group after its first, in an arena */
+struct row_block {
+        struct row_block *next;         /* older block */
+        int count;
+        int capacity;
+        struct row rows[];
+};
+
+/* Arena storage for groups and keys longer than KEY_INLINE_MAX */
+struct arena_chunk {
+        struct arena_chunk *next;
+        size_t used;
+        size_t size;            /* bytes allocated, including this header */
+        char bytes[];
+};
+
+/* All lines sharing one string, in insertion order */
+struct group {
+        uint64_t fingerprint;   /* of the key, from fingerprint.h */
+        union {
+                char bytes[KEY_INLINE_MAX];     /* key_len <= max */
+                const char *arena;              /* longer keys */
+        } key;
+        int key_len;
+        struct group *next;     /* chain within the stripe */
+        struct row first;       /* first row stored */
+        struct row_block *more; /* later rows, newest block first */
+        int count;              /* rows, counting first */
+        long max_index;         /* latest line of the group */
+        int max_len;            /* number of integers (or bytes of text)
+                                   on that line */
+};
 
-#define INITIAL_TABLE_SIZE 10000
+/* One hash table of groups */
+struct group_stripe {
+        pthread_mutex_t lock;
+        struct arena_chunk *arena;
+        struct group **buckets;
+        size_t nbuckets;
+        size_t ngroups;
+};
+
+/* Lines seen for one string length */
+struct length_bucket {
+        long lines;
+        struct group *pending;  /* only line of this length, not hashed */
+};
+
+/* Counters for lengths l with l % LENGTH_STRIPES equal to the stripe's
+ * position, stored at l / LENGTH_STRIPES */
+struct length_stripe {
+        pthread_mutex_t lock;
+        struct arena_chunk *arena;
+        struct length_bucket *lengths;
+        int size;
+};
 
 /* Struct Definition */
 struct LineTable {
-        const char *original_string;
+        alloc_mode_t mode;
+        row_parser_fn parse_row;        /* NULL unless rows keep text */
+        struct group_stripe groups[GROUP_STRIPES];
+        struct length_stripe lengths[LENGTH_STRIPES];
+        pthread_mutex_t target_lock;
+        struct group *original;
+        long original_index;    /* latest line of original */
         int original_row_size;
-        Table_T t;
+        long next_index;        /* line numbers for add_to_line_table */
+        struct row *target;     /* original's rows in input order */
+        int **target_rows;      /* built by get_reconstructed_digits */
 };
 
-/********** line_table_contains ********
+/********** arena_alloc ********
  *
- * Check if the table already contains a key.
+ * Carve memory out of an arena, starting a new chunk when the current
+ * one is full.
  *
  * Parameters:
- *      LineTable *lt:   line table (not NULL)
- *      const char *key: string key (not NULL, already atomized)
+ *      LineTable *lt:              line table (not NULL)
+ *      struct arena_chunk **arena: in/out; newest chunk first (locked by
+ *                                  the caller)
+ *      size_t size:                bytes needed
  *
- * Return: nonzero if present, 0 if not
+ * Return: ARENA_ALIGN-aligned memory, or NULL if allocation fails
+ ***************************************/
+static void *arena_alloc(LineTable *lt, struct arena_chunk **arena,
+                         size_t size)
+{
+        size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        struct arena_chunk *chunk = *arena;
+        if (chunk == NULL ||
+            sizeof *chunk + chunk->used + size > chunk->size) {
+                /* Huge-page arenas double up to a whole huge page, so
+                 * small inputs do not fault in 2 MB per stripe */
+                size_t chunk_size = ARENA_CHUNK_BYTES;
+                if (lt->mode == ALLOC_HUGE && chunk != NULL) {
+                        chunk_size = 2 * chunk->size < HUGE_PAGE_SIZE
+                                     ? 2 * chunk->size : HUGE_PAGE_SIZE;
+                }
+                if (sizeof *chunk + size > chunk_size) {
+                        chunk_size = sizeof *chunk + size;
+                }
+                chunk = page_alloc(chunk_size, lt->mode);
+                if (chunk == NULL) {
+                        return NULL;
+                }
+                chunk->next = *arena;
+                chunk->used = 0;
+                chunk->size = chunk_size;
+                *arena = chunk;
+        }
+        void *p = chunk->bytes + chunk->used;
+        chunk->used += size;
+        return p;
+}
+
+/********** free_arena ********
  *
- * Expects:
- *      lt and key are not NULL
+ * Free every chunk of an arena.
+ *
+ * Parameters:
+ *      LineTable *lt:             line table the arena belongs to
+ *      struct arena_chunk *arena: newest chunk (may be NULL)
+ ***************************************/
+static void free_arena(LineTable *lt, struct arena_chunk *arena)
+{
+        while (arena != NULL) {
+                struct arena_chunk *next = arena->next;
+                page_free(arena, arena->size, lt->mode);
+                arena = next;
+        }
+}
+
+/********** group_key ********
+ *
+ * Get the bytes of a group's key.
+ *
+ * Parameters:
+ *      const struct group *g: group (not NULL)
+ *
+ * Return: key_len bytes, inline or in an arena
+ ***************************************/
+static const char *group_key(const struct group *g)
+{
+        return g->key_len <= KEY_INLINE_MAX ? g->key.bytes : g->key.arena;
+}
+
+/********** free_group ************
+ *
+ * Free the arrays stored in a group. The group, its row blocks and a
+ * long key stay in their arena until the table is freed.
+ *
+ * Parameters:
+ *      struct group *g: group to free
+ ***************************************/
+static void free_group(struct group *g)
+{
+        free(g->first.digits);
+        for (struct row_block *b = g->more; b != NULL; b = b->next) {
+                for (int i = 0; i < b->count; i++) {
+                        free(b->rows[i].digits);
+                }
+        }
+}
+
+/********** gather_rows ************
+ *
+ * Copy a group's rows into one array, in the order they were stored.
+ *
+ * Parameters:
+ *      const struct group *g: group (not NULL)
+ *      struct row *rows:      out; room for g->count rows
+ ***************************************/
+static void gather_rows(const struct group *g, struct row *rows)
+{
+        /* Blocks are newest first: fill from the end */
+        int end = g->count;
+        for (struct row_block *b = g->more; b != NULL; b = b->next) {
+                end -= b->count;
+                memcpy(rows + end, b->rows, b->count * sizeof *rows);
+        }
+        rows[0] = g->first;
+}
+
+/********** group_add_row ********
+ *
+ * Append a row to a group, copying a row's text into an arena.
+ *
+ * Parameters:
+ *      LineTable *lt:              line table (not NULL)
+ *      struct arena_chunk **arena: arena for the text (locked by the
+ *                                  caller, like g)
+ *      struct group *g:            group (locked by the caller if shared)
+ *      struct row row:             row to store
+ *
+ * Return: 1 on success, 0 if the text or a row block cannot be had
+ ***************************************/
+static int group_add_row(LineTable *lt, struct arena_chunk **arena,
+                         struct group *g, struct row row)
+{
+        if (row.text != NULL) {
+                char *text = arena_alloc(lt, arena, row.len);
+                if (text == NULL) {
+                        return 0;
+                }
+                memcpy(text, row.text, row.len);
+                row.text = text;
+        }
+        if (g->count == 0) {
+                g->first = row;
+        } else {
+                struct row_block *b = g->more;
+                if (b == NULL || b->count == b->capacity) {
+                        int capacity = b == NULL ? ROW_BLOCK_ROWS :
+                                       b->capacity < ROW_BLOCK_MAX_ROWS ?
+                                       2 * b->capacity : b->capacity;
+                        b = arena_alloc(lt, arena, sizeof *b + 
+                                        capacity * sizeof b->rows[0]);
+                        if (b == NULL) {
+                                return 0;
+                        }
+                        b->next = g->more;
+                        b->count = 0;
+                        b->capacity = capacity;
+                        g->more = b;
+                }
+                b->rows[b->count++] = row;
+        }
+        g->count++;
+        if (row.index > g->max_index) {
+                g->max_index = row.index;
+                g->max_len = row.len;
+        }
+        return 1;
+}
+
+/********** new_group ********
+ *
+ * Allocate a group holding a copy of s and a single row.
+ *
+ * Parameters:
+ *      LineTable *lt:              line table (not NULL)
+ *      struct arena_chunk **arena: arena for the group and a long s
+ *                                  (locked by the caller)
+ *      const char *s:              string (s_len bytes)
+ *      int s_len:                  length of s
+ *      uint64_t fp:                fingerprint of s
+ *      struct row row:             first row of the group
+ *
+ * Return: new group, or NULL if allocation fails
+ ***************************************/
+static struct group *new_group(LineTable *lt, struct arena_chunk **arena,
+                               const char *s, int s_len, uint64_t fp,
+                               struct row row)
+{
+        struct group *g = arena_alloc(lt, arena, sizeof *g);
+        if (g == NULL) {
+                return NULL;
+        }
+        if (s_len <= KEY_INLINE_MAX) {
+                memcpy(g->key.bytes, s, s_len);
+        } else {
+                char *key = arena_alloc(lt, arena, s_len);
+                if (key == NULL) {
+                        return NULL;
+                }
+                memcpy(key, s, s_len);
+                g->key.arena = key;
+        }
+        g->fingerprint = fp;
+        g->key_len = s_len;
+        g->next = NULL;
+        g->more = NULL;
+        g->count = 0;
+        g->max_index = -1;
+        g->max_len = 0;
+        if (!group_add_row(lt, arena, g, row)) {
+                return NULL;
+        }
+        return g;
+}
+
+/********** group_stripe ********
+ *
+ * Get the hash table responsible for a fingerprint.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *      uint64_t fp:   fingerprint
+ *
+ * Return: the stripe
+ ***************************************/
+static struct group_stripe *group_stripe(LineTable *lt, uint64_t fp)
+{
+        return &lt->groups[fp & (GROUP_STRIPES - 1)];
+}
+
+/********** stripe_chain ********
+ *
+ * Get the chain a fingerprint belongs to within its stripe. The stripe
+ * already used the low bits, so the chain is picked by the ones above.
+ *
+ * Parameters:
+ *      struct group_stripe *gs: stripe of fp
+ *      uint64_t fp:             fingerprint
+ *
+ * Return: the chain's head pointer
+ ***************************************/
+static struct group **stripe_chain(struct group_stripe *gs, uint64_t fp)
+{
+        return &gs->buckets[(fp / GROUP_STRIPES) & (gs->nbuckets - 1)];
+}
+
+/********** stripe_find ********
+ *
+ * Look a string up in its stripe.
+ *
+ * Parameters:
+ *      struct group_stripe *gs: locked stripe of fp
+ *      uint64_t fp:             fingerprint of s
+ *      const char *s:           string (s_len bytes)
+ *      int s_len:               length of s
+ *
+ * Return: the group holding s, or NULL
+ ***************************************/
+static struct group *stripe_find(struct group_stripe *gs, uint64_t fp,
+                                 const char *s, int s_len)
+{
+        for (struct group *g = *stripe_chain(gs, fp); g != NULL;
+             g = g->next) {
+                if (g->fingerprint == fp && g->key_len == s_len &&
+                    memcmp(group_key(g), s, s_len) == 0) {
+                        return g;
+                }
+        }
+        return NULL;
+}
+
+/********** stripe_insert ********
+ *
+ * Add a group to its stripe, doubling the chains once there are as many
+ * groups as chains.
+ *
+ * Parameters:
+ *      LineTable *lt:           line table (not NULL)
+ *      struct group_stripe *gs: locked stripe of g
+ *      struct group *g:         group with its fingerprint set
+ *
+ * Notes:
+ *      Growing is best effort; if it fails the chains just get longer
  ***************************************/
-static int line_table_contains(LineTable *lt, const char *key) 
+static void stripe_insert(LineTable *lt, struct group_stripe *gs,
+                          struct group *g)
 {
-        return Table_get(lt->t, key) != NULL;
+        if (gs->ngroups >= gs->nbuckets) {
+                size_t nbuckets = 2 * gs->nbuckets;
+                struct group **buckets =
+                        page_alloc(nbuckets * sizeof *buckets, lt->mode);
+                if (buckets != NULL) {
+                        struct group_stripe grown = *gs;
+                        grown.buckets = buckets;
+                        grown.nbuckets = nbuckets;
+                        for (size_t i = 0; i < gs->nbuckets; i++) {
+                                struct group *p = gs->buckets[i];
+                                while (p != NULL) {
+                                        struct group *next = p->next;
+                                        struct group **chain =
+                                            stripe_chain(&grown,
+                                                         p->fingerprint);
+                                        p->next = *chain;
+                                        *chain = p;
+                                        p = next;
+                                }
+                        }
+                        page_free(gs->buckets,
+                                  gs->nbuckets * sizeof *gs->buckets,
+                                  lt->mode);
+                        gs->buckets = buckets;
+                        gs->nbuckets = nbuckets;
+                }
+        }
+        struct group **chain = stripe_chain(gs, g->fingerprint);
+        g->next = *chain;
+        *chain = g;
+        gs->ngroups++;
 }
 
-/*********** get_or_make_seq ***********
+/********** note_repeat ********
  *
- * Finds the sequence in the table associated to a given key.
- * If there is no any coincidences, it creates a new sequence and returns it.
+ * Make a repeated group the target if its latest line is the latest
+ * repeated line seen so far.
  *
  * Parameters:
  *      LineTable *lt:   line table (not NULL)
- *      const char *key: string key (not NULL, already atomized)
+ *      struct group *g: group with at least two rows (stripe locked)
+ ***************************************/
+static void note_repeat(LineTable *lt, struct group *g)
+{
+        pthread_mutex_lock(&lt->target_lock);
+        if (lt->original == NULL || g->max_index >= lt->original_index) {
+                lt->original = g;
+                lt->original_index = g->max_index;
+                lt->original_row_size = g->max_len;
+        }
+        pthread_mutex_unlock(&lt->target_lock);
+}
+
+/********** length_bucket ********
  *
- * Return: sequence matching key if present, new sequence if key not in table
+ * Get the counters for one string length, growing its stripe if needed.
  *
- * Expects:
- *      lt and key are not NULL.
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *      int s_len:     string length (>= 0, its stripe locked)
+ *
+ * Return: the bucket, or NULL if allocation fails
  ***************************************/
-static Seq_T get_or_make_seq(LineTable *lt, const char *key) 
+static struct length_bucket *length_bucket(LineTable *lt, int s_len)
 {
-        Seq_T seq = Table_get(lt->t, key);
-        if (seq == NULL) {
-                seq = Seq_new(0);
-                Table_put(lt->t, key, seq);
+        struct length_stripe *ls = &lt->lengths[s_len % LENGTH_STRIPES];
+        int i = s_len / LENGTH_STRIPES;
+        if (i >= ls->size) {
+                int size = ls->size > 0 ? ls->size : INITIAL_LENGTHS;
+                while (size <= i) {
+                        size *= 2;
+                }
+                struct length_bucket *lengths =
+                        realloc(ls->lengths, size * sizeof *lengths);
+                if (lengths == NULL) {
+                        return NULL;
+                }
+                memset(lengths + ls->size, 0,
+                       (size - ls->size) * sizeof *lengths);
+                ls->lengths = lengths;
+                ls->size = size;
         }
-        return seq;
+        return &ls->lengths[i];
+}
+
+/********** count_length ********
+ *
+ * Count a string in its length bucket. The first string of a length is
+ * parked there outside any stripe; the second one moves the parked group
+ * into its stripe before the length lock is released, so any later
+ * string of that length finds it.
+ *
+ * Parameters:
+ *      LineTable *lt:  line table (not NULL)
+ *      char *s:        string key (s_len bytes)
+ *      int s_len:      length of string
+ *      uint64_t fp:    fingerprint of s
+ *      struct row row: row to store
+ *
+ * Return:
+ *      1 if the row was parked, 0 if it still has to go into a stripe,
+ *      -1 if memory runs out
+ ***************************************/
+static int count_length(LineTable *lt, char *s, int s_len, uint64_t fp,
+                        struct row row)
+{
+        struct length_stripe *ls = &lt->lengths[s_len % LENGTH_STRIPES];
+        int parked = 0;
+        pthread_mutex_lock(&ls->lock);
+        struct length_bucket *bucket = length_bucket(lt, s_len);
+        if (bucket == NULL) {
+                parked = -1;
+        } else if (bucket->lines == 0) {
+                /* Nothing of this length to repeat yet */
+                bucket->pending = new_group(lt, &ls->arena, s, s_len, fp,
+                                            row);
+                if (bucket->pending == NULL) {
+                        parked = -1;
+                } else {
+                        bucket->lines = 1;
+                        parked = 1;
+                }
+        } else {
+                struct group *pending = bucket->pending;
+                if (pending != NULL) {
+                        struct group_stripe *gs =
+                                group_stripe(lt, pending->fingerprint);
+                        pthread_mutex_lock(&gs->lock);
+                        stripe_insert(lt, gs, pending);
+                        pthread_mutex_unlock(&gs->lock);
+                        bucket->pending = NULL;
+                }
+                bucket->lines++;
+        }
+        pthread_mutex_unlock(&ls->lock);
+        return parked;
+}
+
+/********** insert_row ********
+ *
+ * Store a row under its string key.
+ *
+ * Parameters:
+ *      LineTable *lt:  line table (not NULL)
+ *      char *s:        string key (not NULL, copied)
+ *      int s_len:      length of string
+ *      uint64_t fp:    fingerprint of s
+ *      struct row row: row to store; its text, if any, is copied
+ *
+ * Return: 1 on success, 0 if memory runs out
+ ***************************************/
+static int insert_row(LineTable *lt, char *s, int s_len, uint64_t fp,
+                      struct row row)
+{
+        int parked = count_length(lt, s, s_len, fp, row);
+        if (parked != 0) {
+                return parked > 0;
+        }
+
+        struct group_stripe *gs = group_stripe(lt, fp);
+        int stored = 1;
+        pthread_mutex_lock(&gs->lock);
+        struct group *g = stripe_find(gs, fp, s, s_len);
+        if (g != NULL) {
+                /* If string is already present in table (target string) */
+                stored = group_add_row(lt, &gs->arena, g, row);
+                if (stored) {
+                        note_repeat(lt, g);
+                }
+        } else {
+                g = new_group(lt, &gs->arena, s, s_len, fp, row);
+                if (g == NULL) {
+                        stored = 0;
+                } else {
+                        stripe_insert(lt, gs, g);
+                }
+        }
+        pthread_mutex_unlock(&gs->lock);
+        return stored;
+}
+
+/********** add_to_line_table_at ********
+ *
+ * Insert a new integer array under string key, remembering which input
+ * line it came from. Safe to call from several threads at once.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *      char *s:       string key (not NULL, copied)
+ *      int s_len:     length of string
+ *      uint64_t fp:   fingerprint of s, as fingerprint.h computes it
+ *      int *intarr:   integer array to store (not NULL)
+ *      int len:       number of integers in intarr
+ *      long index:    position of the line in the input (distinct for
+ *                     every row of one table)
+ *
+ * Return:
+ *      1 on success, 0 if memory runs out (intarr is then not stored)
+ *
+ * Effects:
+ *      Pushes intarr onto the group stored under key. Once a group has
+ *      two rows it is a candidate target; the target is the candidate
+ *      whose latest line is latest, and lt->original_row_size is the
+ *      length of that line.
+ ***************************************/
+int add_to_line_table_at(LineTable *lt, char *s, int s_len, uint64_t fp,
+                         int *intarr, int len, long index)
+{
+        return insert_row(lt, s, s_len, fp,
+                          (struct row){ intarr, NULL, index, len });
 }
 
 /********** add_to_line_table ********
@@ -75,30 +670,242 @@ static Seq_T get_or_make_seq(LineTable *lt, const char *key)
  *
  * Parameters:
  *      LineTable *lt: line table (not NULL)
- *      char *s:       string key (not NULL, will be atomized)
+ *      char *s:       string key (not NULL, copied)
  *      int s_len:     length of string
  *      int *intarr:   integer array to store (not NULL)
  *      int len:       number of integers in intarr
  *
+ * Return:
+ *      1 on success, 0 if memory runs out (intarr is then not stored)
+ *
  * Effects:
- *      Updates lt->original_string and lt->original_row_size if s has
- *      appeared before.
- *      Pushes intarr onto the seq stored in the table under key.
+ *      Same as add_to_line_table_at, numbering lines in call order and
+ *      fingerprinting s itself.
  *
- * Checked Runtime Errors:
- *      CRE if lt or s or intarr is NULL
+ * Notes:
+ *      Not for concurrent use; threads number their own lines and call
+ *      add_to_line_table_at
  ***************************************/
-void add_to_line_table(LineTable *lt, char *s, int s_len, int *intarr, int len) 
+int add_to_line_table(LineTable *lt, char *s, int s_len, int *intarr, int len) 
 { 
-        const char *key = Atom_new(s, s_len); 
-        /* If string is already present in table (target string) */
-        if (line_table_contains(lt, key)) {
-                lt->original_string = key;
-                lt->original_row_size = len;
-        } 
+        return add_to_line_table_at(lt, s, s_len, fingerprint_bytes(s, s_len),
+                                    intarr, len, lt->next_index++);
+}
+
+/********** add_text_to_line_table_at ********
+ *
+ * Insert a line's raw text under string key, to be parsed only if the
+ * key turns out to be the target. Safe to call from several threads at
+ * once.
+ *
+ * Parameters:
+ *      LineTable *lt:    line table made by create_line_table_lazy
+ *      char *s:          string key (not NULL, copied)
+ *      int s_len:        length of string
+ *      uint64_t fp:      fingerprint of s, as fingerprint.h computes it
+ *      const char *text: the line (not NULL, copied)
+ *      int text_len:     bytes in text (> 0)
+ *      long index:       position of the line in the input (distinct
+ *                        for every row of one table)
+ *
+ * Return:
+ *      1 on success, 0 if memory runs out
+ *
+ * Effects:
+ *      Same as add_to_line_table_at; the copy of text lives in the
+ *      table's arenas.
+ ***************************************/
+int add_text_to_line_table_at(LineTable *lt, char *s, int s_len,
+                              uint64_t fp, const char *text, int text_len,
+                              long index)
+{
+        return insert_row(lt, s, s_len, fp,
+                          (struct row){ NULL, text, index, text_len });
+}
 
-        Seq_T sq = get_or_make_seq(lt, key);
-        Seq_addhi(sq, intarr);
+/********** add_text_to_line_table ********
+ *
+ * Insert a line's raw text under string key, numbering lines in call
+ * order and fingerprinting the key itself.
+ *
+ * Parameters:
+ *      LineTable *lt:    line table made by create_line_table_lazy
+ *      char *s:          string key (not NULL, copied)
+ *      int s_len:        length of string
+ *      const char *text: the line (not NULL, copied)
+ *      int text_len:     bytes in text (> 0)
+ *
+ * Return:
+ *      1 on success, 0 if memory runs out
+ *
+ * Notes:
+ *      Not for concurrent use, like add_to_line_table
+ ***************************************/
+int add_text_to_line_table(LineTable *lt, char *s, int s_len,
+                           const char *text, int text_len)
+{
+        return add_text_to_line_table_at(lt, s, s_len,
+                                         fingerprint_bytes(s, s_len), text,
+                                         text_len, lt->next_index++);
+}
+
+/********** add_batch_to_line_table ********
+ *
+ * Insert a batch of lines, numbering them in order after every line
+ * inserted before.
+ *
+ * Parameters:
+ *      LineTable *lt:                    line table (not NULL)
+ *      struct line_table_entry *entries: lines in input order, each
+ *                                        with its key_fp set
+ *      int count:                        entries (at most
+ *                                        LINE_TABLE_BATCH_MAX)
+ *
+ * Return:
+ *      Number of entries stored. They are stored in order, so if memory
+ *      runs out at entry i, i is returned and the digits of entries i
+ *      and up are not stored.
+ *
+ * Effects:
+ *      Same as calling add_to_line_table (or add_text_to_line_table for
+ *      entries with NULL digits) on each entry in turn, so the target is
+ *      the one those calls would pick.
+ *
+ * Notes:
+ *      Not for concurrent use, like add_to_line_table: the prefetches
+ *      read the chains without taking the stripe locks.
+ ***************************************/
+int add_batch_to_line_table(LineTable *lt, struct line_table_entry *entries,
+                            int count)
+{
+        if (count > LINE_TABLE_BATCH_MAX) {
+                count = LINE_TABLE_BATCH_MAX;
+        }
+
+        /* Start loading the chain every key hangs off */
+        for (int i = 0; i < count; i++) {
+                uint64_t fp = entries[i].key_fp;
+                PREFETCH(stripe_chain(group_stripe(lt, fp), fp));
+        }
+        /* By now the first chains have arrived: start on their groups */
+        for (int i = 0; i < count; i++) {
+                uint64_t fp = entries[i].key_fp;
+                struct group *g = *stripe_chain(group_stripe(lt, fp), fp);
+                if (g != NULL) {
+                        PREFETCH(g);
+                }
+        }
+
+        for (int i = 0; i < count; i++) {
+                struct line_table_entry *e = &entries[i];
+                struct row row = { e->digits, NULL, lt->next_index++,
+                                   e->len };
+                if (e->digits == NULL) {
+                        row.text = e->text;
+                }
+                if (!insert_row(lt, e->key, e->key_len, e->key_fp, row)) {
+                        return i;
+                }
+        }
+        return count;
+}
+
+/********** line_table_is_lazy ********
+ *
+ * Check whether a table stores raw text instead of integer arrays.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *
+ * Return: 1 for a table made by create_line_table_lazy, else 0
+ ***************************************/
+int line_table_is_lazy(LineTable *lt)
+{
+        return lt->parse_row != NULL;
+}
+
+/********** compare_rows ********
+ *
+ * qsort comparison: order rows by their position in the input.
+ *
+ * Parameters:
+ *      const void *a, *b: rows (struct row *)
+ *
+ * Return: negative, zero or positive like strcmp
+ ***************************************/
+static int compare_rows(const void *a, const void *b)
+{
+        long x = ((const struct row *)a)->index;
+        long y = ((const struct row *)b)->index;
+        return (x > y) - (x < y);
+}
+
+/********** parse_rows ********
+ *
+ * Parse the text of every target row of a lazy table.
+ *
+ * Parameters:
+ *      LineTable *lt: lazy line table (not NULL)
+ *      int count:     rows in lt->target, which are in input order
+ *
+ * Return: 1 on success, 0 if a row cannot be parsed
+ *
+ * Effects:
+ *      Sets each target row's digits and len, and lt->original_row_size
+ *      to the number of integers on the latest line. The digits belong
+ *      to lt->target, not to the group.
+ ***************************************/
+static int parse_rows(LineTable *lt, int count)
+{
+        for (int i = 0; i < count; i++) {
+                struct row *row = &lt->target[i];
+                if (row->digits == NULL) {
+                        int len;
+                        row->digits = lt->parse_row(row->text, row->len,
+                                                    &len);
+                        if (row->digits == NULL) {
+                                return 0;
+                        }
+                        row->len = len;
+                }
+        }
+        lt->original_row_size = lt->target[count - 1].len;
+        return 1;
+}
+
+/********** order_target ********
+ *
+ * Gather the target's rows into lt->target and put them in input order.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL) with a target
+ *
+ * Return: 1 on success, 0 if memory runs out
+ *
+ * Notes:
+ *      Does the work once; later calls find lt->target in order.
+ ***************************************/
+static int order_target(LineTable *lt)
+{
+        struct group *g = lt->original;
+        if (lt->target != NULL) {
+                return 1;
+        }
+        lt->target = malloc(g->count * sizeof *lt->target);
+        if (lt->target == NULL) {
+                return 0;
+        }
+        gather_rows(g, lt->target);
+
+        /* Threads may have stored rows out of input order */
+        struct row *rows = lt->target;
+        for (int i = 1; i < g->count; i++) {
+                if (rows[i - 1].index > rows[i].index) {
+                        qsort(rows, g->count, sizeof *rows, compare_rows);
+                        break;
+                }
+        }
+        return 1;
 }
 
 /********** get_reconstructed_digits ********
@@ -108,20 +915,199 @@ void add_to_line_table(LineTable *lt, char *s, int s_len, int *intarr, int len)
  * Parameters:
  *      LineTable *lt: line table (not NULL, with a target string set)
  *      int *size:     pointer to store array size (not NULL)
+ *      int *height:   out; number of arrays returned (not NULL)
  *
  * Return:
- *      List_T of integer arrays for the target string
+ *      Array of *height integer arrays for the target string in input
+ *      order, or NULL if no string has repeated. The array belongs to lt.
  *
  * Expects:
  *      lt not NULL
- *      size not NULL
- *      lt->original_string is set (CRE otherwise)
+ *      size and height not NULL
+ *      no insertion running or following
+ *
+ * Notes:
+ *      A lazy table parses the target's rows here, on the first call. If
+ *      memory runs out gathering the rows or one cannot be parsed, NULL
+ *      is returned and *size is set to -1. Raises nothing.
  ***************************************/
-Seq_T get_reconstructed_digits(LineTable *lt, int *size) 
+int **get_reconstructed_digits(LineTable *lt, int *size, int *height)
 {
+        struct group *g = lt->original;
+        *height = 0;
+        if (g == NULL) {
+                *size = lt->original_row_size;
+                return NULL;
+        }
+        if (lt->target_rows == NULL) {
+                if (!order_target(lt) ||
+                    (lt->parse_row != NULL && !parse_rows(lt, g->count))) {
+                        *size = -1;
+                        return NULL;
+                }
+                int **rows = malloc((g->count > 0 ? g->count : 1) *
+                                    sizeof *rows);
+                if (rows == NULL) {
+                        *size = -1;
+                        return NULL;
+                }
+                for (int i = 0; i < g->count; i++) {
+                        rows[i] = lt->target[i].digits;
+                }
+                lt->target_rows = rows;
+        }
         /* Set size var equal to size of stored arrays */
         *size = lt->original_row_size;
-        return Table_get(lt->t, lt->original_string);
+        *height = g->count;
+        return lt->target_rows;
+}
+
+/********** line_table_target_height ********
+ *
+ * Count the target's rows, putting them in input order for
+ * map_target_rows.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *
+ * Return:
+ *      Number of rows, 0 if no string has repeated, or -1 if memory runs
+ *      out
+ *
+ * Expects:
+ *      no insertion running or following
+ ***************************************/
+long line_table_target_height(LineTable *lt)
+{
+        if (lt->original == NULL) {
+                return 0;
+        }
+        return order_target(lt) ? lt->original->count : -1;
+}
+
+/********** map_target_rows ********
+ *
+ * Show a range of the target's rows to a callback, as they are stored:
+ * a lazy table's rows that get_reconstructed_digits has not parsed are
+ * given as their text, and nothing is parsed here.
+ *
+ * Parameters:
+ *      LineTable *lt:         line table (not NULL)
+ *      long first:            first row, counting from 0 in input order
+ *      long last:             one past the last row (at most
+ *                             line_table_target_height)
+ *      target_row_fn apply:   callback for each row, in order
+ *      void *cl:              passed to apply
+ *
+ * Return:
+ *      1 if every row was shown, 0 if apply stopped early
+ *
+ * Expects:
+ *      line_table_target_height has returned a positive count
+ ***************************************/
+int map_target_rows(LineTable *lt, long first, long last,
+                    target_row_fn apply, void *cl)
+{
+        for (long i = first; i < last; i++) {
+                struct row *row = &lt->target[i];
+                if (!apply(i, row->digits, row->text, row->len, cl)) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/********** line_table_target_line ********
+ *
+ * Find which input line one of the target's rows came from.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *      long row:      position of the row, counting from 0 in input order
+ *                     (less than line_table_target_height)
+ *
+ * Return: the row's line number, as given when it was added
+ *
+ * Expects:
+ *      line_table_target_height has returned a positive count
+ ***************************************/
+long line_table_target_line(LineTable *lt, long row)
+{
+        return lt->target[row].index;
+}
+
+/********** line_table_target_fingerprint ********
+ *
+ * Get the fingerprint of the target string.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL) with a target
+ *
+ * Return: the fingerprint the target was added with (fingerprint.h)
+ ***************************************/
+uint64_t line_table_target_fingerprint(LineTable *lt)
+{
+        return lt->original->fingerprint;
+}
+
+/********** line_table_target_matches ********
+ *
+ * Check whether a string is the current target string.
+ *
+ * Parameters:
+ *      LineTable *lt:  line table (not NULL)
+ *      const char *s:  string to compare (s_len bytes)
+ *      int s_len:      length of s
+ *
+ * Return:
+ *      1 if a target is set and equals s, 0 otherwise
+ ***************************************/
+int line_table_target_matches(LineTable *lt, const char *s, int s_len)
+{
+        return lt->original != NULL && 
+               lt->original->key_len == s_len &&
+               memcmp(group_key(lt->original), s, s_len) == 0;
+}
+
+/********** line_table_max_length ********
+ *
+ * Get the largest string length the table keeps a counter for.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *
+ * Return: upper bound for line_table_length_count, -1 if none
+ ***************************************/
+int line_table_max_length(LineTable *lt)
+{
+        int max = -1;
+        for (int i = 0; i < LENGTH_STRIPES; i++) {
+                int top = (lt->lengths[i].size - 1) * LENGTH_STRIPES + i;
+                if (lt->lengths[i].size > 0 && top > max) {
+                        max = top;
+                }
+        }
+        return max;
+}
+
+/********** line_table_length_count ********
+ *
+ * Get the number of strings of one length inserted so far.
+ *
+ * Parameters:
+ *      LineTable *lt: line table (not NULL)
+ *      int s_len:     string length
+ *
+ * Return: number of strings of length s_len stored in the table
+ ***************************************/
+long line_table_length_count(LineTable *lt, int s_len)
+{
+        if (s_len < 0) {
+                return 0;
+        }
+        struct length_stripe *ls = &lt->lengths[s_len % LENGTH_STRIPES];
+        int i = s_len / LENGTH_STRIPES;
+        return i < ls->size ? ls->lengths[i].lines : 0;
 }
 
 /********** create_line_table ********
@@ -135,20 +1121,82 @@ Seq_T get_reconstructed_digits(LineTable *lt, int *size)
  *      Caller must free with free_line_table
  ***************************************/
 LineTable *create_line_table() 
+{
+        return create_line_table_in(ALLOC_DEFAULT);
+}
+
+/********** create_line_table_in ********
+ *
+ * Allocate and initialize a new LineTable whose hash chains and arenas
+ * are allocated in the given mode.
+ *
+ * Parameters:
+ *      alloc_mode_t mode: ALLOC_HUGE to back them with huge pages
+ *
+ * Return:
+ *      Pointer to new LineTable, or NULL if allocation fails
+ *
+ * Notes:
+ *      Caller must free with free_line_table
+ ***************************************/
+LineTable *create_line_table_in(alloc_mode_t mode)
 {
         LineTable *out = malloc(sizeof *out);
         if (out == NULL) {
                 return NULL;
         }
-        
+
         /* Set struct and populate data members */
         *out = (struct LineTable){0};
-        out->t = Table_new(INITIAL_TABLE_SIZE, NULL, NULL);
-        if (out->t == NULL) {
-                free(out);
-                return NULL;
+        out->mode = mode;
+        size_t chains = INITIAL_STRIPE_BUCKETS * sizeof(struct group *);
+        for (int i = 0; i < GROUP_STRIPES; i++) {
+                struct group_stripe *gs = &out->groups[i];
+                gs->buckets = page_alloc(chains, mode);
+                if (gs->buckets == NULL) {
+                        while (i-- > 0) {
+                                page_free(out->groups[i].buckets, chains,
+                                          mode);
+                        }
+                        free(out);
+                        return NULL;
+                }
+                gs->nbuckets = INITIAL_STRIPE_BUCKETS;
+        }
+        for (int i = 0; i < GROUP_STRIPES; i++) {
+                pthread_mutex_init(&out->groups[i].lock, NULL);
+        }
+        for (int i = 0; i < LENGTH_STRIPES; i++) {
+                pthread_mutex_init(&out->lengths[i].lock, NULL);
+        }
+        pthread_mutex_init(&out->target_lock, NULL);
+        out->original = NULL;
+        return out;
+}
+
+/********** create_line_table_lazy ********
+ *
+ * Allocate and initialize a new LineTable that keeps each line's raw
+ * text and parses only the target's rows.
+ *
+ * Parameters:
+ *      alloc_mode_t mode:       as for create_line_table_in
+ *      row_parser_fn parse_row: turns a row's text into its integers
+ *                               (not NULL)
+ *
+ * Return:
+ *      Pointer to new LineTable, or NULL if allocation fails
+ *
+ * Notes:
+ *      Rows go in with add_text_to_line_table(_at). Caller must free with
+ *      free_line_table
+ ***************************************/
+LineTable *create_line_table_lazy(alloc_mode_t mode, row_parser_fn parse_row)
+{
+        LineTable *out = create_line_table_in(mode);
+        if (out != NULL) {
+                out->parse_row = parse_row;
         }
-        out->original_string = NULL;
         return out;
 }
 
@@ -165,15 +1213,50 @@ void free_line_table(LineTable *lt)
         if (lt == NULL) {
                  return;
         }
-        /* Free digit arrays in lists */
-        Table_map(lt->t, free_seq_contents, NULL);
-        Table_free(&lt->t);
+        if (lt->target != NULL && lt->parse_row != NULL) {
+                /* A lazy table's groups hold no digits */
+                for (int i = 0; i < lt->original->count; i++) {
+                        free(lt->target[i].digits);
+                }
+        }
+        /* Free digit arrays in groups */
+        for (int i = 0; i < GROUP_STRIPES; i++) {
+                struct group_stripe *gs = &lt->groups[i];
+                for (size_t b = 0; b < gs->nbuckets; b++) {
+                        struct group *g = gs->buckets[b];
+                        while (g != NULL) {
+                                struct group *next = g->next;
+                                free_group(g);
+                                g = next;
+                        }
+                }
+                page_free(gs->buckets, gs->nbuckets * sizeof *gs->buckets,
+                          lt->mode);
+                free_arena(lt, gs->arena);
+                pthread_mutex_destroy(&gs->lock);
+        }
+        for (int i = 0; i < LENGTH_STRIPES; i++) {
+                struct length_stripe *ls = &lt->lengths[i];
+                for (int j = 0; j < ls->size; j++) {
+                        if (ls->lengths[j].pending != NULL) {
+                                free_group(ls->lengths[j].pending);
+                        }
+                }
+                free(ls->lengths);
+                free_arena(lt, ls->arena);
+                pthread_mutex_destroy(&ls->lock);
+        }
+        pthread_mutex_destroy(&lt->target_lock);
+        /* Its arrays were freed with the groups */
+        free(lt->target_rows);
+        free(lt->target);
         free(lt);
 }
 
 /********** free_seq_contents *********
  *
- * Helper for free_line_table: frees all arrays in a seq and the seq itself
+ * Helper for freeing a seq of arrays: frees all arrays in a seq and the
+ * seq itself
  *
  * Parameters:
  *      const void *key: unused
@@ -12,8 +12,10 @@
 #ifndef LINE_TABLE_H
 #define LINE_TABLE_H
 
+#include <stdint.h>
 #include "list.h"
 #include "seq.h"
+#include "page_alloc.h"
 
 /********** LineTable ********
  * Abstract type representing a line table mapping strings to
@@ -21,10 +23,65 @@
  ************************/
 typedef struct LineTable LineTable;
 
+/********** row_parser_fn ********
+ * Callback a lazy table uses to parse a row's text.
+ *      const char *text: the text given when the row was added
+ *      int text_len:     bytes in text
+ *      int *len:         out; number of integers
+ * Returns a malloc'd integer array, which the table then owns, or NULL
+ * if memory runs out.
+ ************************/
+typedef int *(*row_parser_fn)(const char *text, int text_len, int *len);
+
+/********** target_row_fn ********
+ * Callback map_target_rows calls for each row of the target.
+ *      long row:          position of the row among the target's rows
+ *      const int *digits: the row's integers, or NULL if it is text
+ *      const char *text:  the row's raw text when digits is NULL
+ *      int len:           integers in digits, else bytes of text
+ *      void *cl:          closure given to map_target_rows
+ * Returns nonzero to go on to the next row, 0 to stop.
+ ************************/
+typedef int (*target_row_fn)(long row, const int *digits, const char *text,
+                             int len, void *cl);
+
+/* Most lines add_batch_to_line_table takes at once */
+#define LINE_TABLE_BATCH_MAX 64
+
+/* One line for add_batch_to_line_table */
+struct line_table_entry {
+        char *key;              /* string key (copied) */
+        int key_len;
+        uint64_t key_fp;        /* fingerprint of key (fingerprint.h) */
+        int *digits;            /* integers, or NULL to store text */
+        const char *text;       /* raw line (copied), if digits is NULL */
+        int len;                /* integers in digits, else bytes of text */
+};
+
 /* Functions */
 LineTable *create_line_table();
-void add_to_line_table(LineTable *lt, char* s, int s_len, int *intarr, int len);
-Seq_T get_reconstructed_digits(LineTable *lt, int *size);
+LineTable *create_line_table_in(alloc_mode_t mode);
+LineTable *create_line_table_lazy(alloc_mode_t mode, row_parser_fn parse_row);
+int add_to_line_table(LineTable *lt, char* s, int s_len, int *intarr, int len);
+int add_to_line_table_at(LineTable *lt, char *s, int s_len, uint64_t fp,
+                         int *intarr, int len, long index);
+int add_text_to_line_table(LineTable *lt, char *s, int s_len,
+                           const char *text, int text_len);
+int add_text_to_line_table_at(LineTable *lt, char *s, int s_len,
+                              uint64_t fp, const char *text, int text_len,
+                              long index);
+int add_batch_to_line_table(LineTable *lt, struct line_table_entry *entries,
+                            int count);
+int line_table_is_lazy(LineTable *lt);
+int **get_reconstructed_digits(LineTable *lt, int *size, int *height);
+long line_table_target_height(LineTable *lt);
+int map_target_rows(LineTable *lt, long first, long last,
+                    target_row_fn apply, void *cl);
+long line_table_target_line(LineTable *lt, long row);
+uint64_t line_table_target_fingerprint(LineTable *lt);
+int line_table_target_matches(LineTable *lt, const char *s, int s_len);
+int line_table_max_length(LineTable *lt);
+long line_table_length_count(LineTable *lt, int s_len);
 void free_line_table(LineTable *lt);
 
 /* Helper for freeing contents */
@@ -0,0 +1,98 @@
+/*
+ *     narrow.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements narrow_row. With SSE2 (every x86-64) sixteen pixels are
+ *     narrowed at once: two signed packs take int32 to int16 and an
+ *     unsigned pack takes int16 to uint8, each saturating, which together
+ *     clamp to [0, 255]. A pixel is in range exactly when its bits above
+ *     the low eight are clear; in-range lanes are counted in a vector of
+ *     counters alongside. arm64 does the same with NEON's saturating
+ *     narrows. Other targets, and the last few pixels of a row, take the
+ *     scalar loop.
+ */
+
+#include "narrow.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Largest value a pixel byte holds (MAXVAL in restoration.h) */
+#define PIXEL_MAX 255
+
+/********** narrow_row ********
+ *
+ * Convert a row of int pixels to bytes, clamping to [0, PIXEL_MAX].
+ *
+ * Parameters:
+ *      unsigned char *out: out; len bytes
+ *      const int *in:      len pixels
+ *      int len:            number of pixels (>= 0)
+ *
+ * Return: number of pixels that were below 0 or above PIXEL_MAX
+ ************************/
+long narrow_row(unsigned char *out, const int *in, int len)
+{
+        long clamped = 0;
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i high_bits = _mm_set1_epi32(~PIXEL_MAX);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i in_range = zero;
+        for (; i + 16 <= len; i += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 4));
+                __m128i c = _mm_loadu_si128((const __m128i *)(in + i + 8));
+                __m128i d = _mm_loadu_si128((const __m128i *)(in + i + 12));
+                __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b),
+                                                  _mm_packs_epi32(c, d));
+                _mm_storeu_si128((__m128i *)(out + i), packed);
+
+                /* Each in-range lane subtracts -1 */
+                in_range = _mm_sub_epi32(in_range, _mm_cmpeq_epi32(
+                        _mm_and_si128(a, high_bits), zero));
+                in_range = _mm_sub_epi32(in_range, _mm_cmpeq_epi32(
+                        _mm_and_si128(b, high_bits), zero));
+                in_range = _mm_sub_epi32(in_range, _mm_cmpeq_epi32(
+                        _mm_and_si128(c, high_bits), zero));
+                in_range = _mm_sub_epi32(in_range, _mm_cmpeq_epi32(
+                        _mm_and_si128(d, high_bits), zero));
+        }
+        unsigned int lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, in_range);
+        clamped = (long)i - ((long)lanes[0] + lanes[1] + lanes[2] + 
+                             lanes[3]);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+        const uint32x4_t limit = vdupq_n_u32(PIXEL_MAX);
+        uint32x4_t out_of_range = vdupq_n_u32(0);
+        for (; i + 8 <= len; i += 8) {
+                int32x4_t a = vld1q_s32(in + i);
+                int32x4_t b = vld1q_s32(in + i + 4);
+                uint16x8_t wide = vcombine_u16(vqmovun_s32(a),
+                                               vqmovun_s32(b));
+                vst1_u8(out + i, vqmovn_u16(wide));
+
+                /* Negative pixels are huge as unsigned; each lane above
+                 * the limit subtracts -1 */
+                out_of_range = vsubq_u32(out_of_range, vcgtq_u32(
+                        vreinterpretq_u32_s32(a), limit));
+                out_of_range = vsubq_u32(out_of_range, vcgtq_u32(
+                        vreinterpretq_u32_s32(b), limit));
+        }
+        clamped = (long)vaddvq_u32(out_of_range);
+#endif
+        for (; i < len; i++) {
+                int v = in[i];
+                if (v < 0 || v > PIXEL_MAX) {
+                        clamped++;
+                        v = v < 0 ? 0 : PIXEL_MAX;
+                }
+                out[i] = (unsigned char)v;
+        }
+        return clamped;
+}
@@ -0,0 +1,18 @@
+/*
+ *     narrow.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for narrowing rows of int pixels to the bytes a raster
+ *     holds. Values outside [0, MAXVAL] are clamped rather than wrapped,
+ *     and counted, so a caller can report how many pixels did not fit.
+ */
+
+#ifndef NARROW_H
+#define NARROW_H
+
+/* Functions */
+long narrow_row(unsigned char *out, const int *in, int len);
+
+#endif /* NARROW_H */
@@ -0,0 +1,513 @@
+/*
+ *     output_sink.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements OutputSink. fd and spill sinks stage bytes in a
+ *     page-aligned buffer and flush it with write(2), so the P5 writer
+ *     pays neither stdio locking nor the copy into a FILE buffer; writes
+ *     larger than the buffer go straight to the descriptor. Copies from
+ *     one file descriptor into a sink use copy_file_range where the kernel
+ *     supports it, then sendfile (which also reaches pipes), then plain
+ *     read/write.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include "output_sink.h"
+
+/* Alignment of fd sink buffers (one page) */
+#define SINK_BUFFER_ALIGN 4096
+
+/* Initial capacity of a memory sink */
+#define MEMORY_SINK_CAPACITY 4096
+
+/* Largest single copy_file_range/sendfile request */
+#define COPY_CHUNK (1 << 30)
+
+/* Size of the bounce buffer used when the kernel cannot copy for us */
+#define BOUNCE_BUFFER_SIZE 65536
+
+/* Kinds of sink */
+typedef enum sink_kind {
+        SINK_FD,
+        SINK_SPILL,
+        SINK_MEMORY
+} sink_kind_t;
+
+/* Struct Definition */
+struct OutputSink {
+        sink_kind_t kind;
+        int fd;                 /* destination (fd) or spill file (spill) */
+        int owns_fd;            /* close fd when the sink is closed */
+        unsigned char *buffer;
+        size_t capacity;
+        size_t used;
+        int failed;
+        OutputSink *dest;       /* spill sinks only: where the spill goes */
+};
+
+/*------------------------Helpers-------------------------*/
+
+/********** write_all ********
+ *
+ * Write a whole buffer to a file descriptor, retrying short writes.
+ *
+ * Parameters:
+ *      int fd:           destination descriptor
+ *      const void *data: bytes to write
+ *      size_t len:       number of bytes in data
+ *
+ * Return: 1 if every byte was written, 0 on error
+ ************************/
+static int write_all(int fd, const void *data, size_t len)
+{
+        const unsigned char *p = data;
+        while (len > 0) {
+                ssize_t n = write(fd, p, len);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return 0;
+                }
+                p += n;
+                len -= (size_t)n;
+        }
+        return 1;
+}
+
+/********** new_sink ********
+ *
+ * Allocate a sink with a buffer of the given capacity.
+ *
+ * Parameters:
+ *      sink_kind_t kind: kind of sink
+ *      size_t capacity:  buffer size in bytes (> 0)
+ *      int aligned:      nonzero to page-align the buffer
+ *
+ * Return: new sink, or NULL if allocation fails
+ ************************/
+static OutputSink *new_sink(sink_kind_t kind, size_t capacity, int aligned)
+{
+        OutputSink *sink = malloc(sizeof *sink);
+        if (sink == NULL) {
+                return NULL;
+        }
+        *sink = (struct OutputSink){0};
+        sink->kind = kind;
+        sink->fd = -1;
+        sink->capacity = capacity;
+
+        void *buffer = NULL;
+        if (aligned) {
+                if (posix_memalign(&buffer, SINK_BUFFER_ALIGN, capacity) != 0) {
+                        buffer = NULL;
+                }
+        } else {
+                buffer = malloc(capacity);
+        }
+        if (buffer == NULL) {
+                free(sink);
+                return NULL;
+        }
+        sink->buffer = buffer;
+        return sink;
+}
+
+/********** grow_memory ********
+ *
+ * Make room for at least len more bytes in a memory sink.
+ *
+ * Parameters:
+ *      OutputSink *sink: memory sink (not NULL)
+ *      size_t len:       bytes about to be appended
+ *
+ * Return: 1 on success, 0 if allocation fails
+ ************************/
+static int grow_memory(OutputSink *sink, size_t len)
+{
+        size_t capacity = sink->capacity;
+        while (capacity - sink->used < len) {
+                capacity *= 2;
+        }
+        if (capacity == sink->capacity) {
+                return 1;
+        }
+        unsigned char *grown = realloc(sink->buffer, capacity);
+        if (grown == NULL) {
+                return 0;
+        }
+        sink->buffer = grown;
+        sink->capacity = capacity;
+        return 1;
+}
+
+/********** copy_fd_by_reading ********
+ *
+ * Copy the rest of fd into sink through a bounce buffer.
+ *
+ * Parameters:
+ *      OutputSink *sink: destination sink (not NULL)
+ *      int fd:           source descriptor
+ ************************/
+static void copy_fd_by_reading(OutputSink *sink, int fd)
+{
+        unsigned char *bounce = malloc(BOUNCE_BUFFER_SIZE);
+        if (bounce == NULL) {
+                sink->failed = 1;
+                return;
+        }
+        for (;;) {
+                ssize_t n = read(fd, bounce, BOUNCE_BUFFER_SIZE);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n < 0) {
+                        sink->failed = 1;
+                }
+                if (n <= 0) {
+                        break;
+                }
+                sink_write(sink, bounce, (size_t)n);
+        }
+        free(bounce);
+}
+
+/********** copy_fd_in_kernel ********
+ *
+ * Copy the rest of fd into the sink's descriptor without passing the
+ * bytes through user space.
+ *
+ * Parameters:
+ *      OutputSink *sink: fd or spill sink with an empty buffer (not NULL)
+ *      int fd:           source descriptor
+ *
+ * Return:
+ *      1 if the copy finished (check sink->failed for errors), 0 if the
+ *      kernel supports neither call for this pair of descriptors; the
+ *      bytes not yet copied are then still at fd's file position
+ ************************/
+static int copy_fd_in_kernel(OutputSink *sink, int fd)
+{
+        int use_copy_file_range = 1;
+        for (;;) {
+                ssize_t n;
+                if (use_copy_file_range) {
+                        n = copy_file_range(fd, NULL, sink->fd, NULL,
+                                            COPY_CHUNK, 0);
+                        if (n < 0 && errno != EINTR) {
+                                /* Pipes, other filesystems, old kernels */
+                                use_copy_file_range = 0;
+                                continue;
+                        }
+                } else {
+                        n = sendfile(sink->fd, fd, NULL, COPY_CHUNK);
+                        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                                return 0;
+                        }
+                }
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n < 0) {
+                        sink->failed = 1;
+                }
+                if (n <= 0) {
+                        return 1;
+                }
+        }
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** create_fd_sink ********
+ *
+ * Create a sink that writes to a file descriptor with write(2).
+ *
+ * Parameters:
+ *      int fd:             open descriptor to write to (not closed by sink)
+ *      size_t buffer_size: size of the aligned write buffer (> 0)
+ *
+ * Return: new sink, or NULL if allocation fails
+ *
+ * Notes:
+ *      Caller must close with close_output_sink
+ ************************/
+OutputSink *create_fd_sink(int fd, size_t buffer_size)
+{
+        OutputSink *sink = new_sink(SINK_FD, buffer_size, 1);
+        if (sink != NULL) {
+                sink->fd = fd;
+        }
+        return sink;
+}
+
+/********** create_spill_sink ********
+ *
+ * Create a sink that collects output in a spill file and copies it to
+ * dest when closed.
+ *
+ * Parameters:
+ *      OutputSink *dest: sink that receives the spilled bytes (not NULL)
+ *      int spill_fd:     open, empty, seekable descriptor to spill into;
+ *                        left open when the sink is closed. Pass -1 to
+ *                        spill into an anonymous temporary file instead.
+ *
+ * Return: new sink, or NULL if allocation or the temporary file fails
+ *
+ * Notes:
+ *      Caller must close with close_output_sink before closing dest
+ ************************/
+OutputSink *create_spill_sink(OutputSink *dest, int spill_fd)
+{
+        OutputSink *sink = new_sink(SINK_SPILL, SINK_BUFFER_SIZE, 1);
+        if (sink == NULL) {
+                return NULL;
+        }
+        sink->dest = dest;
+        sink->fd = spill_fd;
+        if (spill_fd < 0) {
+                const char *dir = getenv("TMPDIR");
+                if (dir == NULL) {
+                        dir = "/tmp";
+                }
+                char *path = malloc(strlen(dir) + sizeof "/restoration-XXXXXX");
+                if (path != NULL) {
+                        sprintf(path, "%s/restoration-XXXXXX", dir);
+                        sink->fd = mkstemp(path);
+                        if (sink->fd >= 0) {
+                                unlink(path);
+                        }
+                        free(path);
+                }
+                if (sink->fd < 0) {
+                        free(sink->buffer);
+                        free(sink);
+                        return NULL;
+                }
+                sink->owns_fd = 1;
+        }
+        return sink;
+}
+
+/********** create_memory_sink ********
+ *
+ * Create a sink that collects output in memory.
+ *
+ * Return: new sink, or NULL if allocation fails
+ *
+ * Notes:
+ *      Retrieve the bytes with sink_memory_data before close_output_sink
+ ************************/
+OutputSink *create_memory_sink(void)
+{
+        return new_sink(SINK_MEMORY, MEMORY_SINK_CAPACITY, 0);
+}
+
+/********** sink_write ********
+ *
+ * Append bytes to a sink.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to write to (not NULL)
+ *      const void *data: bytes to write
+ *      size_t len:       number of bytes in data
+ *
+ * Effects:
+ *      Marks the sink failed if the bytes cannot be stored or written.
+ ************************/
+void sink_write(OutputSink *sink, const void *data, size_t len)
+{
+        if (sink->failed) {
+                return;
+        }
+        if (sink->kind == SINK_MEMORY) {
+                if (!grow_memory(sink, len)) {
+                        sink->failed = 1;
+                        return;
+                }
+                memcpy(sink->buffer + sink->used, data, len);
+                sink->used += len;
+                return;
+        }
+
+        if (sink->used + len > sink->capacity) {
+                if (!sink_flush(sink)) {
+                        return;
+                }
+                /* Too big to stage: hand it to the kernel directly */
+                if (len >= sink->capacity) {
+                        if (!write_all(sink->fd, data, len)) {
+                                sink->failed = 1;
+                        }
+                        return;
+                }
+        }
+        memcpy(sink->buffer + sink->used, data, len);
+        sink->used += len;
+}
+
+/********** sink_copy_from_fd ********
+ *
+ * Append everything from fd's current position to its end to a sink.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to write to (not NULL)
+ *      int fd:           open descriptor to read from
+ *
+ * Effects:
+ *      Advances fd's file position to its end. Marks the sink failed on
+ *      a read or write error.
+ ************************/
+void sink_copy_from_fd(OutputSink *sink, int fd)
+{
+        if (sink->kind != SINK_MEMORY) {
+                if (!sink_flush(sink) || copy_fd_in_kernel(sink, fd)) {
+                        return;
+                }
+        }
+        copy_fd_by_reading(sink, fd);
+}
+
+/********** sink_flush ********
+ *
+ * Write any staged bytes of an fd or spill sink to its descriptor.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to flush (not NULL)
+ *
+ * Return: 1 if the sink has not failed, 0 otherwise
+ ************************/
+int sink_flush(OutputSink *sink)
+{
+        if (sink->kind != SINK_MEMORY && !sink->failed && sink->used > 0) {
+                if (!write_all(sink->fd, sink->buffer, sink->used)) {
+                        sink->failed = 1;
+                }
+                sink->used = 0;
+        }
+        return !sink->failed;
+}
+
+/********** sink_failed ********
+ *
+ * Report whether any write to the sink has failed.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to check (not NULL)
+ *
+ * Return: nonzero if a write failed
+ ************************/
+int sink_failed(OutputSink *sink)
+{
+        return sink->failed;
+}
+
+/********** sink_fd ********
+ *
+ * Get the descriptor an fd sink writes to.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to inspect (not NULL)
+ *
+ * Return:
+ *      the destination descriptor of an fd sink, -1 for other kinds
+ *
+ * Notes:
+ *      Bytes written to the sink reach the descriptor only after
+ *      sink_flush
+ ************************/
+int sink_fd(OutputSink *sink)
+{
+        return sink->kind == SINK_FD ? sink->fd : -1;
+}
+
+/********** sink_memory_data ********
+ *
+ * Take the bytes collected by a memory sink.
+ *
+ * Parameters:
+ *      OutputSink *sink: memory sink (not NULL)
+ *      size_t *len:      out; number of bytes returned
+ *
+ * Return:
+ *      malloc'd buffer holding the bytes (caller frees), or NULL for
+ *      other kinds of sink. The sink is left empty.
+ ************************/
+unsigned char *sink_memory_data(OutputSink *sink, size_t *len)
+{
+        *len = 0;
+        if (sink->kind != SINK_MEMORY) {
+                return NULL;
+        }
+        unsigned char *data = sink->buffer;
+        *len = sink->used;
+        sink->buffer = malloc(MEMORY_SINK_CAPACITY);
+        sink->capacity = MEMORY_SINK_CAPACITY;
+        sink->used = 0;
+        if (sink->buffer == NULL) {
+                sink->capacity = 0;
+                sink->failed = 1;
+        }
+        return data;
+}
+
+/********** close_output_sink ********
+ *
+ * Flush and free a sink. Spill sinks first copy their spill file to
+ * their destination sink.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to close (may be NULL)
+ *
+ * Return: 1 if every write to the sink succeeded, 0 otherwise
+ ************************/
+int close_output_sink(OutputSink *sink)
+{
+        if (sink == NULL) {
+                return 1;
+        }
+        int ok = sink_flush(sink);
+        if (sink->kind == SINK_SPILL && ok) {
+                if (lseek(sink->fd, 0, SEEK_SET) != 0) {
+                        ok = 0;
+                } else {
+                        sink_copy_from_fd(sink->dest, sink->fd);
+                        ok = !sink_failed(sink->dest);
+                }
+        }
+        if (sink->owns_fd) {
+                close(sink->fd);
+        }
+        free(sink->buffer);
+        free(sink);
+        return ok;
+}
+
+/********** abandon_output_sink ********
+ *
+ * Free a sink without flushing it, e.g. after an error. Spill sinks do
+ * not copy anything to their destination.
+ *
+ * Parameters:
+ *      OutputSink *sink: sink to free (may be NULL)
+ ************************/
+void abandon_output_sink(OutputSink *sink)
+{
+        if (sink == NULL) {
+                return;
+        }
+        if (sink->owns_fd) {
+                close(sink->fd);
+        }
+        free(sink->buffer);
+        free(sink);
+}
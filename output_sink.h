@@ -0,0 +1,45 @@
+/*
+ *     output_sink.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for OutputSink, the destination restoration writes its P5
+ *     output to. Three implementations share the interface:
+ *       - fd sinks buffer writes in a large aligned buffer and flush with
+ *         write(2), bypassing stdio,
+ *       - spill sinks collect everything in a spill file and hand it to
+ *         another sink with copy_file_range/sendfile when closed,
+ *       - memory sinks collect everything in a growable heap buffer.
+ *
+ *     Write errors are sticky, like ferror: individual writes do not
+ *     report failure, close_output_sink does.
+ */
+
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <stddef.h>
+
+/* Default size of the write buffer of an fd sink */
+#define SINK_BUFFER_SIZE (1 << 20)
+
+/********** OutputSink ********
+ * Abstract type representing a destination for output bytes.
+ ************************/
+typedef struct OutputSink OutputSink;
+
+/* Functions */
+OutputSink *create_fd_sink(int fd, size_t buffer_size);
+OutputSink *create_spill_sink(OutputSink *dest, int spill_fd);
+OutputSink *create_memory_sink(void);
+void sink_write(OutputSink *sink, const void *data, size_t len);
+void sink_copy_from_fd(OutputSink *sink, int fd);
+int sink_flush(OutputSink *sink);
+int sink_failed(OutputSink *sink);
+int sink_fd(OutputSink *sink);
+unsigned char *sink_memory_data(OutputSink *sink, size_t *len);
+int close_output_sink(OutputSink *sink);
+void abandon_output_sink(OutputSink *sink);
+
+#endif /* OUTPUT_SINK_H */
@@ -0,0 +1,174 @@
+/*
+ *     page_alloc.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements page_alloc. Small buffers, and every buffer in the
+ *     default mode, come from calloc. Huge-page buffers are rounded up to
+ *     whole huge pages and mapped with MAP_HUGETLB; most systems reserve
+ *     no hugetlbfs pages, so when that fails the buffer is mapped with
+ *     2 MB alignment and madvise(MADV_HUGEPAGE) lets the kernel back it
+ *     with transparent huge pages instead.
+ *
+ *     NUMA placement uses libnuma (HAVE_NUMA) and only matters on
+ *     machines with more than one node.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "page_alloc.h"
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+/*------------------------Helpers-------------------------*/
+
+/********** uses_huge_pages ********
+ *
+ * Decide whether a buffer is mapped rather than taken from the heap.
+ *
+ * Parameters:
+ *      size_t size:       bytes requested
+ *      alloc_mode_t mode: allocation mode
+ *
+ * Return: 1 for huge-page buffers, 0 for heap buffers
+ ************************/
+static int uses_huge_pages(size_t size, alloc_mode_t mode)
+{
+        /* A smaller buffer would still fault in a whole huge page */
+        return mode == ALLOC_HUGE && size >= HUGE_PAGE_SIZE;
+}
+
+/********** huge_round ********
+ *
+ * Round a size up to whole huge pages.
+ *
+ * Parameters:
+ *      size_t size: bytes requested
+ *
+ * Return: mapped size
+ ************************/
+static size_t huge_round(size_t size)
+{
+        return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/********** map_transparent ********
+ *
+ * Map a huge-page-aligned region and advise transparent huge pages.
+ *
+ * Parameters:
+ *      size_t size: bytes to map, a multiple of HUGE_PAGE_SIZE
+ *
+ * Return: the region, or NULL if it cannot be mapped
+ ************************/
+static void *map_transparent(size_t size)
+{
+        /* Over-map by one huge page, then trim to an aligned region */
+        size_t span = size + HUGE_PAGE_SIZE;
+        char *p = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+                return NULL;
+        }
+        uintptr_t start = ((uintptr_t)p + HUGE_PAGE_SIZE - 1) &
+                          ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+        char *aligned = (char *)start;
+        if (aligned > p) {
+                munmap(p, aligned - p);
+        }
+        if (aligned + size < p + span) {
+                munmap(aligned + size, (p + span) - (aligned + size));
+        }
+#ifdef MADV_HUGEPAGE
+        /* Only a hint: without THP the region works with small pages */
+        madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+        return aligned;
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** page_alloc ********
+ *
+ * Allocate a zeroed buffer.
+ *
+ * Parameters:
+ *      size_t size:       bytes needed (> 0)
+ *      alloc_mode_t mode: allocation mode
+ *
+ * Return: the buffer, or NULL if memory runs out
+ *
+ * Notes:
+ *      Caller must free with page_free, passing the same size and mode.
+ ************************/
+void *page_alloc(size_t size, alloc_mode_t mode)
+{
+        if (!uses_huge_pages(size, mode)) {
+                return calloc(1, size);
+        }
+        size_t mapped = huge_round(size);
+#ifdef MAP_HUGETLB
+        void *p = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+                return p;
+        }
+#endif
+        return map_transparent(mapped);
+}
+
+/********** page_free ********
+ *
+ * Free a buffer from page_alloc.
+ *
+ * Parameters:
+ *      void *p:           buffer (may be NULL)
+ *      size_t size:       size it was allocated with
+ *      alloc_mode_t mode: mode it was allocated with
+ ************************/
+void page_free(void *p, size_t size, alloc_mode_t mode)
+{
+        if (p == NULL) {
+                return;
+        }
+        if (uses_huge_pages(size, mode)) {
+                munmap(p, huge_round(size));
+        } else {
+                free(p);
+        }
+}
+
+/********** page_alloc_bind_worker ********
+ *
+ * Keep the calling parsing thread, and the memory it allocates from now
+ * on, on one NUMA node. Workers are spread over the nodes round robin.
+ *
+ * Parameters:
+ *      int worker:        index of the calling thread in its pool
+ *      alloc_mode_t mode: allocation mode; only ALLOC_HUGE binds
+ *
+ * Effects:
+ *      None in the default mode, without libnuma, or on a single node.
+ *      The thread's malloc arena and buffers it first touches then get
+ *      pages from its own node.
+ ************************/
+void page_alloc_bind_worker(int worker, alloc_mode_t mode)
+{
+#ifdef HAVE_NUMA
+        if (mode != ALLOC_HUGE || numa_available() < 0) {
+                return;
+        }
+        int nodes = numa_num_configured_nodes();
+        if (nodes > 1 && numa_run_on_node(worker % nodes) == 0) {
+                numa_set_localalloc();
+        }
+#else
+        (void)worker;
+        (void)mode;
+#endif
+}
@@ -0,0 +1,41 @@
+/*
+ *     page_alloc.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for page-level allocation of the large, long-lived buffers
+ *     restoration builds (the LineTable's hash chains and arenas). In the
+ *     huge-page mode such buffers are backed by 2 MB pages, so walking a
+ *     multi-GB table touches far fewer TLB entries, and parsing threads
+ *     keep their allocations on their own NUMA node.
+ */
+
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stddef.h>
+
+/* Size of one huge page (x86-64 and arm64 default) */
+#define HUGE_PAGE_SIZE ((size_t)1 << 21)
+
+/********** alloc_mode_t ********
+ * How large buffers are allocated.
+ *      ALLOC_DEFAULT: the C heap
+ *      ALLOC_HUGE:    buffers of at least HUGE_PAGE_SIZE come from
+ *                     MAP_HUGETLB pages, or, where none are reserved,
+ *                     from 2 MB aligned mappings advised for transparent
+ *                     huge pages; parsing threads run on, and allocate
+ *                     from, one NUMA node each (with libnuma)
+ ************************/
+typedef enum alloc_mode {
+        ALLOC_DEFAULT,
+        ALLOC_HUGE
+} alloc_mode_t;
+
+/* Functions */
+void *page_alloc(size_t size, alloc_mode_t mode);
+void page_free(void *p, size_t size, alloc_mode_t mode);
+void page_alloc_bind_worker(int worker, alloc_mode_t mode);
+
+#endif /* PAGE_ALLOC_H */
@@ -0,0 +1,385 @@
+/*
+ *     parse_pool.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements ParsePool. The reader copies lines into a batch and
+ *     queues full batches; each worker takes the oldest queued batch,
+ *     runs the callback on its lines and returns the batch to a free list.
+ *     There are twice as many batches as workers, so the reader can fill
+ *     one while every worker is busy, and a slow pool holds the reader
+ *     back instead of buffering the whole input.
+ *
+ *     In ALLOC_HUGE mode each worker binds itself to a NUMA node before
+ *     parsing, so what its callbacks allocate stays local to it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parse_pool.h"
+
+/* Batches per worker */
+#define BATCHES_PER_THREAD 2
+
+/* Target size of one batch of lines */
+#define PARSE_BATCH_BYTES (1 << 20)
+
+/* Initial number of lines a batch has room for */
+#define PARSE_BATCH_LINES 4096
+
+/* A run of consecutive input lines */
+struct batch {
+        char *data;             /* the lines, back to back */
+        size_t len;
+        size_t capacity;
+        size_t *ends;           /* end offset of each line in data */
+        long lines;
+        long lines_capacity;
+        long first_index;       /* input position of the first line */
+        struct batch *next;     /* free list link */
+};
+
+/* Struct Definition */
+struct ParsePool {
+        parse_line_fn parse;
+        void *cl;
+        alloc_mode_t mode;
+        int nthreads;
+        pthread_t *threads;
+        int nbatches;
+        struct batch *batches;
+        struct batch *filling;  /* owned by the reader, or NULL */
+        long next_index;        /* position of the next line added */
+        int add_failed;         /* the reader ran out of memory */
+
+        /* Guarded by lock */
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        struct batch *free;     /* batches nobody is using */
+        struct batch **ready;   /* queued batches, a ring of nbatches */
+        int head;               /* oldest queued batch */
+        int count;              /* queued batches */
+        int finished;           /* no more batches will be queued */
+        int failed;             /* a callback failed */
+        int started;            /* workers that have picked an index */
+};
+
+/*------------------------Helpers-------------------------*/
+
+/********** parse_batch ********
+ *
+ * Run the callback on every line of a batch.
+ *
+ * Parameters:
+ *      ParsePool *pool:     pool (not NULL)
+ *      struct batch *batch: batch taken off the queue
+ *
+ * Return: 1 if every callback succeeded, else 0
+ ************************/
+static int parse_batch(ParsePool *pool, struct batch *batch)
+{
+        size_t start = 0;
+        for (long i = 0; i < batch->lines; i++) {
+                size_t end = batch->ends[i];
+                if (!pool->parse(batch->data + start, end - start,
+                                 batch->first_index + i, pool->cl)) {
+                        return 0;
+                }
+                start = end;
+        }
+        return 1;
+}
+
+/********** parse_thread ********
+ *
+ * Thread body: parse queued batches until the reader is finished.
+ *
+ * Parameters:
+ *      void *arg: the ParsePool
+ *
+ * Return: NULL
+ ************************/
+static void *parse_thread(void *arg)
+{
+        ParsePool *pool = arg;
+        pthread_mutex_lock(&pool->lock);
+        int worker = pool->started++;
+        pthread_mutex_unlock(&pool->lock);
+        page_alloc_bind_worker(worker, pool->mode);
+
+        for (;;) {
+                pthread_mutex_lock(&pool->lock);
+                while (pool->count == 0 && !pool->finished) {
+                        pthread_cond_wait(&pool->changed, &pool->lock);
+                }
+                if (pool->count == 0) {
+                        pthread_mutex_unlock(&pool->lock);
+                        break;
+                }
+                struct batch *batch = pool->ready[pool->head];
+                pool->head = (pool->head + 1) % pool->nbatches;
+                pool->count--;
+                int skip = pool->failed;
+                pthread_mutex_unlock(&pool->lock);
+
+                /* After a failure the rest of the input is drained */
+                int ok = skip || parse_batch(pool, batch);
+                batch->len = 0;
+                batch->lines = 0;
+
+                pthread_mutex_lock(&pool->lock);
+                if (!ok) {
+                        pool->failed = 1;
+                }
+                batch->next = pool->free;
+                pool->free = batch;
+                pthread_cond_broadcast(&pool->changed);
+                pthread_mutex_unlock(&pool->lock);
+        }
+        return NULL;
+}
+
+/********** queue_batch ********
+ *
+ * Hand the batch being filled to the workers.
+ *
+ * Parameters:
+ *      ParsePool *pool: pool whose reader owns a nonempty filling batch
+ ************************/
+static void queue_batch(ParsePool *pool)
+{
+        pthread_mutex_lock(&pool->lock);
+        int tail = (pool->head + pool->count) % pool->nbatches;
+        pool->ready[tail] = pool->filling;
+        pool->count++;
+        pthread_cond_signal(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+        pool->filling = NULL;
+}
+
+/********** take_batch ********
+ *
+ * Give the reader an empty batch, waiting for one if all are in use.
+ *
+ * Parameters:
+ *      ParsePool *pool: pool whose reader has no filling batch
+ ************************/
+static void take_batch(ParsePool *pool)
+{
+        pthread_mutex_lock(&pool->lock);
+        while (pool->free == NULL) {
+                pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        pool->filling = pool->free;
+        pool->free = pool->free->next;
+        pthread_mutex_unlock(&pool->lock);
+        pool->filling->first_index = pool->next_index;
+}
+
+/********** make_room ********
+ *
+ * Make sure the filling batch can take one more line.
+ *
+ * Parameters:
+ *      struct batch *batch: batch owned by the reader
+ *      size_t line_len:     bytes in the line
+ *
+ * Return: 1 on success, 0 if memory runs out
+ ************************/
+static int make_room(struct batch *batch, size_t line_len)
+{
+        if (batch->len + line_len > batch->capacity) {
+                /* Only a line longer than a whole batch gets here */
+                char *data = realloc(batch->data, batch->len + line_len);
+                if (data == NULL) {
+                        return 0;
+                }
+                batch->data = data;
+                batch->capacity = batch->len + line_len;
+        }
+        if (batch->lines == batch->lines_capacity) {
+                size_t *ends = realloc(batch->ends, 2 * batch->lines_capacity
+                                                    * sizeof *ends);
+                if (ends == NULL) {
+                        return 0;
+                }
+                batch->ends = ends;
+                batch->lines_capacity *= 2;
+        }
+        return 1;
+}
+
+/********** free_pool ********
+ *
+ * Free a pool's batches and the pool itself.
+ *
+ * Parameters:
+ *      ParsePool *pool: pool whose threads are not running
+ ************************/
+static void free_pool(ParsePool *pool)
+{
+        for (int i = 0; pool->batches != NULL && i < pool->nbatches; i++) {
+                free(pool->batches[i].data);
+                free(pool->batches[i].ends);
+        }
+        free(pool->batches);
+        free(pool->ready);
+        free(pool->threads);
+        free(pool);
+}
+
+/********** stop_threads ********
+ *
+ * Tell the workers no more batches are coming and wait for them.
+ *
+ * Parameters:
+ *      ParsePool *pool:  pool (not NULL)
+ *      int started:      number of workers running
+ ************************/
+static void stop_threads(ParsePool *pool, int started)
+{
+        pthread_mutex_lock(&pool->lock);
+        pool->finished = 1;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < started; i++) {
+                pthread_join(pool->threads[i], NULL);
+        }
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** create_parse_pool ********
+ *
+ * Start worker threads that run parse on every line added.
+ *
+ * Parameters:
+ *      int threads:         number of workers (> 0)
+ *      alloc_mode_t mode:   ALLOC_HUGE to spread workers over NUMA nodes
+ *      parse_line_fn parse: callback for each line (not NULL)
+ *      void *cl:            passed to parse
+ *
+ * Return:
+ *      new pool, or NULL if memory or the threads cannot be had
+ *
+ * Notes:
+ *      parse runs on several threads at once. Caller must close the
+ *      pool with close_parse_pool.
+ ************************/
+ParsePool *create_parse_pool(int threads, alloc_mode_t mode,
+                             parse_line_fn parse, void *cl)
+{
+        if (threads <= 0) {
+                return NULL;
+        }
+        ParsePool *pool = calloc(1, sizeof *pool);
+        if (pool == NULL) {
+                return NULL;
+        }
+        pool->parse = parse;
+        pool->cl = cl;
+        pool->mode = mode;
+        pool->nthreads = threads;
+        pool->nbatches = BATCHES_PER_THREAD * threads;
+        pool->threads = malloc(threads * sizeof *pool->threads);
+        pool->batches = calloc(pool->nbatches, sizeof *pool->batches);
+        pool->ready = malloc(pool->nbatches * sizeof *pool->ready);
+        int ok = pool->threads != NULL && pool->batches != NULL &&
+                 pool->ready != NULL;
+        for (int i = 0; ok && i < pool->nbatches; i++) {
+                struct batch *batch = &pool->batches[i];
+                batch->data = malloc(PARSE_BATCH_BYTES);
+                batch->ends = malloc(PARSE_BATCH_LINES * sizeof *batch->ends);
+                ok = batch->data != NULL && batch->ends != NULL;
+                batch->capacity = PARSE_BATCH_BYTES;
+                batch->lines_capacity = PARSE_BATCH_LINES;
+                batch->next = pool->free;
+                pool->free = batch;
+        }
+        if (!ok) {
+                free_pool(pool);
+                return NULL;
+        }
+
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->changed, NULL);
+        for (int i = 0; i < threads; i++) {
+                if (pthread_create(&pool->threads[i], NULL, parse_thread,
+                                   pool) != 0) {
+                        stop_threads(pool, i);
+                        pthread_cond_destroy(&pool->changed);
+                        pthread_mutex_destroy(&pool->lock);
+                        free_pool(pool);
+                        return NULL;
+                }
+        }
+        return pool;
+}
+
+/********** parse_pool_add_line ********
+ *
+ * Queue the next input line for parsing.
+ *
+ * Parameters:
+ *      ParsePool *pool: pool (not NULL)
+ *      const char *line: line including its final byte; copied before
+ *                        returning
+ *      size_t line_len:  bytes in line (> 0)
+ *
+ * Effects:
+ *      Numbers the line after the previous one. Waits while every batch
+ *      is queued or being parsed. If memory runs out the line is dropped
+ *      and close_parse_pool reports failure.
+ ************************/
+void parse_pool_add_line(ParsePool *pool, const char *line, size_t line_len)
+{
+        if (pool->add_failed) {
+                return;
+        }
+        if (pool->filling != NULL &&
+            pool->filling->len + line_len > PARSE_BATCH_BYTES &&
+            pool->filling->lines > 0) {
+                queue_batch(pool);
+        }
+        if (pool->filling == NULL) {
+                take_batch(pool);
+        }
+
+        struct batch *batch = pool->filling;
+        if (!make_room(batch, line_len)) {
+                pool->add_failed = 1;
+                return;
+        }
+        memcpy(batch->data + batch->len, line, line_len);
+        batch->len += line_len;
+        batch->ends[batch->lines++] = batch->len;
+        pool->next_index++;
+}
+
+/********** close_parse_pool ********
+ *
+ * Parse the remaining lines, stop the workers, and free the pool.
+ *
+ * Parameters:
+ *      ParsePool *pool: pool to close (not NULL)
+ *
+ * Return:
+ *      1 if every line was added and parsed successfully, else 0
+ ************************/
+int close_parse_pool(ParsePool *pool)
+{
+        if (pool->filling != NULL && pool->filling->lines > 0) {
+                queue_batch(pool);
+        }
+        stop_threads(pool, pool->nthreads);
+
+        int ok = !pool->failed && !pool->add_failed;
+        pthread_cond_destroy(&pool->changed);
+        pthread_mutex_destroy(&pool->lock);
+        free_pool(pool);
+        return ok;
+}
@@ -0,0 +1,44 @@
+/*
+ *     parse_pool.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for ParsePool, a set of worker threads that parse input
+ *     lines in parallel. The reader hands lines over in input order; they
+ *     are copied into batches, numbered, and given to whichever worker is
+ *     free, so a worker's callback sees every line's original position
+ *     but lines are not processed in order.
+ */
+
+#ifndef PARSE_POOL_H
+#define PARSE_POOL_H
+
+#include <stddef.h>
+#include "page_alloc.h"
+
+/********** parse_line_fn ********
+ * Callback run on a worker thread for every line.
+ *      char *line:      copy of the line, including its final byte; may be
+ *                       modified in place
+ *      size_t line_len: bytes in line (> 0)
+ *      long line_index: position of the line in the input, from 0
+ *      void *cl:        closure given to create_parse_pool
+ * Returns nonzero on success, 0 to fail the whole pool. Must not raise
+ * exceptions (the CII exception stack is not per thread).
+ ************************/
+typedef int (*parse_line_fn)(char *line, size_t line_len, long line_index,
+                             void *cl);
+
+/********** ParsePool ********
+ * Abstract type representing a pool of line-parsing threads.
+ ************************/
+typedef struct ParsePool ParsePool;
+
+/* Functions */
+ParsePool *create_parse_pool(int threads, alloc_mode_t mode,
+                             parse_line_fn parse, void *cl);
+void parse_pool_add_line(ParsePool *pool, const char *line, size_t line_len);
+int close_parse_pool(ParsePool *pool);
+
+#endif /* PARSE_POOL_H */
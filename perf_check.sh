@@ -0,0 +1,108 @@
+#!/bin/sh
+# Restoration throughput regression check (run by "make perf-check")
+#
+# Usage: ./perf_check.sh [--update]
+#
+# Restores generated corrupted inputs of each size in PERF_SIZES
+# (megabytes, default "1 100 1024"), PERF_RUNS times each (default 3),
+# and records the best throughput and the peak RSS of that run in
+# perf_results.json. The results are compared against perf_baseline.json;
+# the check fails if throughput drops, or peak RSS grows, by more than
+# the baseline's threshold_percent. --update rewrites the baseline from
+# this run instead. Extra restoration options can be passed in
+# PERF_FLAGS (e.g. PERF_FLAGS="--read-mode block").
+
+sizes=${PERF_SIZES:-"1 100 1024"}
+runs=${PERF_RUNS:-3}
+baseline=perf_baseline.json
+results=perf_results.json
+inputs=perf_inputs
+
+now() {
+        date +%s.%N
+}
+
+# baseline_value SIZE_MB FIELD: print FIELD of the baseline run for SIZE_MB
+baseline_value() {
+        [ -f "$baseline" ] || return
+        awk -v size="$1" -v field="$2" '
+                $0 ~ "\"size_mb\": *" size "[,}]" {
+                        if (match($0, "\"" field "\": *[0-9.]+")) {
+                                value = substr($0, RSTART, RLENGTH)
+                                sub(/.*: */, "", value)
+                                print value
+                        }
+                }' "$baseline"
+}
+
+mkdir -p "$inputs"
+threshold=$(sed -n 's/.*"threshold_percent": *\([0-9.]*\).*/\1/p' \
+            "$baseline" 2>/dev/null)
+threshold=${threshold:-20}
+status=0
+entries=""
+
+printf "%8s %12s %12s %12s %12s\n" size_mb MB/s base_MB/s rss_kb base_rss_kb
+for size in $sizes; do
+        input="$inputs/input_${size}mb.txt"
+        if [ ! -f "$input" ]; then
+                ./gen_corrupted $(( size * 1048576 )) > "$input" || exit 1
+        fi
+        bytes=$(wc -c < "$input")
+
+        best=""
+        rss=""
+        i=0
+        while [ "$i" -lt "$runs" ]; do
+                start=$(now)
+                ./restoration -s $PERF_FLAGS "$input" \
+                        > /dev/null 2> "$inputs/stats.txt" || exit 1
+                end=$(now)
+                run_rss=$(awk '$1 == "peak_rss_kb" { print $2 }' \
+                          "$inputs/stats.txt")
+                mbps=$(awk -v s="$start" -v e="$end" -v b="$bytes" \
+                       'BEGIN { printf "%.2f", b / (e - s) / 1048576 }')
+                if [ -z "$best" ] || \
+                   awk -v a="$mbps" -v b="$best" 'BEGIN { exit !(a > b) }'
+                then
+                        best=$mbps
+                        rss=$run_rss
+                fi
+                i=$(( i + 1 ))
+        done
+
+        entry="    {\"size_mb\": $size, \"throughput_mb_s\": $best, \"peak_rss_kb\": $rss}"
+        entries="${entries:+$entries,
+}$entry"
+
+        base_mbps=$(baseline_value "$size" throughput_mb_s)
+        base_rss=$(baseline_value "$size" peak_rss_kb)
+        printf "%8s %12s %12s %12s %12s\n" "$size" "$best" \
+               "${base_mbps:--}" "$rss" "${base_rss:--}"
+        [ "$1" = "--update" ] && continue
+        if [ -z "$base_mbps" ] || [ -z "$base_rss" ]; then
+                echo "no baseline for ${size} MB (run: make perf-baseline)"
+                status=1
+                continue
+        fi
+        if awk -v v="$best" -v b="$base_mbps" -v t="$threshold" \
+               'BEGIN { exit !(v < b * (1 - t / 100)) }'; then
+                echo "REGRESSION: ${size} MB throughput $best MB/s < baseline $base_mbps MB/s - $threshold%"
+                status=1
+        fi
+        if awk -v v="$rss" -v b="$base_rss" -v t="$threshold" \
+               'BEGIN { exit !(v > b * (1 + t / 100)) }'; then
+                echo "REGRESSION: ${size} MB peak RSS $rss kB > baseline $base_rss kB + $threshold%"
+                status=1
+        fi
+done
+
+printf '{\n  "threshold_percent": %s,\n  "runs": [\n%s\n  ]\n}\n' \
+       "$threshold" "$entries" > "$results"
+if [ "$1" = "--update" ]; then
+        cp "$results" "$baseline"
+        echo "baseline updated: $baseline"
+elif [ "$status" -eq 0 ]; then
+        echo "perf-check passed (threshold $threshold%)"
+fi
+exit $status
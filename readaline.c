@@ -7,10 +7,12 @@
  *     This file implements the readaline function as specified.
  *     Reads a single line (ending with '\n') from an input stream
  *     into a dynamically allocated buffer, while ensuring checked runtime
- *     error safety.
+ *     error safety. readaline_status does the reading and reports errors
+ *     as a restore_status_t, for callers that must not raise.
  */
 
 #include "readaline.h"
+#include "restore_status.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <except.h>
@@ -25,10 +27,6 @@ Except_T Runtime_Error;
 /* Helper function declarations */
 void check_null(void *pointer_to_check);
 void check_valid_input(FILE *inputfd, char **datapp);
-char *allocate_buffer_mem(size_t capacity);
-void check_output_array_length(size_t curr_length, size_t *curr_capacity, 
-                               char **buffer);
-void check_read_errors(FILE *inputfd, char *buffer);
 
 /********** readaline ********
  *
@@ -47,34 +45,91 @@ void check_read_errors(FILE *inputfd, char *buffer);
  * Effects:
  *      Allocates memory for buffer, assigns to *datapp.
  *      Caller responsible for freeing *datapp.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE for NULL arguments, read errors, or if memory runs
+ *      out (see readaline_status).
  ************************/
 size_t readaline(FILE *inputfd, char **datapp) 
 {
         check_valid_input(inputfd, datapp); 
         
+        size_t length;
+        if (readaline_status(inputfd, datapp, &length) != RESTORE_OK) {
+                RAISE(Runtime_Error);
+        }
+        return length;
+}
+
+/********** readaline_status ********
+ *
+ * Read a single line from inputfd into a newly allocated buffer without
+ * raising exceptions.
+ *
+ * Parameters:
+ *      FILE *inputfd:  input file stream
+ *      char **datapp:  out; the line, or NULL at EOF or on failure
+ *      size_t *length: out; characters read (including final '\n'), 0
+ *                      at EOF
+ *
+ * Return:
+ *      RESTORE_OK (also at EOF), RESTORE_ERR_ARGUMENT for a NULL
+ *      argument, RESTORE_ERR_READ if the stream reports an error, or
+ *      RESTORE_ERR_MEMORY
+ *
+ * Effects:
+ *      Same as readaline. Reentrant: threads may read their own streams
+ *      at once. Nothing is left allocated on failure.
+ ************************/
+restore_status_t readaline_status(FILE *inputfd, char **datapp,
+                                  size_t *length)
+{
+        if (inputfd == NULL || datapp == NULL || length == NULL) {
+                return RESTORE_ERR_ARGUMENT;
+        }
+        *datapp = NULL;
+        *length = 0;
+
         int ch = fgetc(inputfd);
         /* Check for read errors after 1st fgetc */
-        check_read_errors(inputfd, NULL);
+        if (ferror(inputfd)) {
+                return RESTORE_ERR_READ;
+        }
         if (ch == EOF) {
-                *datapp = NULL;
-                return 0;
+                return RESTORE_OK;
         }
 
         /* Build the output array */
         size_t curr_capacity = INITIAL_OUTPUT_ARRAY_CAPACITY, curr_length = 0;
-        char *buffer = allocate_buffer_mem(curr_capacity);
+        char *buffer = malloc(curr_capacity);
+        if (buffer == NULL) {
+                return RESTORE_ERR_MEMORY;
+        }
         while (ch != '\n' && ch != EOF) {
+                /* Keep room for this char and a trailing '\n' */
+                if (curr_length >= curr_capacity - 1) {
+                        char *grown = realloc(buffer, 2 * curr_capacity);
+                        if (grown == NULL) {
+                                free(buffer);
+                                return RESTORE_ERR_MEMORY;
+                        }
+                        buffer = grown;
+                        curr_capacity *= 2;
+                }
                 /* Store the current char in the buffer and read the next one */
-                check_output_array_length(curr_length, &curr_capacity, &buffer);
                 buffer[curr_length++] = (char) ch;
                 ch = fgetc(inputfd);
-                check_read_errors(inputfd, buffer);
+                if (ferror(inputfd)) {
+                        free(buffer);
+                        return RESTORE_ERR_READ;
+                }
         }
         if (ch != EOF) {
                 buffer[curr_length++] = '\n';
         }   
         *datapp = buffer;
-        return curr_length;  
+        *length = curr_length;
+        return RESTORE_OK;
 }
 
 /********** check_valid_input ********
@@ -98,90 +153,6 @@ void check_valid_input(FILE *inputfd, char **datapp)
         return;
 }
 
-/********** allocate_buffer_mem ********
- *
- * Allocate a character buffer of the requested capacity.
- *
- * Parameters:
- *      size_t capacity:  number of bytes to allocate
- *
- * Return:
- *      Pointer to newly allocated buffer of size capacity.
- *
- * Expects:
- *      capacity > 0
- *
- * Effects:
- *      Allocates memory with malloc; caller must free it.
- *
- * Checked Runtime Errors:
- *      Raises a CRE if malloc fails.
- ************************/
-char *allocate_buffer_mem(size_t capacity) 
-{
-        char *out = malloc(capacity);
-        /* Check if enough memory was found */
-        check_null(out);
-        return out;
-}
-
-/********** check_output_array_length ********
- *
- * Ensure there is space in the buffer for the next write (and trailing '\n').
- * Doubles capacity and updates the caller’s buffer and capacity if needed.
- *
- * Parameters:
- *      size_t  curr_length:    number of bytes currently stored in buffer
- *      size_t *curr_capacity:  in/out; current capacity updated if grown
- *      char  **buffer:         in/out; pointer updated if reallocated
- *
- * Expects:
- *      curr_capacity and buffer are not NULL and point to valid objects.
- *
- * Effects:
- *      May reallocate the buffer via realloc and update *buffer and
- *      *curr_capacity accordingly.
- *
- * Checked Runtime Errors:
- *      Raises a CRE if realloc fails (original buffer remains owned by caller).
- ************************/
-void check_output_array_length(size_t curr_length, size_t *curr_capacity, 
-                                char **buffer) 
-{
-        if (curr_length >= *curr_capacity - 1) {
-                *curr_capacity *= 2;
-                char *new_buffer = realloc(*buffer, *curr_capacity);
-                check_null(new_buffer);
-                *buffer = new_buffer;
-        }
-        return;
-}
-
-/********** check_read_errors ********
- *
- * Check for a stream read error on inputfd after reading operations.
- *
- * Parameters:
- *      FILE *inputfd:  input stream to check
- *      char *buffer:   buffer to free if a read error is detected
- *
- * Expects:
- *      inputfd is not NULL; buffer is either NULL or an allocated block.
- *
- * Effects:
- *      Frees buffer if a read error is detected.
- *
- * Checked Runtime Errors:
- *      Raises a CRE if ferror(inputfd) is set.
- ************************/
-void check_read_errors(FILE *inputfd, char *buffer) 
-{
-        if (ferror(inputfd)) {
-                free(buffer);
-                RAISE(Runtime_Error);
-        }
-}
-
 /********** check_null ********
  *
  * Check if a pointer is NULL and raise a checked runtime error if so.
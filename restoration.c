@@ -17,7 +17,17 @@
  *     Dependencies: restoration.h, readaline.h, line_table.h, seq.h, except.h
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "restoration.h" 
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+/* Error Definition */
+Except_T Checked_Runtime_Error;
 
 /**************** main *****************
  *
@@ -28,36 +38,421 @@
  *      char *argv[]:   vector of command-line arguments
  *
  * Return:
- *      EXIT_SUCCESS on success; exits with nonzero on usage/CRE.
+ *      EXIT_SUCCESS on success, EXIT_FAILURE if a --batch input failed;
+ *      exits with nonzero on usage/CRE.
  *
  * Expects:
- *      At most 1 argument: program name and optional input path.
+ *      Options (see parse_arguments) and at most one input path.
  *
  * Effects:
  *      Opens files inside restore_image; may print diagnostics to stderr.
- *      If no argument provided, reads from standard input.
+ *      If no input path provided, reads from standard input. Prints
+ *      counters to stderr when --stats is given.
  *
  * Checked Runtime Errors:
- *      Raises CRE if more than 1 argument is supplied.
+ *      Raises CRE on a malformed command line.
  *      Exits with nonzero; restore_image may raise CRE.
+ *
+ * Notes:
+ *      Compiled out with -DRESTORATION_NO_MAIN, so test harnesses can
+ *      link this file.
  ************************/
+#ifndef RESTORATION_NO_MAIN
 int main(int argc, char *argv[]) 
 {
-        if (argc > 2) {
-                RAISE(Checked_Runtime_Error);
+        struct restore_options options = {0};
+        struct restore_stats stats = {0};
+        options.cache_policy = CACHE_EVICT_LRU;
+        options.queue_depth = BLOCK_READER_QUEUE_DEPTH;
+        const char *input_filename = parse_arguments(argc, argv, &options);
+        if (options.serve_path != NULL) {
+                return serve_restorations(&options);
         }
+
+        volatile int status = EXIT_SUCCESS;
         TRY
-                if (argc == 2) {
-                        restore_image(argv[1]);
-                } else { 
-                        /* Read from stdin */
-                        restore_image(NULL);
+                if (options.batch_path != NULL) {
+                        status = restore_batch(&options, &stats);
+                } else {
+                        /* NULL input_filename reads from stdin */
+                        restore_image_with_options(input_filename, &options,
+                                                   &stats);
                 }
         EXCEPT(Checked_Runtime_Error)
                 exit(1);
         END_TRY;
-        
-        return EXIT_SUCCESS;
+
+        if (options.print_stats) {
+                print_restore_stats(stderr, &stats);
+        }
+        free_restore_stats(&stats);
+        return status;
+}
+#endif /* RESTORATION_NO_MAIN */
+
+/**************** parse_count *****************
+ *
+ * Parse a nonnegative decimal count given as an option value.
+ *
+ * Parameters:
+ *      const char *text: option value (not NULL)
+ *
+ * Return:
+ *      Parsed value.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if text is not a nonnegative decimal number.
+ ************************/
+long long parse_count(const char *text)
+{
+        char *end;
+        long long value = strtoll(text, &end, 10);
+        if (end == text || *end != '\0' || value < 0) {
+                RAISE(Checked_Runtime_Error);
+        }
+        return value;
+}
+
+/**************** option_value *****************
+ *
+ * Consume and return the value following an option that requires one.
+ *
+ * Parameters:
+ *      int argc:      number of command-line arguments
+ *      char *argv[]:  vector of command-line arguments
+ *      int *i:        in/out; index of the option, advanced to its value
+ *
+ * Return:
+ *      The option's value.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the option is the last argument.
+ ************************/
+const char *option_value(int argc, char *argv[], int *i)
+{
+        if (*i + 1 >= argc) {
+                RAISE(Checked_Runtime_Error);
+        }
+        (*i)++;
+        return argv[*i];
+}
+
+/**************** parse_read_mode *****************
+ *
+ * Parse the value of --read-mode.
+ *
+ * Parameters:
+ *      const char *text: option value (not NULL)
+ *
+ * Return:
+ *      Matching read_mode_t.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if text names no read mode.
+ ************************/
+read_mode_t parse_read_mode(const char *text)
+{
+        if (strcmp(text, "stdio") == 0) {
+                return READ_STDIO;
+        } else if (strcmp(text, "block") == 0) {
+                return READ_BLOCK;
+        } else if (strcmp(text, "cold") == 0) {
+                return READ_COLD;
+        } else if (strcmp(text, "direct") == 0) {
+                return READ_DIRECT;
+        } else if (strcmp(text, "uring") == 0) {
+                return READ_URING;
+        }
+        RAISE(Checked_Runtime_Error);
+        return READ_STDIO;
+}
+
+/**************** parse_output_format *****************
+ *
+ * Parse the value of --format.
+ *
+ * Parameters:
+ *      const char *text: option value (not NULL)
+ *
+ * Return:
+ *      Matching output_format_t.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if text names no format, or a format this build
+ *      cannot write.
+ ************************/
+output_format_t parse_output_format(const char *text)
+{
+        output_format_t format;
+        if (strcmp(text, "pgm") == 0) {
+                format = FORMAT_PGM;
+        } else if (strcmp(text, "png") == 0) {
+                format = FORMAT_PNG;
+        } else if (strcmp(text, "zstd") == 0) {
+                format = FORMAT_ZSTD;
+        } else {
+                RAISE(Checked_Runtime_Error);
+                return FORMAT_PGM;
+        }
+        if (!output_format_supported(format)) {
+                RAISE(Checked_Runtime_Error);
+        }
+        return format;
+}
+
+/**************** parse_size *****************
+ *
+ * Parse a WIDTHxHEIGHT option value, such as that of --thumbnail.
+ *
+ * Parameters:
+ *      const char *text: option value (not NULL)
+ *      int *width:       out; WIDTH
+ *      int *height:      out; HEIGHT
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE unless text is two positive decimal numbers that fit
+ *      in an int, joined by 'x'.
+ ************************/
+void parse_size(const char *text, int *width, int *height)
+{
+        char *end;
+        long w = strtol(text, &end, 10);
+        if (end == text || *end != 'x' || !isdigit(end[1])) {
+                RAISE(Checked_Runtime_Error);
+        }
+        const char *rest = end + 1;
+        long h = strtol(rest, &end, 10);
+        if (*end != '\0' || w <= 0 || h <= 0 || w > INT_MAX ||
+            h > INT_MAX) {
+                RAISE(Checked_Runtime_Error);
+        }
+        *width = w;
+        *height = h;
+}
+
+/**************** parse_row_range *****************
+ *
+ * Parse a FIRST:LAST option value, such as that of --rows.
+ *
+ * Parameters:
+ *      const char *text: option value (not NULL)
+ *      long *first:      out; FIRST
+ *      long *last:       out; LAST
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE unless text is two decimal numbers joined by ':',
+ *      with FIRST less than LAST and LAST less than LONG_MAX.
+ ************************/
+void parse_row_range(const char *text, long *first, long *last)
+{
+        char *end;
+        long from = strtol(text, &end, 10);
+        if (!isdigit(text[0]) || *end != ':' || !isdigit(end[1])) {
+                RAISE(Checked_Runtime_Error);
+        }
+        const char *rest = end + 1;
+        long to = strtol(rest, &end, 10);
+        if (*end != '\0' || from >= to || to == LONG_MAX) {
+                RAISE(Checked_Runtime_Error);
+        }
+        *first = from;
+        *last = to;
+}
+
+/**************** parse_arguments *****************
+ *
+ * Fill options from the command line and find the input path.
+ *
+ * Parameters:
+ *      int argc:                  number of command-line arguments
+ *      char *argv[]:              vector of command-line arguments
+ *      restore_options_t options: out; options set by the command line
+ *
+ * Return:
+ *      Input path, or NULL to read from standard input.
+ *
+ * Notes:
+ *      Recognized options:
+ *        -o, --output PATH          write the image to PATH, not stdout
+ *        -s, --stats                print counters to stderr at exit
+ *        --format pgm|png|zstd      write raw P5 (default), a grayscale
+ *                                   PNG, or P5 in a zstd frame; a target
+ *                                   whose rows hold no integers has no
+ *                                   pixels, which a PNG cannot hold, so
+ *                                   png fails with RESTORE_ERR_ARGUMENT
+ *        --read-mode MODE           stdio (default), block, cold, direct
+ *                                   or uring; see read_mode_t in
+ *                                   block_reader.h
+ *        --queue-depth N            reads in flight in uring mode
+ *        --speculate N              guess the target from the first N
+ *                                   lines and stream its rows before the
+ *                                   input is done (seekable -o only; no
+ *                                   --format png|zstd or --cache)
+ *        --threads N                parse lines, and write a tall P5
+ *                                   raster to a file, on N threads (no
+ *                                   --speculate with N > 1)
+ *        --lazy                     keep each line's raw text and parse
+ *                                   only the target's rows, at output
+ *        --thumbnail WxH            write the image box-filtered down to
+ *                                   at most W by H pixels instead (implies
+ *                                   --lazy; no --speculate)
+ *        --index                    also write INPUT.fpidx, recording
+ *                                   where each row of the target lies
+ *                                   (named, uncompressed inputs read on
+ *                                   one thread; never served from
+ *                                   --cache; see row_index.h)
+ *        --rows N:M                 write only rows N to M - 1 of the
+ *                                   image, counting from 0; read straight
+ *                                   from INPUT.fpidx when it is current
+ *                                   (no --thumbnail or --speculate)
+ *        --insert-batch N           insert lines into the line table N
+ *                                   at a time (1 to LINE_TABLE_BATCH_MAX,
+ *                                   default INSERT_BATCH), prefetching
+ *                                   their hash chains; single-threaded
+ *                                   parsing only
+ *        --alloc default|huge       back the line table with huge pages
+ *                                   and keep each parsing thread on one
+ *                                   NUMA node (see page_alloc.h)
+ *        --serve SOCKET             run as a job server on a Unix domain
+ *                                   socket instead (see job_server.h);
+ *                                   other options apply to every job
+ *        --workers N                job server processes (default: one
+ *                                   per online CPU)
+ *        --batch LIST               restore every "INPUT<TAB>OUTPUT" line
+ *                                   of LIST on --threads threads (default:
+ *                                   one per online CPU), splitting large
+ *                                   inputs into chunks
+ *        --cache DIR                reuse restored output keyed by the
+ *                                   input's content hash (named inputs only)
+ *        --cache-max-entries N      evict beyond N cache entries
+ *        --cache-max-bytes N        evict beyond N bytes of cache entries
+ *        --cache-evict lru|fifo     eviction order (default lru)
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE for unknown options, missing or malformed option
+ *      values, more than one input path, an input path or -o with
+ *      --serve or --batch, --rows with --thumbnail, or --speculate with
+ *      --threads N > 1, --thumbnail, --rows, --format png|zstd or
+ *      --cache.
+ ************************/
+const char *parse_arguments(int argc, char *argv[], restore_options_t options)
+{
+        const char *input_filename = NULL;
+        for (int i = 1; i < argc; i++) {
+                const char *arg = argv[i];
+                if (strcmp(arg, "-s") == 0 || strcmp(arg, "--stats") == 0) {
+                        options->print_stats = 1;
+                } else if (strcmp(arg, "-o") == 0 || 
+                           strcmp(arg, "--output") == 0) {
+                        options->output_path = option_value(argc, argv, &i);
+                } else if (strcmp(arg, "--format") == 0) {
+                        const char *format = option_value(argc, argv, &i);
+                        options->format = parse_output_format(format);
+                } else if (strcmp(arg, "--read-mode") == 0) {
+                        options->read_mode = 
+                                parse_read_mode(option_value(argc, argv, &i));
+                } else if (strcmp(arg, "--queue-depth") == 0) {
+                        options->queue_depth = 
+                                parse_count(option_value(argc, argv, &i));
+                        if (options->queue_depth == 0) {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (strcmp(arg, "--speculate") == 0) {
+                        options->speculate_lines = 
+                                parse_count(option_value(argc, argv, &i));
+                        if (options->speculate_lines == 0) {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (strcmp(arg, "--threads") == 0) {
+                        options->threads = 
+                                parse_count(option_value(argc, argv, &i));
+                        if (options->threads == 0) {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (strcmp(arg, "--insert-batch") == 0) {
+                        options->insert_batch = 
+                                parse_count(option_value(argc, argv, &i));
+                        if (options->insert_batch == 0 ||
+                            options->insert_batch > LINE_TABLE_BATCH_MAX) {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (strcmp(arg, "--lazy") == 0) {
+                        options->lazy_digits = 1;
+                } else if (strcmp(arg, "--thumbnail") == 0) {
+                        parse_size(option_value(argc, argv, &i),
+                                   &options->thumbnail_width,
+                                   &options->thumbnail_height);
+                        /* Only the target's rows get parsed, one at a time */
+                        options->lazy_digits = 1;
+                } else if (strcmp(arg, "--index") == 0) {
+                        options->write_index = 1;
+                } else if (strcmp(arg, "--rows") == 0) {
+                        parse_row_range(option_value(argc, argv, &i),
+                                        &options->rows_first,
+                                        &options->rows_last);
+                } else if (strcmp(arg, "--alloc") == 0) {
+                        const char *mode = option_value(argc, argv, &i);
+                        if (strcmp(mode, "default") == 0) {
+                                options->alloc_mode = ALLOC_DEFAULT;
+                        } else if (strcmp(mode, "huge") == 0) {
+                                options->alloc_mode = ALLOC_HUGE;
+                        } else {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (strcmp(arg, "--serve") == 0) {
+                        options->serve_path = option_value(argc, argv, &i);
+                } else if (strcmp(arg, "--workers") == 0) {
+                        options->workers = 
+                                parse_count(option_value(argc, argv, &i));
+                        if (options->workers == 0) {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (strcmp(arg, "--batch") == 0) {
+                        options->batch_path = option_value(argc, argv, &i);
+                } else if (strcmp(arg, "--cache") == 0) {
+                        options->cache_dir = option_value(argc, argv, &i);
+                } else if (strcmp(arg, "--cache-max-entries") == 0) {
+                        options->cache_max_entries = 
+                                parse_count(option_value(argc, argv, &i));
+                } else if (strcmp(arg, "--cache-max-bytes") == 0) {
+                        options->cache_max_bytes = 
+                                parse_count(option_value(argc, argv, &i));
+                } else if (strcmp(arg, "--cache-evict") == 0) {
+                        const char *policy = option_value(argc, argv, &i);
+                        if (strcmp(policy, "lru") == 0) {
+                                options->cache_policy = CACHE_EVICT_LRU;
+                        } else if (strcmp(policy, "fifo") == 0) {
+                                options->cache_policy = CACHE_EVICT_FIFO;
+                        } else {
+                                RAISE(Checked_Runtime_Error);
+                        }
+                } else if (arg[0] == '-' && arg[1] != '\0') {
+                        /* Unknown option */
+                        RAISE(Checked_Runtime_Error);
+                } else if (input_filename == NULL) {
+                        input_filename = arg;
+                } else {
+                        /* More than one input path */
+                        RAISE(Checked_Runtime_Error);
+                }
+        }
+        if ((options->serve_path != NULL || options->batch_path != NULL) &&
+            (input_filename != NULL || options->output_path != NULL)) {
+                /* Jobs name their own input and output */
+                RAISE(Checked_Runtime_Error);
+        }
+        if (options->rows_last > 0 && options->thumbnail_width > 0) {
+                RAISE(Checked_Runtime_Error);
+        }
+        if (options->speculate_lines > 0 && 
+            (options->threads > 1 || options->thumbnail_width > 0 ||
+             options->rows_last > 0 || options->format != FORMAT_PGM ||
+             options->cache_dir != NULL)) {
+                /* Speculation streams every P5 row on one thread,
+                 * straight into the output file */
+                RAISE(Checked_Runtime_Error);
+        }
+        return input_filename;
 }
 
 /********** check_if_null ********
@@ -80,6 +475,55 @@ void check_if_null(void *pointer_to_check)
         }
 }
 
+/**************** check_status *****************
+ *
+ * Turn the result of a *_status function back into a CRE.
+ *
+ * Parameters:
+ *      restore_status_t status: result to check
+ *
+ * Effects:
+ *      None if status is RESTORE_OK.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE for any other status.
+ ************************/
+void check_status(restore_status_t status)
+{
+        if (status != RESTORE_OK) {
+                RAISE(Checked_Runtime_Error);
+        }
+}
+
+/**************** restore_status_string *****************
+ *
+ * Describe a status for diagnostics.
+ *
+ * Parameters:
+ *      restore_status_t status: status to describe
+ *
+ * Return:
+ *      static string naming the failure ("ok" for RESTORE_OK)
+ ************************/
+const char *restore_status_string(restore_status_t status)
+{
+        switch (status) {
+        case RESTORE_OK:
+                return "ok";
+        case RESTORE_ERR_ARGUMENT:
+                return "invalid argument";
+        case RESTORE_ERR_MEMORY:
+                return "out of memory";
+        case RESTORE_ERR_OPEN:
+                return "cannot open file";
+        case RESTORE_ERR_READ:
+                return "read error";
+        case RESTORE_ERR_WRITE:
+                return "write error";
+        }
+        return "unknown error";
+}
+
 /**************** create_digit_array *****************
  *
  * Wrap a digits buffer and its logical length into a digit_array_t.
@@ -110,34 +554,304 @@ digit_array_t create_digit_array(int *digits, int length)
         return da;
 }
 
-/**************** write_digit_arrays_from_sequence *****************
+/**************** write_digit_arrays_from_sequence_status *****************
  *
- * Write a PGM raster from a sequence of int* rows as single-byte pixels.
+ * Write a PGM raster from an array of int* rows as single-byte pixels.
  *
  * Parameters:
- *      FILE *output:        open stream for writing (binary)
- *      Seq_T digit_sequences: sequence whose elements are (int *) rows
- *      int row_width:       number of pixels in each row
+ *      OutputSink *output:    sink receiving the raster
+ *      int **rows:            the image's rows, top first
+ *      int height:            number of rows
+ *      int row_width:         number of pixels in each row
+ *      long *clamped:         out; pixels outside [0, MAXVAL]
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_MEMORY if the row buffer cannot be
+ *      allocated
  *
  * Expects:
- *      output not NULL and writable; digit_sequences not NULL;
- *      each row has at least row_width integers in [0,255].
+ *      output not NULL; rows not NULL unless height is 0;
+ *      each row has at least row_width integers.
  *
  * Effects:
- *      Writes row_count * row_width bytes to output.
+ *      Writes height * row_width bytes to output, one row per write.
+ *      Pixels are narrowed with narrow_row, so out-of-range values are
+ *      clamped to [0, MAXVAL] instead of wrapping.
  ************************/
-void write_digit_arrays_from_sequence(FILE *output, Seq_T digit_sequences, 
-                                        int row_width)
+restore_status_t write_digit_arrays_from_sequence_status(OutputSink *output,
+                                                         int **rows,
+                                                         int height,
+                                                         int row_width,
+                                                         long *clamped)
 {
+        *clamped = 0;
+        unsigned char *row = malloc(row_width > 0 ? row_width : 1);
+        if (row == NULL) {
+                return RESTORE_ERR_MEMORY;
+        }
+
         /* Write each digit array as a row of pixel vals */
-        for (int i = 0; i < Seq_length(digit_sequences); i++) {
-                int *digit_array = Seq_get(digit_sequences, i);
-                for (int j = 0; j < row_width; j++) {
-                        /* Write each pixel as a single byte */
-                        unsigned char pixel = (unsigned char)digit_array[j];
-                        fwrite(&pixel, sizeof(unsigned char), 1, output);
+        for (int i = 0; i < height; i++) {
+                *clamped += narrow_row(row, rows[i], row_width);
+                sink_write(output, row, row_width);
+        }
+        free(row);
+        return RESTORE_OK;
+}
+
+/**************** write_digit_arrays_from_sequence *****************
+ *
+ * CRE wrapper for write_digit_arrays_from_sequence_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the row buffer cannot be allocated.
+ ************************/
+void write_digit_arrays_from_sequence(OutputSink *output, int **rows,
+                                      int height, int row_width)
+{
+        long clamped;
+        check_status(write_digit_arrays_from_sequence_status(output, rows,
+                                                             height,
+                                                             row_width,
+                                                             &clamped));
+}
+
+/**************** write_rows_at *****************
+ *
+ * Thread body: narrow one share of a raster and pwrite it in place.
+ *
+ * Parameters:
+ *      void *arg: the share's row_writer_t
+ *
+ * Return: NULL
+ *
+ * Effects:
+ *      Writes rows first..last-1 at start + row * width, narrowing up to
+ *      POSITIONAL_CHUNK bytes of rows with narrow_row per pwrite. Sets
+ *      the share's status and clamped count; raises nothing.
+ ************************/
+void *write_rows_at(void *arg)
+{
+        row_writer_t w = arg;
+        int rows_per_chunk = w->width > 0 && w->width < POSITIONAL_CHUNK ?
+                             POSITIONAL_CHUNK / w->width : 1;
+        size_t chunk_size = (size_t)rows_per_chunk * w->width;
+        unsigned char *chunk = malloc(chunk_size > 0 ? chunk_size : 1);
+        if (chunk == NULL) {
+                w->status = RESTORE_ERR_MEMORY;
+                return NULL;
+        }
+
+        w->status = RESTORE_OK;
+        for (int row = w->first; row < w->last; row += rows_per_chunk) {
+                int count = w->last - row < rows_per_chunk ? 
+                            w->last - row : rows_per_chunk;
+                for (int i = 0; i < count; i++) {
+                        w->clamped += narrow_row(chunk + 
+                                                 (size_t)i * w->width,
+                                                 w->rows[row + i],
+                                                 w->width);
+                }
+                size_t len = (size_t)count * w->width;
+                off_t at = w->start + (off_t)row * w->width;
+                size_t done = 0;
+                while (done < len) {
+                        ssize_t n = pwrite(w->fd, chunk + done, len - done,
+                                           at + (off_t)done);
+                        if (n <= 0) {
+                                w->status = RESTORE_ERR_WRITE;
+                                free(chunk);
+                                return NULL;
+                        }
+                        done += (size_t)n;
+                }
+        }
+        free(chunk);
+        return NULL;
+}
+
+/**************** write_digit_arrays_positional_status *****************
+ *
+ * Write a PGM raster on several threads, each row straight to its final
+ * offset in the output file.
+ *
+ * Parameters:
+ *      OutputSink *output:    sink receiving the raster; the header has
+ *                             already been written to it
+ *      int **rows:            the image's rows, top first
+ *      int height:            number of rows
+ *      int row_width:         number of pixels in each row
+ *      int threads:           threads to narrow and write rows on
+ *      long long min_bytes:   smallest raster worth the threads; 0 for
+ *                             POSITIONAL_MIN_BYTES
+ *      long *clamped:         out; pixels outside [0, MAXVAL]
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_MEMORY, or RESTORE_ERR_WRITE
+ *
+ * Expects:
+ *      Same as write_digit_arrays_from_sequence_status.
+ *
+ * Effects:
+ *      Once the header is flushed, row i belongs at the header's end plus
+ *      i * row_width, so the rows are cut into one contiguous share per
+ *      thread and each share is written with pwrite. The descriptor is
+ *      then positioned after the raster, where the sink goes on writing.
+ *      Falls back to write_digit_arrays_from_sequence_status when output
+ *      is not an fd sink on a regular file (pwrite needs offsets, and
+ *      ignores them on O_APPEND descriptors), with a single thread, or
+ *      for rasters under min_bytes. A share whose thread
+ *      cannot be started is written by the calling thread.
+ ************************/
+restore_status_t write_digit_arrays_positional_status(OutputSink *output,
+                                                     int **rows, int height,
+                                                     int row_width, 
+                                                     int threads,
+                                                     long long min_bytes,
+                                                     long *clamped)
+{
+        long long bytes = (long long)height * row_width;
+        int fd = sink_fd(output);
+        struct stat st;
+        int flags = fd >= 0 ? fcntl(fd, F_GETFL) : -1;
+        if (min_bytes == 0) {
+                min_bytes = POSITIONAL_MIN_BYTES;
+        }
+        if (threads <= 1 || bytes < min_bytes || flags < 0 ||
+            (flags & O_APPEND) || fstat(fd, &st) != 0 || 
+            !S_ISREG(st.st_mode) || !sink_flush(output)) {
+                return write_digit_arrays_from_sequence_status(
+                        output, rows, height, row_width, clamped);
+        }
+        off_t start = lseek(fd, 0, SEEK_CUR);
+        if (start < 0) {
+                return write_digit_arrays_from_sequence_status(
+                        output, rows, height, row_width, clamped);
+        }
+
+        *clamped = 0;
+        if (threads > height) {
+                threads = height;
+        }
+        struct row_writer *writers = calloc(threads, sizeof *writers);
+        pthread_t *ids = calloc(threads, sizeof *ids);
+        int *started = calloc(threads, sizeof *started);
+        restore_status_t status = RESTORE_OK;
+        if (writers == NULL || ids == NULL || started == NULL) {
+                status = RESTORE_ERR_MEMORY;
+                threads = 0;
+        }
+        for (int t = 0; t < threads; t++) {
+                row_writer_t w = &writers[t];
+                w->rows = rows;
+                w->width = row_width;
+                w->first = (int)((long long)height * t / threads);
+                w->last = (int)((long long)height * (t + 1) / threads);
+                w->fd = fd;
+                w->start = start;
+                /* The calling thread takes the last share itself */
+                started[t] = t < threads - 1 &&
+                             pthread_create(&ids[t], NULL, write_rows_at,
+                                            w) == 0;
+        }
+        for (int t = 0; t < threads; t++) {
+                if (!started[t]) {
+                        write_rows_at(&writers[t]);
                 }
         }
+        for (int t = 0; t < threads; t++) {
+                if (started[t]) {
+                        pthread_join(ids[t], NULL);
+                }
+                if (status == RESTORE_OK) {
+                        status = writers[t].status;
+                }
+                *clamped += writers[t].clamped;
+        }
+        free(writers);
+        free(ids);
+        free(started);
+
+        if (status == RESTORE_OK && 
+            lseek(fd, start + (off_t)bytes, SEEK_SET) < 0) {
+                status = RESTORE_ERR_WRITE;
+        }
+        return status;
+}
+
+/**************** write_encoded_image_status *****************
+ *
+ * Write a raster from an array of int* rows in a compressed format.
+ *
+ * Parameters:
+ *      OutputSink *output:     sink receiving the image
+ *      output_format_t format: FORMAT_PNG or FORMAT_ZSTD
+ *      int **rows:             the image's rows, top first
+ *      int height:             number of rows
+ *      int row_width:          number of pixels in each row
+ *      long *clamped:          out; pixels outside [0, MAXVAL]
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_ARGUMENT if format cannot hold a
+ *      row_width by height image (a PNG without pixels; nothing is then
+ *      written), RESTORE_ERR_MEMORY if the row buffer or the encoder
+ *      cannot be created, or RESTORE_ERR_WRITE if compression fails
+ *
+ * Expects:
+ *      output not NULL; rows not NULL unless height is 0;
+ *      each row has at least row_width integers.
+ *
+ * Effects:
+ *      Writes the whole image, header included, to output. Rows are
+ *      compressed on a separate thread while later rows are narrowed
+ *      (see write_digit_arrays_from_sequence_status).
+ ************************/
+restore_status_t write_encoded_image_status(OutputSink *output, 
+                                            output_format_t format,
+                                            int **rows, int height,
+                                            int row_width, long *clamped)
+{
+        *clamped = 0;
+        if (!image_encoder_fits(format, row_width, height)) {
+                return RESTORE_ERR_ARGUMENT;
+        }
+        unsigned char *row = malloc(row_width > 0 ? row_width : 1);
+        if (row == NULL) {
+                return RESTORE_ERR_MEMORY;
+        }
+        ImageEncoder *encoder = create_image_encoder(output, format, 
+                                                     row_width, height);
+        if (encoder == NULL) {
+                free(row);
+                return RESTORE_ERR_MEMORY;
+        }
+
+        for (int i = 0; i < height; i++) {
+                *clamped += narrow_row(row, rows[i], row_width);
+                encoder_write_row(encoder, row);
+        }
+        free(row);
+        if (!close_image_encoder(encoder)) {
+                return RESTORE_ERR_WRITE;
+        }
+        return RESTORE_OK;
+}
+
+/**************** write_encoded_image *****************
+ *
+ * CRE wrapper for write_encoded_image_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if format cannot hold the image, if the row buffer
+ *      or the encoder cannot be created, or if compression fails.
+ ************************/
+void write_encoded_image(OutputSink *output, output_format_t format,
+                         int **rows, int height, int row_width)
+{
+        long clamped;
+        check_status(write_encoded_image_status(output, format, rows, 
+                                                height, row_width,
+                                                &clamped));
 }
 
 /**************** parse_number *****************
@@ -280,7 +994,7 @@ void free_pgm_header(pgm_header_t header)
  * Write a P5 PGM header to output.
  *
  * Parameters:
- *      FILE *output:        stream opened for binary write
+ *      OutputSink *output:  sink receiving the header
  *      pgm_header_t header: header with width, height, maxval
  *
  * Expects:
@@ -290,10 +1004,12 @@ void free_pgm_header(pgm_header_t header)
  *      Writes ASCII header lines for P5 format to output.
  *
  ************************/
-void write_pgm_header(FILE *output, pgm_header_t header) 
+void write_pgm_header(OutputSink *output, pgm_header_t header) 
 {
-        fprintf(output, "P5\n%d %d\n%d\n", header->width, header->height, 
-                header->maxval);
+        char text[PGM_HEADER_MAX];
+        int len = snprintf(text, sizeof text, "P5\n%d %d\n%d\n", 
+                           header->width, header->height, header->maxval);
+        sink_write(output, text, len);
 }
 
 /*----------------Line processing--------------------*/
@@ -345,6 +1061,131 @@ void break_line_down(const char *line, int line_len, char **char_sequence,
         *digit_array = create_digit_array(digits, digit_count);
 }
 
+/**************** split_line *****************
+ *
+ * Split a line into its infusion and its digits in a single pass, keeping
+ * a short infusion in a caller's buffer instead of the heap and
+ * fingerprinting it on the way.
+ *
+ * Parameters:
+ *      const char *line:  input line buffer
+ *      size_t line_len:   number of bytes to consider from line (> 0)
+ *      char *key_buffer:  buffer of KEY_BUFFER_SIZE bytes
+ *      char **chars:      out; the infusion: key_buffer if it fits,
+ *                         otherwise a malloc'd copy
+ *      int *char_count:   out; bytes in the infusion
+ *      uint64_t *fp:      out; fingerprint of the infusion, equal to
+ *                         fingerprint_bytes(*chars, *char_count)
+ *      int **digits:      out; malloc'd integers of the line, or NULL to
+ *                         skip the integers
+ *      int *digit_count:  out; number of integers (0 if digits is NULL)
+ *
+ * Return:
+ *      1 on success, 0 if memory runs out (nothing is then allocated)
+ *
+ * Expects:
+ *      all pointers but digits not NULL.
+ *
+ * Effects:
+ *      Same results as extract_characters and extract_digits. The caller
+ *      owns *digits and must free *chars if it is not key_buffer. Raises
+ *      nothing, so parsing threads can call it.
+ ************************/
+int split_line(const char *line, size_t line_len, char *key_buffer, 
+               char **chars, int *char_count, uint64_t *fp, int **digits, 
+               int *digit_count)
+{
+        if (digits != NULL) {
+                *digits = malloc(line_len * sizeof(int));
+                if (*digits == NULL) {
+                        return 0;
+                }
+        }
+        char *key = key_buffer;
+        int key_limit = KEY_BUFFER_SIZE - 1;
+        uint32_t crc = FINGERPRINT_SEED;
+        *char_count = 0;
+        *digit_count = 0;
+        size_t i = 0;
+        while (i < line_len) {
+                if (isdigit(line[i])) {
+                        if (digits == NULL) {
+                                i++;
+                                continue;
+                        }
+                        /* Leaves i on the byte after the number */
+                        (*digits)[(*digit_count)++] = 
+                                parse_number(line, &i, line_len);
+                        continue;
+                }
+                if (*char_count == key_limit) {
+                        /* Long infusion: move it to the heap, where
+                         * line_len + 1 bytes always suffice */
+                        key = malloc(line_len + 1);
+                        if (key == NULL) {
+                                if (digits != NULL) {
+                                        free(*digits);
+                                }
+                                return 0;
+                        }
+                        memcpy(key, key_buffer, *char_count);
+                        key_limit = -1;
+                }
+                crc = fingerprint_step(crc, (unsigned char)line[i]);
+                key[(*char_count)++] = line[i++];
+        }
+        key[*char_count] = '\0';
+        *chars = key;
+        *fp = fingerprint_finish(crc, *char_count);
+        return 1;
+}
+
+/**************** parse_row_text *****************
+ *
+ * row_parser_fn for lazy line tables: parse the integers of a line kept
+ * as raw text.
+ *
+ * Parameters:
+ *      const char *text: line as stored by process_line or parse_line_at
+ *      int text_len:     bytes in text
+ *      int *len:         out; number of integers
+ *
+ * Return:
+ *      malloc'd integers of the line, or NULL if memory runs out
+ *
+ * Effects:
+ *      Same integers as split_line. Raises nothing, like split_line.
+ ************************/
+int *parse_row_text(const char *text, int text_len, int *len)
+{
+        int *digits = malloc(text_len * sizeof(int));
+        if (digits != NULL) {
+                extract_digits(text, text_len, digits, len);
+        }
+        return digits;
+}
+
+/**************** create_table *****************
+ *
+ * Create the line table a run asks for.
+ *
+ * Parameters:
+ *      restore_options_t options: run options (not NULL)
+ *      int lazy:                  nonzero to keep rows as raw text
+ *
+ * Return:
+ *      new LineTable allocating per options->alloc_mode, or NULL if
+ *      allocation fails
+ ************************/
+LineTable *create_table(restore_options_t options, int lazy)
+{
+        if (lazy) {
+                return create_line_table_lazy(options->alloc_mode,
+                                              parse_row_text);
+        }
+        return create_line_table_in(options->alloc_mode);
+}
+
 /* FILE I/O */
 
 /**************** open_file *****************
@@ -376,73 +1217,569 @@ FILE *open_file(const char *filename, const char *mode)
 
 /*--------------------Restoration--------------------*/
 
-/**************** process_image_file *****************
+/**************** process_image_file_status *****************
  *
  * Read all corrupted lines from input and populate the line table.
  *
  * Parameters:
  *      FILE *input:     stream positioned at start of corrupted raster
  *      LineTable *table: destination table for infusion groups
+ *      Speculation *speculation: told about every line (may be NULL)
+ *      int batch_size:  lines inserted into table at once (1 inserts
+ *                       each line as it is read)
+ *      line_offsets_t offsets: in/out; where each line starts is added
+ *                       here (may be NULL)
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_READ if readaline fails, or
+ *      RESTORE_ERR_MEMORY if memory runs out
  *
  * Expects:
  *      input and table not NULL; each input line ends with '\n'.
  *
  * Effects:
- *      For each line: reads with readaline, derives infusion and digits,
- *      inserts digits under its infusion key in table. Frees transient buffers.
- *
- * Checked Runtime Errors:
- *      Propagates CREs from readaline, allocation wrappers, or file errors.
+ *      For each line: reads with readaline_status, derives infusion and
+ *      digits, inserts digits under its infusion key in table. Frees
+ *      transient buffers, also when it fails; table then holds the lines
+ *      read so far.
  ************************/
-void process_image_file(FILE *input, LineTable *table)
+restore_status_t process_image_file_status(FILE *input, LineTable *table, 
+                                           Speculation *speculation, 
+                                           int batch_size,
+                                           line_offsets_t offsets)
 {
         char *line;
         size_t line_len;
+        struct line_batch batch;
+        restore_status_t status;
+        init_line_batch(&batch, table, speculation, batch_size);
         
         /* Process corrupted image line by line */
-        while ((line_len = readaline(input, &line)) > 0) {
-                line[line_len - 1] = '\0';
-                char *char_sequence;
-                digit_array_t digit_array;
-                
-                int char_sequence_len;
-                break_line_down(line, line_len, &char_sequence, 
-                                &char_sequence_len, &digit_array);
-                add_to_line_table(table, char_sequence, char_sequence_len, 
-                                    digit_array->digits, digit_array->length);
-                free(char_sequence);
-                free(digit_array);
+        while ((status = readaline_status(input, &line, &line_len)) == 
+               RESTORE_OK && line_len > 0) {
+                if (offsets != NULL &&
+                    record_line_offset(offsets, line_len) != RESTORE_OK) {
+                        free(line);
+                        status = RESTORE_ERR_MEMORY;
+                        break;
+                }
+                if (batch_size > 1) {
+                        status = batch_line(&batch, line, line_len);
+                } else {
+                        status = process_line_status(line, line_len, table,
+                                                     speculation);
+                }
                 free(line);
+                if (status != RESTORE_OK) {
+                        break;
+                }
+        }
+        if (status == RESTORE_OK) {
+                status = flush_line_batch(&batch);
         }
-}   
+        free_line_batch(&batch);
+        return status;
+}
 
-/********** check_if_stdin_or_open_file ********
+/**************** process_image_file *****************
+ *
+ * CRE wrapper for process_image_file_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE on read errors or if memory allocation fails.
+ ************************/
+void process_image_file(FILE *input, LineTable *table, 
+                        Speculation *speculation, int batch_size)
+{
+        check_status(process_image_file_status(input, table, speculation,
+                                               batch_size, NULL));
+}
+
+/**************** process_image_blocks_status *****************
  *
- * Initialize input stream to either stdin or a named file based on filename.
+ * Read all corrupted lines from a BlockReader and populate the line table.
  *
  * Parameters:
- *      FILE **input:           out; pointer to FILE* to be set
- *      const char *input_filename: path to file (NULL for stdin)
+ *      BlockReader *reader: reader positioned at start of corrupted raster
+ *      LineTable *table:    destination table for infusion groups
+ *      Speculation *speculation: told about every line (may be NULL)
+ *      int batch_size:      lines inserted into table at once
+ *      line_offsets_t offsets: in/out; where each line starts is added
+ *                           here (may be NULL)
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_READ if the reader fails, or
+ *      RESTORE_ERR_MEMORY if memory runs out
  *
  * Expects:
- *      input not NULL; input_filename may be NULL.
+ *      reader and table not NULL.
  *
  * Effects:
- *      Sets *input to stdin if input_filename is NULL, otherwise opens
- *      the named file for reading. Caller must close file if not stdin.
+ *      Same as process_image_file_status, but lines are parsed in place
+ *      in the reader's buffer instead of being copied out one byte at a
+ *      time.
+ ************************/
+restore_status_t process_image_blocks_status(BlockReader *reader, 
+                                             LineTable *table, 
+                                             Speculation *speculation, 
+                                             int batch_size,
+                                             line_offsets_t offsets)
+{
+        char *line;
+        size_t line_len;
+        struct line_batch batch;
+        restore_status_t status = RESTORE_OK;
+        init_line_batch(&batch, table, speculation, batch_size);
+
+        while (status == RESTORE_OK &&
+               (line_len = block_reader_next_line(reader, &line)) > 0) {
+                if (offsets != NULL) {
+                        status = record_line_offset(offsets, line_len);
+                        if (status != RESTORE_OK) {
+                                break;
+                        }
+                }
+                if (batch_size > 1) {
+                        status = batch_line(&batch, line, line_len);
+                } else {
+                        status = process_line_status(line, line_len, table,
+                                                     speculation);
+                }
+        }
+        if (status == RESTORE_OK) {
+                status = flush_line_batch(&batch);
+        }
+        free_line_batch(&batch);
+        if (status == RESTORE_OK && block_reader_failed(reader)) {
+                status = RESTORE_ERR_READ;
+        }
+        return status;
+}
+
+/**************** process_image_blocks *****************
+ *
+ * CRE wrapper for process_image_blocks_status.
  *
  * Checked Runtime Errors:
- *      Raises a CRE if input is NULL or if file opening fails.
+ *      Raises a CRE if the reader hits a read or allocation error.
  ************************/
-void check_if_stdin_or_open_file(FILE **input, const char *input_filename) 
+void process_image_blocks(BlockReader *reader, LineTable *table, 
+                          Speculation *speculation, int batch_size)
 {
-        /* Read from standard input */
-        if (input_filename == NULL) {
-                *input = stdin;
+        check_status(process_image_blocks_status(reader, table, speculation,
+                                                 batch_size, NULL));
+}
+
+/**************** record_line_offset *****************
+ *
+ * Note where the next line of an input starts.
+ *
+ * Parameters:
+ *      line_offsets_t offsets: in/out; offsets of the lines read so far
+ *      size_t line_len:        bytes in the line, including its '\n'
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_MEMORY if offsets cannot grow
+ *
+ * Effects:
+ *      Appends offsets->end to offsets->starts and moves end past the
+ *      line, so a line's length is where the next one starts (or end)
+ *      less its own start.
+ ************************/
+restore_status_t record_line_offset(line_offsets_t offsets, 
+                                    size_t line_len)
+{
+        if (offsets->count == offsets->size) {
+                long size = offsets->size > 0 ? 2 * offsets->size : 1024;
+                long long *starts = realloc(offsets->starts, 
+                                            size * sizeof *starts);
+                if (starts == NULL) {
+                        return RESTORE_ERR_MEMORY;
+                }
+                offsets->starts = starts;
+                offsets->size = size;
+        }
+        offsets->starts[offsets->count++] = offsets->end;
+        offsets->end += line_len;
+        return RESTORE_OK;
+}
+
+/**************** process_line_status *****************
+ *
+ * Split one corrupted line and add it to the line table.
+ *
+ * Parameters:
+ *      char *line:       line as returned by readaline (modified in place)
+ *      size_t line_len:  bytes in line, including its final '\n'
+ *      LineTable *table: destination table for infusion groups
+ *      Speculation *speculation: told about the line (may be NULL)
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_MEMORY if memory allocation fails or
+ *      the line table runs out of memory
+ *
+ * Expects:
+ *      line and table not NULL; line_len > 0.
+ *
+ * Effects:
+ *      Replaces the final byte of line with '\0', derives infusion and
+ *      digits with split_line, inserts digits under its infusion key in
+ *      table. Frees transient buffers; table takes ownership of the
+ *      digits. A lazy table gets a copy of the line instead, and the
+ *      digits are not parsed.
+ ************************/
+restore_status_t process_line_status(char *line, size_t line_len, 
+                                     LineTable *table, 
+                                     Speculation *speculation)
+{
+        line[line_len - 1] = '\0';
+        char key_buffer[KEY_BUFFER_SIZE];
+        struct line_table_entry entry;
+        int digit_count;
+        int lazy = line_table_is_lazy(table);
+
+        entry.digits = NULL;
+        if (!split_line(line, line_len, key_buffer, &entry.key,
+                        &entry.key_len, &entry.key_fp,
+                        lazy ? NULL : &entry.digits, &digit_count)) {
+                return RESTORE_ERR_MEMORY;
+        }
+        entry.text = line;
+        entry.len = lazy ? (int)line_len : digit_count;
+
+        /* A batch of one, so the fingerprint goes in with the key */
+        int stored = add_batch_to_line_table(table, &entry, 1);
+        if (stored && speculation != NULL) {
+                speculation_observe(speculation, entry.key, entry.key_len,
+                                    entry.digits, digit_count);
+        }
+        if (entry.key != key_buffer) {
+                free(entry.key);
+        }
+        if (!stored) {
+                free(entry.digits);
+                return RESTORE_ERR_MEMORY;
+        }
+        return RESTORE_OK;
+}
+
+/**************** process_line *****************
+ *
+ * CRE wrapper for process_line_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if memory allocation fails or the line table runs
+ *      out of memory.
+ ************************/
+void process_line(char *line, size_t line_len, LineTable *table, 
+                  Speculation *speculation)
+{
+        check_status(process_line_status(line, line_len, table, 
+                                         speculation));
+}
+
+/**************** init_line_batch *****************
+ *
+ * Start an empty batch of lines for add_batch_to_line_table.
+ *
+ * Parameters:
+ *      line_batch_t batch:       batch to set up (not NULL)
+ *      LineTable *table:         destination table for infusion groups
+ *      Speculation *speculation: told about every line (may be NULL;
+ *                                then table may be lazy)
+ *      int size:                 lines inserted at once (clamped to
+ *                                [1, LINE_TABLE_BATCH_MAX])
+ *
+ * Effects:
+ *      Allocates nothing until lines of a lazy table arrive. Caller must
+ *      free the batch with free_line_batch.
+ ************************/
+void init_line_batch(line_batch_t batch, LineTable *table, 
+                     Speculation *speculation, int size)
+{
+        batch->table = table;
+        batch->speculation = speculation;
+        batch->size = size < 1 ? 1 : size > LINE_TABLE_BATCH_MAX ?
+                      LINE_TABLE_BATCH_MAX : size;
+        batch->count = 0;
+        batch->text = NULL;
+        batch->text_used = 0;
+        batch->text_size = 0;
+}
+
+/**************** batch_line *****************
+ *
+ * Split one corrupted line and queue it for insertion, inserting the
+ * batch once it is full.
+ *
+ * Parameters:
+ *      line_batch_t batch: batch from init_line_batch
+ *      char *line:         line as returned by readaline (modified in
+ *                          place)
+ *      size_t line_len:    bytes in line, including its final '\n'
+ *
+ * Expects:
+ *      batch and line not NULL; line_len > 0.
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_MEMORY if memory allocation fails or
+ *      the line table runs out of memory; the batch is then emptied
+ *
+ * Effects:
+ *      Same as process_line, once the batch is inserted. The batch keeps
+ *      its own copy of a lazy table's lines, so line may be reused as
+ *      soon as this returns.
+ ************************/
+restore_status_t batch_line(line_batch_t batch, char *line, size_t line_len)
+{
+        line[line_len - 1] = '\0';
+        int i = batch->count;
+        struct line_table_entry *entry = &batch->entries[i];
+        int lazy = line_table_is_lazy(batch->table);
+        int digit_count;
+
+        entry->digits = NULL;
+        if (!split_line(line, line_len, batch->keys[i], &entry->key,
+                        &entry->key_len, &entry->key_fp,
+                        lazy ? NULL : &entry->digits, &digit_count)) {
+                free_line_batch(batch);
+                return RESTORE_ERR_MEMORY;
+        }
+        entry->len = digit_count;
+        batch->count++;
+        if (lazy) {
+                if (batch->text_used + line_len > batch->text_size) {
+                        size_t size = 2 * (batch->text_used + line_len);
+                        char *text = realloc(batch->text, size);
+                        if (text == NULL) {
+                                free_line_batch(batch);
+                                return RESTORE_ERR_MEMORY;
+                        }
+                        batch->text = text;
+                        batch->text_size = size;
+                }
+                memcpy(batch->text + batch->text_used, line, line_len);
+                batch->text_at[i] = batch->text_used;
+                batch->text_used += line_len;
+                entry->len = line_len;
+        }
+        if (batch->count == batch->size) {
+                return flush_line_batch(batch);
+        }
+        return RESTORE_OK;
+}
+
+/**************** flush_line_batch *****************
+ *
+ * Insert every queued line into the line table, in order.
+ *
+ * Parameters:
+ *      line_batch_t batch: batch from init_line_batch
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_MEMORY if the line table runs out of
+ *      memory
+ *
+ * Effects:
+ *      Tells the batch's speculation about every stored line and empties
+ *      the batch; the table takes ownership of the digits.
+ ************************/
+restore_status_t flush_line_batch(line_batch_t batch)
+{
+        for (int i = 0; i < batch->count; i++) {
+                /* The text may have moved while the batch filled */
+                if (batch->entries[i].digits == NULL) {
+                        batch->entries[i].text = batch->text + 
+                                                 batch->text_at[i];
+                }
+        }
+        int stored = add_batch_to_line_table(batch->table, batch->entries,
+                                             batch->count);
+        for (int i = 0; i < stored && batch->speculation != NULL; i++) {
+                struct line_table_entry *entry = &batch->entries[i];
+                speculation_observe(batch->speculation, entry->key,
+                                    entry->key_len, entry->digits,
+                                    entry->len);
+        }
+        for (int i = 0; i < batch->count; i++) {
+                struct line_table_entry *entry = &batch->entries[i];
+                if (entry->key != batch->keys[i]) {
+                        free(entry->key);
+                }
+                if (i >= stored) {
+                        free(entry->digits);
+                }
+        }
+        int failed = stored < batch->count;
+        batch->count = 0;
+        batch->text_used = 0;
+        if (failed) {
+                free_line_batch(batch);
+                return RESTORE_ERR_MEMORY;
+        }
+        return RESTORE_OK;
+}
+
+/**************** free_line_batch *****************
+ *
+ * Drop the lines still queued in a batch and free its buffers.
+ *
+ * Parameters:
+ *      line_batch_t batch: batch from init_line_batch
+ *
+ * Effects:
+ *      Lines not yet inserted are lost. The batch stays usable.
+ ************************/
+void free_line_batch(line_batch_t batch)
+{
+        for (int i = 0; i < batch->count; i++) {
+                struct line_table_entry *entry = &batch->entries[i];
+                if (entry->key != batch->keys[i]) {
+                        free(entry->key);
+                }
+                free(entry->digits);
+        }
+        free(batch->text);
+        batch->count = 0;
+        batch->text = NULL;
+        batch->text_used = 0;
+        batch->text_size = 0;
+}
+
+/**************** parse_line_at *****************
+ *
+ * ParsePool callback: split one corrupted line and add it to the line
+ * table under its input position.
+ *
+ * Parameters:
+ *      char *line:       copy of the line (modified in place)
+ *      size_t line_len:  bytes in line, including its final '\n'
+ *      long line_index:  position of the line in the input
+ *      void *cl:         destination LineTable
+ *
+ * Return:
+ *      1 on success, 0 if memory runs out
+ *
+ * Expects:
+ *      line and cl not NULL; line_len > 0.
+ *
+ * Effects:
+ *      Same as process_line without speculation. Safe to run on several
+ *      threads at once; raises nothing, since the CII exception stack is
+ *      shared by all threads.
+ ************************/
+int parse_line_at(char *line, size_t line_len, long line_index, void *cl)
+{
+        LineTable *table = cl;
+        line[line_len - 1] = '\0';
+        char key_buffer[KEY_BUFFER_SIZE];
+        char *chars;
+        int char_count;
+        uint64_t fp;
+        int *digits = NULL;
+        int digit_count;
+        int lazy = line_table_is_lazy(table);
+
+        if (!split_line(line, line_len, key_buffer, &chars, &char_count,
+                        &fp, lazy ? NULL : &digits, &digit_count)) {
+                return 0;
+        }
+        int stored;
+        if (lazy) {
+                stored = add_text_to_line_table_at(table, chars, char_count,
+                                                   fp, line, line_len,
+                                                   line_index);
         } else {
-                /* Read from named file */
-                *input = open_file(input_filename, "rb");
+                stored = add_to_line_table_at(table, chars, char_count, fp,
+                                              digits, digit_count,
+                                              line_index);
+        }
+        if (chars != key_buffer) {
+                free(chars);
+        }
+        if (!stored) {
+                free(digits);
+        }
+        return stored;
+}
+
+/**************** process_image_parallel_status *****************
+ *
+ * Read all corrupted lines and populate the line table on several
+ * parsing threads.
+ *
+ * Parameters:
+ *      FILE *input:         stream positioned at start of corrupted
+ *                           raster, read with readaline if reader is NULL
+ *      BlockReader *reader: reader to take lines from instead (may be NULL)
+ *      LineTable *table:    destination table for infusion groups
+ *      restore_options_t options: run options; options->threads parsing
+ *                           threads (> 0) allocating per
+ *                           options->alloc_mode
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_READ on read errors, or RESTORE_ERR_MEMORY
+ *      if the threads cannot be started or memory allocation fails
+ *
+ * Expects:
+ *      table not NULL; input not NULL if reader is NULL.
+ *
+ * Effects:
+ *      This thread only reads and numbers lines; a ParsePool splits them
+ *      and inserts them into table concurrently. Every row keeps its
+ *      line's position, so the table picks the same target and row order
+ *      as process_image_file. The pool is always closed before this
+ *      returns.
+ ************************/
+restore_status_t process_image_parallel_status(FILE *input, 
+                                               BlockReader *reader, 
+                                               LineTable *table, 
+                                               restore_options_t options)
+{
+        ParsePool *pool = create_parse_pool(options->threads, 
+                                            options->alloc_mode, 
+                                            parse_line_at, table);
+        if (pool == NULL) {
+                return RESTORE_ERR_MEMORY;
+        }
+
+        char *line;
+        size_t line_len;
+        restore_status_t status = RESTORE_OK;
+        if (reader != NULL) {
+                while ((line_len = block_reader_next_line(reader, &line)) > 0) {
+                        parse_pool_add_line(pool, line, line_len);
+                }
+                if (block_reader_failed(reader)) {
+                        status = RESTORE_ERR_READ;
+                }
+        } else {
+                while ((status = readaline_status(input, &line, 
+                                                  &line_len)) == RESTORE_OK &&
+                       line_len > 0) {
+                        parse_pool_add_line(pool, line, line_len);
+                        free(line);
+                }
         }
+        if (!close_parse_pool(pool) && status == RESTORE_OK) {
+                status = RESTORE_ERR_MEMORY;
+        }
+        return status;
+}
+
+/**************** process_image_parallel *****************
+ *
+ * CRE wrapper for process_image_parallel_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the threads cannot be started, on read errors, or
+ *      if memory allocation fails.
+ ************************/
+void process_image_parallel(FILE *input, BlockReader *reader, 
+                            LineTable *table, restore_options_t options)
+{
+        check_status(process_image_parallel_status(input, reader, table,
+                                                   options));
 }
 
 /********** close_if_not_stdin ********
@@ -469,53 +1806,1925 @@ void close_if_not_stdin(FILE **input)
         }
 }
 
-/**************** restore_image *****************
+/********** open_input_status ********
  *
- * Orchestrate full restoration: read corrupted input, derive original rows,
- * and write a valid P5 PGM to output.
+ * Initialize input stream to either stdin or a named file based on filename,
+ * decompressing it on the fly if it starts with a gzip or zstd magic number.
  *
  * Parameters:
- *      const char *input_filename:   path to corrupted PGM (plain-like)
+ *      const char *input_filename: path to file (NULL for stdin)
+ *      FILE **input:               out; the stream to read
+ *      Decompressor **decompressor: out; decompression thread behind
+ *                                  *input, or NULL for a plain input
+ *      unsigned char *prefix:      out; COMPRESSION_MAGIC_MAX bytes, or
+ *                                  NULL
+ *      size_t *prefix_len:         out; bytes the caller must read
+ *                                  before *input (unused if prefix is
+ *                                  NULL)
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_OPEN if the file cannot be opened, or
+ *      RESTORE_ERR_READ if the input is compressed in a format this build
+ *      cannot decode or the decompression thread cannot be started
  *
  * Expects:
- *      input_filename if necessary.
+ *      input and decompressor not NULL; input_filename may be NULL.
+ *
+ * Effects:
+ *      Sets *input to stdin if input_filename is NULL, otherwise opens
+ *      the named file for reading. Sniffs the first bytes: compressed
+ *      inputs are read through a Decompressor and *input is its stream.
+ *      So are plain inputs that cannot be rewound after sniffing (pipes),
+ *      unless prefix is given: their sniffed bytes are then left in
+ *      prefix for the caller to replay, which spares a BlockReader the
+ *      copy through a second pipe. Nothing has been read from *input
+ *      through stdio yet, so its descriptor may be read directly. On
+ *      success the caller must close with close_input_status; on failure
+ *      nothing is left open.
+ ************************/
+restore_status_t open_input_status(const char *input_filename, FILE **input,
+                                   Decompressor **decompressor,
+                                   unsigned char *prefix, size_t *prefix_len)
+{
+        *decompressor = NULL;
+        if (prefix != NULL) {
+                *prefix_len = 0;
+        }
+        /* Read from standard input */
+        if (input_filename == NULL) {
+                *input = stdin;
+        } else {
+                /* Read from named file */
+                *input = fopen(input_filename, "rb");
+                if (*input == NULL) {
+                        return RESTORE_ERR_OPEN;
+                }
+        }
+
+        unsigned char sniffed[COMPRESSION_MAGIC_MAX];
+        size_t sniffed_len;
+        compression_t kind = peek_compression(fileno(*input), sniffed,
+                                              &sniffed_len);
+        if (kind == COMPRESSION_NONE && 
+            (sniffed_len == 0 || prefix != NULL)) {
+                if (prefix != NULL) {
+                        memcpy(prefix, sniffed, sniffed_len);
+                        *prefix_len = sniffed_len;
+                }
+                return RESTORE_OK;
+        }
+        *decompressor = start_decompressor(*input, *input != stdin, kind,
+                                           sniffed, sniffed_len);
+        if (*decompressor == NULL) {
+                close_if_not_stdin(input);
+                return RESTORE_ERR_READ;
+        }
+        *input = decompressor_stream(*decompressor);
+        return RESTORE_OK;
+}
+
+/********** check_if_stdin_or_open_file ********
+ *
+ * CRE wrapper for open_input_status.
+ *
+ * Parameters:
+ *      FILE **input:               out; pointer to FILE* to be set
+ *      const char *input_filename: path to file (NULL for stdin)
+ *      Decompressor **decompressor: out; decompression thread behind
+ *                                  *input, or NULL for a plain input
  *
  * Effects:
- *      Opens/closes input and output; builds line table; selects target
- *      infusion (first duplicate per spec); writes P5 header and raster.
- *      Frees all owned resources before return.
+ *      Caller must close with close_input.
  *
  * Checked Runtime Errors:
- *      Raises a CRE if files cannot be opened, if read errors occur,
- *      or if memory allocation fails.
+ *      Raises a CRE if file opening fails, if the input is compressed in
+ *      a format this build cannot decode, or if the decompression thread
+ *      cannot be started.
  ************************/
-void restore_image(const char *input_filename)
+void check_if_stdin_or_open_file(FILE **input, const char *input_filename,
+                                 Decompressor **decompressor)
 {
-        FILE *input;
-        check_if_stdin_or_open_file(&input, input_filename);
-        
-        /* Process lines and build hash */
-        LineTable *table = create_line_table();
-        process_image_file(input, table);
-        close_if_not_stdin(&input);
+        check_status(open_input_status(input_filename, input, 
+                                       decompressor, NULL, NULL));
+}
 
-        /* Get reconstructed digits */
-        int row_width;
-        Seq_T digit_sequences = get_reconstructed_digits(table, &row_width);
+/********** close_input_status ********
+ *
+ * Close an input opened by open_input_status.
+ *
+ * Parameters:
+ *      FILE **input:               in/out; input stream to close
+ *      Decompressor *decompressor: decompressor behind *input, or NULL
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_READ if a compressed input was
+ *      truncated or corrupt
+ *
+ * Expects:
+ *      input not NULL.
+ *
+ * Effects:
+ *      Finishes the decompressor (closing its stream and the raw input),
+ *      or closes *input if it is a plain file other than stdin. Safe to
+ *      call before the input was read to its end.
+ ************************/
+restore_status_t close_input_status(FILE **input, Decompressor *decompressor)
+{
+        if (decompressor == NULL) {
+                close_if_not_stdin(input);
+        } else if (!finish_decompressor(decompressor)) {
+                return RESTORE_ERR_READ;
+        }
+        return RESTORE_OK;
+}
 
-        if (digit_sequences != NULL) {
-                /* Calculate dimensions */
-                int total_rows = Seq_length(digit_sequences);
+/********** close_input ********
+ *
+ * CRE wrapper for close_input_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if a compressed input was truncated or corrupt.
+ ************************/
+void close_input(FILE **input, Decompressor *decompressor)
+{
+        check_status(close_input_status(input, decompressor));
+}
 
-                /* Create and write PGM header to stdout */
-                pgm_header_t header = create_pgm_header(row_width, total_rows);
-                write_pgm_header(stdout, header);
-                free_pgm_header(header);
+/**************** read_line_table *****************
+ *
+ * Fill a line table from an open input as options ask.
+ *
+ * Parameters:
+ *      FILE *input:               stream from open_input_status
+ *      const unsigned char *prefix: bytes to read before input (may be
+ *                                 NULL if prefix_len is 0)
+ *      size_t prefix_len:         bytes in prefix; nonzero only for
+ *                                 block read modes
+ *      LineTable *table:          destination table for infusion groups
+ *      restore_options_t options: run options (not NULL)
+ *      Speculation *speculation:  told about every line (may be NULL)
+ *      line_offsets_t offsets:    in/out; where each line starts is
+ *                                 added here (may be NULL)
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_READ on read errors, or RESTORE_ERR_MEMORY
+ *
+ * Effects:
+ *      Reads with readaline or a BlockReader as options->read_mode asks,
+ *      parsing on options->threads threads if more than one. Lines
+ *      parsed on several threads arrive out of order, so offsets are
+ *      only recorded when they are parsed on this one.
+ ************************/
+restore_status_t read_line_table(FILE *input, 
+                                 const unsigned char *prefix, 
+                                 size_t prefix_len, LineTable *table, 
+                                 restore_options_t options, 
+                                 Speculation *speculation,
+                                 line_offsets_t offsets)
+{
+        int parallel = options->threads > 1;
+        int insert_batch = options->insert_batch > 0 ? 
+                           options->insert_batch : INSERT_BATCH;
+        if (options->read_mode == READ_STDIO) {
+                if (parallel) {
+                        return process_image_parallel_status(input, NULL, 
+                                                             table, options);
+                }
+                return process_image_file_status(input, table, speculation,
+                                                 insert_batch, offsets);
+        }
 
-                /* Write digit arrays from reconstructed sequence to stdout */
-                write_digit_arrays_from_sequence(stdout, digit_sequences, 
-                                                row_width);
+        /* Nothing has been read through input yet, so its descriptor is
+         * still at the start of the data */
+        BlockReader *reader = create_block_reader(fileno(input), 
+                                                  options->read_mode,
+                                                  BLOCK_READER_SIZE,
+                                                  options->queue_depth);
+        if (reader == NULL || (prefix_len > 0 &&
+            !block_reader_prime(reader, prefix, prefix_len))) {
+                free_block_reader(reader);
+                return RESTORE_ERR_MEMORY;
         }
-        /* Cleanup */
-        free_line_table(table);
-}
\ No newline at end of file
+        restore_status_t status;
+        if (parallel) {
+                status = process_image_parallel_status(NULL, reader, table,
+                                                       options);
+        } else {
+                status = process_image_blocks_status(reader, table, 
+                                                     speculation, 
+                                                     insert_batch, 
+                                                     offsets);
+        }
+        free_block_reader(reader);
+        return status;
+}
+
+/**************** write_restored_image_status *****************
+ *
+ * Restore one corrupted input and write the P5 result to output.
+ *
+ * Parameters:
+ *      const char *input_filename: path to corrupted PGM (NULL for stdin)
+ *      restore_options_t options:  run options (not NULL)
+ *      restore_stats_t stats:      in/out; infusion length counts are
+ *                                  added here (may be NULL)
+ *      OutputSink *output:         sink receiving the P5 image
+ *
+ * Return:
+ *      RESTORE_OK, or the first failure: RESTORE_ERR_OPEN,
+ *      RESTORE_ERR_READ, RESTORE_ERR_MEMORY or RESTORE_ERR_WRITE
+ *
+ * Expects:
+ *      options and output not NULL.
+ *
+ * Effects:
+ *      Opens/closes input, decompressing gzip/zstd inputs on a separate
+ *      thread; builds line table with read_line_table; selects target
+ *      infusion (first duplicate per spec); writes P5 header and raster
+ *      to output. With options->speculate_lines, may stream a guessed
+ *      target's rows while reading (see speculation.h) and keep them if
+ *      the guess is confirmed. Writes nothing if no infusion repeats.
+ *      A row range is read through the input's row index when it is
+ *      current, and options->write_index leaves one behind (see
+ *      write_indexed_rows_status and save_row_index).
+ *      Frees all owned resources, also when it fails; output may then
+ *      hold part of an image.
+ ************************/
+restore_status_t write_restored_image_status(const char *input_filename, 
+                                             restore_options_t options, 
+                                             restore_stats_t stats,
+                                             OutputSink *output)
+{
+        /* A current index serves a row range without reading the rest */
+        long clamped = 0;
+        if (options->rows_last > 0 && input_filename != NULL) {
+                int served;
+                restore_status_t status;
+                status = write_indexed_rows_status(input_filename, options,
+                                                   output, &clamped, 
+                                                   &served);
+                if (status == RESTORE_OK && served && stats != NULL) {
+                        stats->pixels_clamped += clamped;
+                }
+                if (status != RESTORE_OK || served) {
+                        return status;
+                }
+        }
+
+        FILE *input;
+        Decompressor *decompressor;
+        /* A BlockReader replays a pipe's sniffed bytes itself */
+        unsigned char prefix[COMPRESSION_MAGIC_MAX];
+        size_t prefix_len = 0;
+        int blocks = options->read_mode != READ_STDIO;
+        restore_status_t status = open_input_status(input_filename, &input,
+                                                    &decompressor, 
+                                                    blocks ? prefix : NULL,
+                                                    &prefix_len);
+        if (status != RESTORE_OK) {
+                return status;
+        }
+        
+        /* Speculative output needs a sink it can rewrite in place */
+        Speculation *speculation = NULL;
+        if (options->speculate_lines > 0 && options->format == FORMAT_PGM &&
+            options->threads <= 1 && options->thumbnail_width == 0 &&
+            options->rows_last == 0) {
+                speculation = create_speculation(output, 
+                                                 options->speculate_lines);
+        }
+
+        /* Offsets into a decompressed stream would not lead back into
+         * the file */
+        struct line_offsets offsets = { NULL, 0, 0, 0 };
+        int index = options->write_index && input_filename != NULL &&
+                    decompressor == NULL && options->threads <= 1;
+
+        /* Process lines and build hash; speculation needs every line's
+         * digits as it goes */
+        LineTable *table = create_table(options, options->lazy_digits &&
+                                                 speculation == NULL);
+        if (table == NULL) {
+                status = RESTORE_ERR_MEMORY;
+        } else {
+                status = read_line_table(input, prefix, prefix_len, table,
+                                         options, speculation,
+                                         index ? &offsets : NULL);
+        }
+        restore_status_t closed = close_input_status(&input, decompressor);
+        if (status == RESTORE_OK) {
+                status = closed;
+        }
+        if (status == RESTORE_OK && stats != NULL) {
+                status = record_infusion_lengths_status(stats, table);
+        }
+
+        /* A confirmed guess has already written the whole image; a failed
+         * run drops the guess */
+        int speculated = close_speculation(speculation, 
+                                           status == RESTORE_OK ? table :
+                                           NULL, &clamped);
+        if (speculated < 0 && status == RESTORE_OK) {
+                status = RESTORE_ERR_WRITE;
+        }
+        if (status == RESTORE_OK && speculated == 0) {
+                status = write_line_table_status(table, options, output,
+                                                 &clamped);
+        }
+        if (status == RESTORE_OK && stats != NULL) {
+                stats->pixels_clamped += clamped;
+        }
+        if (status == RESTORE_OK && index) {
+                save_row_index(input_filename, table, &offsets);
+        }
+
+        /* Cleanup */
+        free(offsets.starts);
+        free_line_table(table);
+        return status;
+}
+
+/**************** write_restored_image *****************
+ *
+ * CRE wrapper for write_restored_image_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if files cannot be opened, if read errors occur,
+ *      or if memory allocation fails.
+ ************************/
+void write_restored_image(const char *input_filename, 
+                          restore_options_t options, restore_stats_t stats,
+                          OutputSink *output)
+{
+        check_status(write_restored_image_status(input_filename, options,
+                                                 stats, output));
+}
+
+/**************** write_line_table_status *****************
+ *
+ * Write the image a filled line table restores.
+ *
+ * Parameters:
+ *      LineTable *table:          table holding every line of one input
+ *      restore_options_t options: run options (not NULL); only
+ *                                 options->format, options->threads,
+ *                                 options->positional_min_bytes, the
+ *                                 thumbnail size and the row range are
+ *                                 used
+ *      OutputSink *output:        sink receiving the image
+ *      long *clamped:             out; pixels outside [0, MAXVAL]
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_MEMORY if memory allocation fails, or
+ *      RESTORE_ERR_WRITE if encoding or a positional write fails
+ *
+ * Expects:
+ *      table, options and output not NULL.
+ *
+ * Effects:
+ *      Selects the target infusion and writes the P5 header and raster
+ *      (or the encoded image) to output; see
+ *      write_digit_arrays_positional_status for raster writes with
+ *      options->threads > 1, and write_thumbnail_status when a thumbnail
+ *      is asked for. Writes nothing if no infusion repeats. table keeps
+ *      ownership of the rows.
+ ************************/
+restore_status_t write_line_table_status(LineTable *table, 
+                                         restore_options_t options, 
+                                         OutputSink *output, long *clamped)
+{
+        *clamped = 0;
+        if (options->thumbnail_width > 0) {
+                return write_thumbnail_status(table, options, output,
+                                              clamped);
+        }
+        /* Get reconstructed digits */
+        int row_width, total_rows;
+        int **rows = get_reconstructed_digits(table, &row_width, 
+                                              &total_rows);
+        if (rows == NULL) {
+                /* A lazy table's rows could not be parsed */
+                return row_width < 0 ? RESTORE_ERR_MEMORY : RESTORE_OK;
+        }
+
+        /* Keep only the rows asked for; the table still owns them */
+        if (options->rows_last > 0) {
+                rows = slice_rows(rows, &total_rows, options->rows_first,
+                                  options->rows_last);
+        }
+
+        restore_status_t status;
+        if (options->format != FORMAT_PGM) {
+                status = write_encoded_image_status(output, options->format,
+                                                    rows, total_rows,
+                                                    row_width, clamped);
+        } else {
+                /* Write PGM header to output */
+                struct pgm_header header = { row_width, total_rows, 
+                                             MAXVAL };
+                write_pgm_header(output, &header);
+
+                /* Write digit arrays from reconstructed sequence to
+                 * output, on several threads for a tall image */
+                status = write_digit_arrays_positional_status(
+                                output, rows, total_rows, row_width,
+                                options->threads, 
+                                options->positional_min_bytes, clamped);
+        }
+        return status;
+}
+
+/**************** slice_rows *****************
+ *
+ * Take a range of an image's rows.
+ *
+ * Parameters:
+ *      int **rows:  rows of the image
+ *      int *height: in/out; number of rows, set to the number taken
+ *      long first:  first row wanted
+ *      long last:   one past the last row wanted (> first)
+ *
+ * Return:
+ *      Rows first to last - 1 of rows, cut short at the end of rows;
+ *      empty if first is past it. The slice is part of rows, so nothing
+ *      is allocated or freed.
+ ************************/
+int **slice_rows(int **rows, int *height, long first, long last)
+{
+        if (last > *height) {
+                last = *height;
+        }
+        if (first > last) {
+                first = last;
+        }
+        *height = last - first;
+        return rows + first;
+}
+
+/**************** write_line_table *****************
+ *
+ * CRE wrapper for write_line_table_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if memory allocation or encoding fails.
+ ************************/
+void write_line_table(LineTable *table, restore_options_t options, 
+                      OutputSink *output)
+{
+        long clamped;
+        check_status(write_line_table_status(table, options, output, 
+                                             &clamped));
+}
+
+/*------------------------Thumbnails-------------------------*/
+
+/**************** count_numbers *****************
+ *
+ * Count the integers on a line without parsing them.
+ *
+ * Parameters:
+ *      const char *line: input line buffer
+ *      size_t line_len:  number of bytes to consider from line
+ *
+ * Return:
+ *      Number of digit runs, which extract_digits would turn into as
+ *      many integers
+ ************************/
+int count_numbers(const char *line, size_t line_len)
+{
+        int count = 0;
+        int in_number = 0;
+        for (size_t i = 0; i < line_len; i++) {
+                int digit = isdigit(line[i]) != 0;
+                count += digit && !in_number;
+                in_number = digit;
+        }
+        return count;
+}
+
+/**************** extract_leading_digits *****************
+ *
+ * Parse the integers at the start of a line, stopping after max.
+ *
+ * Parameters:
+ *      const char *line: input line buffer
+ *      size_t line_len:  number of bytes to consider from line
+ *      int *digits:      out; room for max integers
+ *      int max:          most integers wanted
+ *
+ * Return:
+ *      Number of integers written: max, or fewer if the line ends first
+ *
+ * Effects:
+ *      Same integers as the first ones extract_digits finds; the rest
+ *      of the line is not read.
+ ************************/
+int extract_leading_digits(const char *line, size_t line_len, int *digits,
+                           int max)
+{
+        int count = 0;
+        for (size_t i = 0; i < line_len && count < max; i++) {
+                if (isdigit(line[i])) {
+                        digits[count++] = parse_number(line, &i, line_len);
+                }
+        }
+        return count;
+}
+
+/**************** measure_row *****************
+ *
+ * target_row_fn: find the width of the target from its latest row.
+ *
+ * Parameters:
+ *      long row:          position of the row (unused)
+ *      const int *digits: the row's integers, or NULL if it is text
+ *      const char *text:  the row's text when digits is NULL
+ *      int len:           integers in digits, else bytes of text
+ *      void *cl:          int *; out, the row's number of integers
+ *
+ * Return: 1
+ ************************/
+int measure_row(long row, const int *digits, const char *text, int len,
+                void *cl)
+{
+        (void)row;
+        *(int *)cl = digits != NULL ? len : count_numbers(text, len);
+        return 1;
+}
+
+/**************** box_edge *****************
+ *
+ * Find where a thumbnail box starts along one dimension.
+ *
+ * Parameters:
+ *      long i:    box index, from 0 to n (n gives the far edge)
+ *      long full: target pixels along the dimension
+ *      long n:    thumbnail pixels along it (0 < n <= full)
+ *
+ * Return: first target pixel of box i, i * full / n rounded down
+ *
+ * Notes:
+ *      Consecutive edges split full into n boxes of full / n or one more
+ *      pixels, so every target pixel falls in exactly one box.
+ ************************/
+long box_edge(long i, long full, long n)
+{
+        return (long)((long long)i * full / n);
+}
+
+/**************** add_to_thumbnail *****************
+ *
+ * target_row_fn: add one row of the target to its thumbnail's boxes.
+ *
+ * Parameters:
+ *      long row:          position of the row among the target's rows
+ *      const int *digits: the row's integers, or NULL if it is text
+ *      const char *text:  the row's text when digits is NULL
+ *      int len:           integers in digits, else bytes of text
+ *      void *cl:          the thumbnail_t being filled
+ *
+ * Return:
+ *      1, or 0 if memory runs out (thumb->status then says so)
+ *
+ * Effects:
+ *      Adds the row's pixels to the sums of its row of boxes, parsing no
+ *      further than the target width into a text row; a short row adds
+ *      nothing for the pixels it lacks. Pixels above MAXVAL are clamped,
+ *      and counted, first, as the full raster would have them. The last
+ *      row of a box finishes a thumbnail row, rounding each box to the
+ *      mean over its own area (see box_edge).
+ ************************/
+int add_to_thumbnail(long row, const int *digits, const char *text, int len,
+                     void *cl)
+{
+        thumbnail_t thumb = cl;
+        if (digits == NULL) {
+                len = extract_leading_digits(text, len, thumb->pixels,
+                                             thumb->target_width);
+                digits = thumb->pixels;
+        }
+        for (int x = 0; x < thumb->width; x++) {
+                int from = box_edge(x, thumb->target_width, thumb->width);
+                int to = box_edge(x + 1, thumb->target_width, thumb->width);
+                for (int i = from; i < to && i < len; i++) {
+                        if (digits[i] > MAXVAL) {
+                                thumb->clamped++;
+                        }
+                        thumb->sums[x] += digits[i] > MAXVAL ? MAXVAL :
+                                          digits[i];
+                }
+        }
+        int y = thumb->finished;
+        long top = box_edge(y, thumb->target_height, thumb->height);
+        long bottom = box_edge(y + 1, thumb->target_height, thumb->height);
+        if (row != bottom - 1) {
+                return 1;
+        }
+
+        unsigned char *pixels = malloc(thumb->width > 0 ? thumb->width : 1);
+        if (pixels == NULL) {
+                thumb->status = RESTORE_ERR_MEMORY;
+                return 0;
+        }
+        for (int x = 0; x < thumb->width; x++) {
+                long area = (bottom - top) *
+                            (box_edge(x + 1, thumb->target_width, 
+                                      thumb->width) -
+                             box_edge(x, thumb->target_width, thumb->width));
+                pixels[x] = (thumb->sums[x] + area / 2) / area;
+                thumb->sums[x] = 0;
+        }
+        thumb->rows[thumb->finished++] = pixels;
+        return 1;
+}
+
+/**************** write_thumbnail_rows_status *****************
+ *
+ * Write a finished thumbnail.
+ *
+ * Parameters:
+ *      OutputSink *output:     sink receiving the image
+ *      output_format_t format: format of the image
+ *      thumbnail_t thumb:      thumbnail with all thumb->height rows
+ *                              finished
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_ARGUMENT if format cannot hold the
+ *      thumbnail (see write_encoded_image_status), RESTORE_ERR_MEMORY if
+ *      the encoder cannot be created, or RESTORE_ERR_WRITE if encoding
+ *      fails
+ *
+ * Effects:
+ *      Writes the header and raster, or the encoded image, to output.
+ *      The rows are already bytes, as every box mean is in range.
+ ************************/
+restore_status_t write_thumbnail_rows_status(OutputSink *output, 
+                                             output_format_t format,
+                                             thumbnail_t thumb)
+{
+        if (format == FORMAT_PGM) {
+                struct pgm_header header = { thumb->width, thumb->height,
+                                             MAXVAL };
+                write_pgm_header(output, &header);
+                for (int i = 0; i < thumb->height; i++) {
+                        sink_write(output, thumb->rows[i], thumb->width);
+                }
+                return RESTORE_OK;
+        }
+        if (!image_encoder_fits(format, thumb->width, thumb->height)) {
+                return RESTORE_ERR_ARGUMENT;
+        }
+        ImageEncoder *encoder = create_image_encoder(output, format, 
+                                                     thumb->width, 
+                                                     thumb->height);
+        if (encoder == NULL) {
+                return RESTORE_ERR_MEMORY;
+        }
+        for (int i = 0; i < thumb->height; i++) {
+                encoder_write_row(encoder, thumb->rows[i]);
+        }
+        return close_image_encoder(encoder) ? RESTORE_OK : 
+                                              RESTORE_ERR_WRITE;
+}
+
+/**************** write_thumbnail_status *****************
+ *
+ * Write a box-filtered thumbnail of the image a filled line table
+ * restores.
+ *
+ * Parameters:
+ *      LineTable *table:          table holding every line of one input
+ *      restore_options_t options: run options (not NULL); uses
+ *                                 options->format and the thumbnail size
+ *      OutputSink *output:        sink receiving the image
+ *      long *clamped:             out; covered target pixels above
+ *                                 MAXVAL
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_MEMORY if memory allocation fails, or
+ *      RESTORE_ERR_WRITE if encoding fails
+ *
+ * Expects:
+ *      table, options and output not NULL; options->thumbnail_width and
+ *      options->thumbnail_height > 0.
+ *
+ * Effects:
+ *      Shrinks the W by H target to at most the thumbnail size, keeping
+ *      a dimension that already fits. The target is cut into width by
+ *      height boxes at proportional edges (see box_edge), so boxes
+ *      differ by at most one pixel each way and every target pixel
+ *      counts; each thumbnail pixel is the mean of its box. Rows are
+ *      folded into their boxes one at a time, so the full raster is never
+ *      built. Writes nothing if no infusion repeats.
+ ************************/
+restore_status_t write_thumbnail_status(LineTable *table, 
+                                        restore_options_t options, 
+                                        OutputSink *output, long *clamped)
+{
+        *clamped = 0;
+        long height = line_table_target_height(table);
+        if (height <= 0) {
+                return height < 0 ? RESTORE_ERR_MEMORY : RESTORE_OK;
+        }
+        int width;
+        map_target_rows(table, height - 1, height, measure_row, &width);
+
+        struct thumbnail thumb = {0};
+        thumb.width = width < options->thumbnail_width ? 
+                      width : options->thumbnail_width;
+        thumb.height = height < options->thumbnail_height ? 
+                       height : options->thumbnail_height;
+        thumb.target_width = width;
+        thumb.target_height = height;
+        /* Rows without pixels make an empty raster */
+        thumb.sums = calloc(width > 0 ? thumb.width : 1, sizeof *thumb.sums);
+        thumb.pixels = malloc((width > 0 ? (size_t)width : 1) * 
+                              sizeof *thumb.pixels);
+        thumb.rows = malloc(thumb.height * sizeof *thumb.rows);
+        if (thumb.sums == NULL || thumb.pixels == NULL || 
+            thumb.rows == NULL) {
+                free(thumb.sums);
+                free(thumb.pixels);
+                free(thumb.rows);
+                return RESTORE_ERR_MEMORY;
+        }
+        thumb.finished = 0;
+        thumb.status = RESTORE_OK;
+
+        map_target_rows(table, 0, height, add_to_thumbnail, &thumb);
+        restore_status_t status = thumb.status;
+        if (status == RESTORE_OK) {
+                status = write_thumbnail_rows_status(output, options->format,
+                                                     &thumb);
+        }
+        *clamped = thumb.clamped;
+
+        /* Cleanup */
+        for (int i = 0; i < thumb.finished; i++) {
+                free(thumb.rows[i]);
+        }
+        free(thumb.rows);
+        free(thumb.sums);
+        free(thumb.pixels);
+        return status;
+}
+
+/*------------------------Row indexes-------------------------*/
+
+/**************** save_row_index *****************
+ *
+ * Leave an index of where the target's rows lie next to an input.
+ *
+ * Parameters:
+ *      const char *input_filename: the input table was read from
+ *      LineTable *table:           table holding every line of it
+ *      line_offsets_t offsets:     where each of its lines starts
+ *
+ * Expects:
+ *      table filled in input order, one line number per line, with
+ *      offsets recorded for the same lines.
+ *
+ * Effects:
+ *      Writes input_filename's row index (see row_index.h): the target's
+ *      fingerprint, its width as write_line_table_status finds it, and
+ *      each row's line. Does nothing if no infusion repeats; like the
+ *      image cache, an index that cannot be written is simply not left,
+ *      and raises nothing.
+ ************************/
+void save_row_index(const char *input_filename, LineTable *table,
+                    line_offsets_t offsets)
+{
+        long height = line_table_target_height(table);
+        if (height <= 0) {
+                return;
+        }
+        int width;
+        map_target_rows(table, height - 1, height, measure_row, &width);
+        long long *starts = malloc(height * sizeof *starts);
+        int *lengths = malloc(height * sizeof *lengths);
+        if (starts != NULL && lengths != NULL) {
+                for (long row = 0; row < height; row++) {
+                        long line = line_table_target_line(table, row);
+                        long long end = line + 1 < offsets->count ?
+                                        offsets->starts[line + 1] : 
+                                        offsets->end;
+                        starts[row] = offsets->starts[line];
+                        lengths[row] = end - starts[row];
+                }
+                write_row_index(input_filename, 
+                                line_table_target_fingerprint(table), width,
+                                height, starts, lengths);
+        }
+        free(starts);
+        free(lengths);
+}
+
+/**************** write_indexed_rows_status *****************
+ *
+ * Write a range of an input's rows using its row index, reading only
+ * their lines.
+ *
+ * Parameters:
+ *      const char *input_filename: path to corrupted PGM (not NULL)
+ *      restore_options_t options:  run options (not NULL); the row range
+ *                                  is set
+ *      OutputSink *output:         sink receiving the image
+ *      long *clamped:              out; pixels outside [0, MAXVAL]
+ *      int *served:                out; 1 if the rows were written, 0 if
+ *                                  the index could not be used
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_MEMORY if memory runs out, or
+ *      RESTORE_ERR_WRITE if the rows were read but could not be written
+ *
+ * Effects:
+ *      Writes what write_line_table_status would for the range, cut
+ *      short at the last row. Every line read must still hold the
+ *      indexed target's infusion; if the index is missing, stale or
+ *      wrong, or a line cannot be read, nothing is written and *served
+ *      is 0, so the caller restores the input in full. Raises nothing.
+ ************************/
+restore_status_t write_indexed_rows_status(const char *input_filename,
+                                           restore_options_t options,
+                                           OutputSink *output, 
+                                           long *clamped, int *served)
+{
+        *clamped = 0;
+        *served = 0;
+        RowIndex *index = open_row_index(input_filename);
+        if (index == NULL) {
+                return RESTORE_OK;
+        }
+        long height = row_index_rows(index);
+        long last = options->rows_last < height ? options->rows_last : 
+                                                  height;
+        long first = options->rows_first < last ? options->rows_first : 
+                                                  last;
+        long count = last - first;
+        long long *starts = malloc((count + 1) * sizeof *starts);
+        int *lengths = malloc((count + 1) * sizeof *lengths);
+        int **rows = calloc(count + 1, sizeof *rows);
+        long parsed = 0;
+        char *line = NULL;
+        int line_size = 0;
+        restore_status_t status = RESTORE_OK;
+        if (starts == NULL || lengths == NULL || rows == NULL) {
+                status = RESTORE_ERR_MEMORY;
+        }
+        int usable = status == RESTORE_OK &&
+                     (count == 0 || 
+                      row_index_read(index, first, last, starts, lengths));
+        for (long i = 0; usable && i < count; i++) {
+                /* Lines are split the way process_line_status does */
+                if (lengths[i] > line_size) {
+                        free(line);
+                        line_size = lengths[i];
+                        line = malloc(line_size);
+                        if (line == NULL) {
+                                status = RESTORE_ERR_MEMORY;
+                                break;
+                        }
+                }
+                char key_buffer[KEY_BUFFER_SIZE];
+                char *chars;
+                int char_count;
+                uint64_t fp;
+                int *digits;
+                int digit_count;
+                usable = lengths[i] > 0 &&
+                         row_index_read_line(index, starts[i], lengths[i],
+                                             line);
+                if (!usable) {
+                        break;
+                }
+                line[lengths[i] - 1] = '\0';
+                if (!split_line(line, lengths[i], key_buffer, &chars, 
+                                &char_count, &fp, &digits, &digit_count)) {
+                        status = RESTORE_ERR_MEMORY;
+                        break;
+                }
+                if (chars != key_buffer) {
+                        free(chars);
+                }
+                rows[parsed++] = digits;
+                usable = fp == row_index_fingerprint(index);
+        }
+
+        if (status == RESTORE_OK && usable) {
+                int width = row_index_width(index);
+                *served = 1;
+                if (options->format != FORMAT_PGM) {
+                        status = write_encoded_image_status(output, 
+                                                            options->format,
+                                                            rows, count,
+                                                            width, clamped);
+                } else {
+                        struct pgm_header header = { width, count, MAXVAL };
+                        write_pgm_header(output, &header);
+                        status = write_digit_arrays_positional_status(
+                                        output, rows, count, width, 
+                                        options->threads, 
+                                        options->positional_min_bytes,
+                                        clamped);
+                }
+        }
+
+        /* Cleanup */
+        for (long i = 0; i < parsed; i++) {
+                free(rows[i]);
+        }
+        free(rows);
+        free(line);
+        free(starts);
+        free(lengths);
+        close_row_index(index);
+        return status;
+}
+
+/**************** open_image_cache *****************
+ *
+ * Open the image cache requested by options, if caching applies.
+ *
+ * Parameters:
+ *      const char *input_filename: path to corrupted PGM (NULL for stdin)
+ *      restore_options_t options:  run options (not NULL)
+ *      uint64_t *key:              out; content hash of the input,
+ *                                  mixed with the output format,
+ *                                  thumbnail size and row range
+ *
+ * Return:
+ *      Open ImageCache, or NULL if no cache was requested, the input is
+ *      stdin (which cannot be hashed without consuming it), or the cache
+ *      directory or input cannot be used. Restoration then runs uncached.
+ ************************/
+ImageCache *open_image_cache(const char *input_filename, 
+                             restore_options_t options, uint64_t *key)
+{
+        if (options->cache_dir == NULL || input_filename == NULL) {
+                return NULL;
+        }
+        if (!hash_image_file(input_filename, key)) {
+                return NULL;
+        }
+        if (options->format != FORMAT_PGM) {
+                /* Each format gets its own entry; P5 keys stay as they
+                 * were */
+                *key = xxh64(key, sizeof *key, options->format);
+        }
+        if (options->thumbnail_width > 0) {
+                /* So does each thumbnail size; formats are below 2^32 */
+                *key = xxh64(key, sizeof *key,
+                             (uint64_t)options->thumbnail_width << 32 |
+                             (uint32_t)options->thumbnail_height);
+        }
+        if (options->rows_last > 0) {
+                /* And each row range */
+                *key = xxh64(key, sizeof *key, options->rows_first);
+                *key = xxh64(key, sizeof *key, options->rows_last);
+        }
+        return create_image_cache(options->cache_dir, 
+                                  options->cache_max_entries,
+                                  options->cache_max_bytes, 
+                                  options->cache_policy);
+}
+
+/**************** restore_image *****************
+ *
+ * Orchestrate full restoration: read corrupted input, derive original rows,
+ * and write a valid P5 PGM to stdout, using default options.
+ *
+ * Parameters:
+ *      const char *input_filename:   path to corrupted PGM (plain-like)
+ *
+ * Expects:
+ *      input_filename if necessary.
+ *
+ * Effects:
+ *      See restore_image_with_options.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if files cannot be opened, if read errors occur,
+ *      or if memory allocation fails.
+ ************************/
+void restore_image(const char *input_filename)
+{
+        struct restore_options options = {0};
+        struct restore_stats stats = {0};
+        options.cache_policy = CACHE_EVICT_LRU;
+        options.queue_depth = BLOCK_READER_QUEUE_DEPTH;
+        TRY
+                restore_image_with_options(input_filename, &options, &stats);
+        FINALLY
+                free_restore_stats(&stats);
+        END_TRY;
+}
+
+/**************** open_output_fd_status *****************
+ *
+ * Open the descriptor restoration writes to.
+ *
+ * Parameters:
+ *      const char *output_filename: path to write (NULL for stdout)
+ *      int *fd:                     out; descriptor for output_filename,
+ *                                   truncated, or STDOUT_FILENO
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_OPEN if the file cannot be opened
+ ************************/
+restore_status_t open_output_fd_status(const char *output_filename, 
+                                       int *fd)
+{
+        if (output_filename == NULL) {
+                *fd = STDOUT_FILENO;
+                return RESTORE_OK;
+        }
+        *fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        return *fd < 0 ? RESTORE_ERR_OPEN : RESTORE_OK;
+}
+
+/**************** open_output_fd *****************
+ *
+ * CRE wrapper for open_output_fd_status.
+ *
+ * Return:
+ *      Descriptor for output_filename, truncated, or STDOUT_FILENO.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the file cannot be opened.
+ ************************/
+int open_output_fd(const char *output_filename)
+{
+        int fd;
+        check_status(open_output_fd_status(output_filename, &fd));
+        return fd;
+}
+
+/**************** restore_image_status *****************
+ *
+ * Restore a corrupted PGM to stdout or options->output_path without
+ * raising exceptions.
+ *
+ * Parameters:
+ *      const char *input_filename: path to corrupted PGM (NULL for stdin)
+ *      restore_options_t options:  run options (not NULL)
+ *      restore_stats_t stats:      in/out; counters updated by this run
+ *
+ * Return:
+ *      RESTORE_OK, or the first failure: RESTORE_ERR_OPEN,
+ *      RESTORE_ERR_READ, RESTORE_ERR_MEMORY or RESTORE_ERR_WRITE
+ *
+ * Expects:
+ *      options and stats not NULL.
+ *
+ * Effects:
+ *      Writes through a buffered fd sink (write(2), no stdio). See
+ *      restore_to_sink_status for the cache behavior. Every resource is
+ *      released before this returns, so threads may restore different
+ *      files at once (each with its own stats and output path).
+ ************************/
+restore_status_t restore_image_status(const char *input_filename, 
+                                      restore_options_t options, 
+                                      restore_stats_t stats)
+{
+        int output_fd;
+        restore_status_t status = open_output_fd_status(options->output_path,
+                                                        &output_fd);
+        if (status != RESTORE_OK) {
+                return status;
+        }
+        OutputSink *output = create_fd_sink(output_fd, SINK_BUFFER_SIZE);
+        if (output == NULL) {
+                status = RESTORE_ERR_MEMORY;
+        } else {
+                status = restore_to_sink_status(input_filename, options, 
+                                                stats, output);
+        }
+
+        int written = 0;
+        if (status == RESTORE_OK) {
+                written = close_output_sink(output);
+        } else {
+                abandon_output_sink(output);
+        }
+        if (output_fd != STDOUT_FILENO && close(output_fd) != 0) {
+                written = 0;
+        }
+        if (status == RESTORE_OK && !written) {
+                status = RESTORE_ERR_WRITE;
+        }
+        if (status == RESTORE_OK) {
+                record_peak_rss(stats);
+        }
+        return status;
+}
+
+/**************** restore_image_with_options *****************
+ *
+ * CRE wrapper for restore_image_status, used by the CLI.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if files cannot be opened, if read or write errors
+ *      occur, or if memory allocation fails.
+ ************************/
+void restore_image_with_options(const char *input_filename, 
+                                restore_options_t options, 
+                                restore_stats_t stats)
+{
+        check_status(restore_image_status(input_filename, options, stats));
+}
+
+/**************** record_peak_rss *****************
+ *
+ * Store the process's peak resident set size in stats.
+ *
+ * Parameters:
+ *      restore_stats_t stats: in/out; peak_rss_kb raised to the current
+ *                             peak if larger
+ ************************/
+void record_peak_rss(restore_stats_t stats)
+{
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0 && 
+            usage.ru_maxrss > stats->peak_rss_kb) {
+                /* Linux reports ru_maxrss in kilobytes */
+                stats->peak_rss_kb = usage.ru_maxrss;
+        }
+}
+
+/**************** record_infusion_lengths_status *****************
+ *
+ * Add a line table's per-length line counts to stats.
+ *
+ * Parameters:
+ *      restore_stats_t stats: in/out; infusion_lengths grown as needed
+ *      LineTable *table:      table holding every line of one input
+ *
+ * Return:
+ *      RESTORE_OK, or RESTORE_ERR_MEMORY if the histogram cannot be
+ *      grown (stats is then unchanged)
+ ************************/
+restore_status_t record_infusion_lengths_status(restore_stats_t stats, 
+                                                LineTable *table)
+{
+        int size = line_table_max_length(table) + 1;
+        if (size > stats->infusion_lengths_size) {
+                long *lengths = realloc(stats->infusion_lengths, 
+                                        size * sizeof *lengths);
+                if (lengths == NULL) {
+                        return RESTORE_ERR_MEMORY;
+                }
+                for (int i = stats->infusion_lengths_size; i < size; i++) {
+                        lengths[i] = 0;
+                }
+                stats->infusion_lengths = lengths;
+                stats->infusion_lengths_size = size;
+        }
+        for (int i = 0; i < size; i++) {
+                stats->infusion_lengths[i] += 
+                        line_table_length_count(table, i);
+        }
+        return RESTORE_OK;
+}
+
+/**************** record_infusion_lengths *****************
+ *
+ * CRE wrapper for record_infusion_lengths_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the histogram cannot be grown.
+ ************************/
+void record_infusion_lengths(restore_stats_t stats, LineTable *table)
+{
+        check_status(record_infusion_lengths_status(stats, table));
+}
+
+/**************** free_restore_stats *****************
+ *
+ * Free memory held by stats (not stats itself).
+ *
+ * Parameters:
+ *      restore_stats_t stats: counters to release (not NULL)
+ ************************/
+void free_restore_stats(restore_stats_t stats)
+{
+        free(stats->infusion_lengths);
+        stats->infusion_lengths = NULL;
+        stats->infusion_lengths_size = 0;
+        free(stats->workers);
+        stats->workers = NULL;
+        stats->workers_size = 0;
+}
+
+/**************** restore_to_sink_status *****************
+ *
+ * Restore a corrupted PGM into a sink, consulting the image cache first.
+ *
+ * Parameters:
+ *      const char *input_filename: path to corrupted PGM (NULL for stdin)
+ *      restore_options_t options:  run options (not NULL)
+ *      restore_stats_t stats:      in/out; counters updated by this run
+ *      OutputSink *output:         sink receiving the P5 image (not NULL)
+ *
+ * Return:
+ *      RESTORE_OK, the failure of write_restored_image_status, or
+ *      RESTORE_ERR_WRITE if the new entry cannot be copied into output
+ *
+ * Effects:
+ *      On a cache hit, copies the cached P5 into output without parsing.
+ *      On a miss, restores through a spill sink whose spill file is the
+ *      new cache entry, so closing it copies the entry into output
+ *      (copy_file_range/sendfile); then publishes the entry and evicts
+ *      entries beyond the configured limits. A failed run publishes
+ *      nothing. If the spill file cannot take the image (a full cache
+ *      filesystem, say), none of it has reached output: the entry is
+ *      dropped and the input restored again straight into output, with
+ *      stats left as the first run set them. Without a cache, restores
+ *      straight into output. With
+ *      options->write_index, the lookup is skipped, since a hit would
+ *      not read the input and so could not index it; the run still
+ *      publishes its entry.
+ ************************/
+restore_status_t restore_to_sink_status(const char *input_filename, 
+                                        restore_options_t options,
+                                        restore_stats_t stats, 
+                                        OutputSink *output)
+{
+        uint64_t key = 0;
+        ImageCache *cache = open_image_cache(input_filename, options, &key);
+        int entry_fd = -1;
+        OutputSink *entry = NULL;
+
+        if (cache != NULL) {
+                if (!options->write_index && 
+                    image_cache_lookup(cache, key, output)) {
+                        stats->cache_hits++;
+                        free_image_cache(cache);
+                        return RESTORE_OK;
+                }
+                stats->cache_misses++;
+                entry_fd = image_cache_begin(cache);
+                if (entry_fd >= 0) {
+                        entry = create_spill_sink(output, entry_fd);
+                }
+        }
+
+        restore_status_t status = 
+                write_restored_image_status(input_filename, options, stats,
+                                            entry != NULL ? entry : output);
+        if (entry != NULL && !sink_flush(entry)) {
+                abandon_output_sink(entry);
+                entry = NULL;
+                image_cache_commit(cache, key, entry_fd, 0);
+                entry_fd = -1;
+                status = write_restored_image_status(input_filename, options,
+                                                     NULL, output);
+        }
+        if (status != RESTORE_OK) {
+                abandon_output_sink(entry);
+                if (entry_fd >= 0) {
+                        image_cache_commit(cache, key, entry_fd, 0);
+                }
+        } else if (entry_fd >= 0) {
+                int complete = entry != NULL && close_output_sink(entry);
+                image_cache_commit(cache, key, entry_fd, complete);
+                if (entry != NULL && !complete) {
+                        /* The entry is whole, so output failed */
+                        status = RESTORE_ERR_WRITE;
+                } else {
+                        stats->cache_evictions += image_cache_evict(cache);
+                }
+        }
+        free_image_cache(cache);
+        return status;
+}
+
+/**************** restore_to_sink *****************
+ *
+ * CRE wrapper for restore_to_sink_status.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if files cannot be opened, if read or write errors
+ *      occur, or if memory allocation fails.
+ ************************/
+void restore_to_sink(const char *input_filename, restore_options_t options,
+                     restore_stats_t stats, OutputSink *output)
+{
+        check_status(restore_to_sink_status(input_filename, options, stats,
+                                            output));
+}
+
+/**************** restore_image_to_memory *****************
+ *
+ * Library entry point: restore a corrupted PGM into a heap buffer.
+ *
+ * Parameters:
+ *      const char *input_filename: path to corrupted PGM (NULL for stdin)
+ *      size_t *length:             out; number of bytes returned
+ *
+ * Return:
+ *      malloc'd P5 image (caller frees). *length is 0 if no infusion
+ *      repeats.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the input cannot be opened or read, or if memory
+ *      allocation fails.
+ ************************/
+unsigned char *restore_image_to_memory(const char *input_filename, 
+                                       size_t *length)
+{
+        struct restore_options options = {0};
+        OutputSink *output = create_memory_sink();
+        check_if_null(output);
+
+        if (write_restored_image_status(input_filename, &options, NULL, 
+                                        output) != RESTORE_OK) {
+                abandon_output_sink(output);
+                RAISE(Checked_Runtime_Error);
+        }
+
+        unsigned char *data = sink_memory_data(output, length);
+        int written = close_output_sink(output);
+        if (data == NULL || !written) {
+                free(data);
+                RAISE(Checked_Runtime_Error);
+        }
+        return data;
+}
+
+/**************** print_restore_stats *****************
+ *
+ * Print run counters, one "name value" pair per line. The infusion
+ * length histogram prints as "infusion_length LENGTH LINES" for every
+ * length that occurred. After a --batch run, also prints the file counts
+ * and "worker_tasks", "worker_steals" and "worker_utilization" lines
+ * (name, worker index, value) for every thread.
+ *
+ * Parameters:
+ *      FILE *output:          stream to print to (not NULL)
+ *      restore_stats_t stats: counters to print (not NULL)
+ ************************/
+void print_restore_stats(FILE *output, restore_stats_t stats)
+{
+        fprintf(output, "cache_hits %ld\n", stats->cache_hits);
+        fprintf(output, "cache_misses %ld\n", stats->cache_misses);
+        fprintf(output, "cache_evictions %ld\n", stats->cache_evictions);
+        fprintf(output, "peak_rss_kb %ld\n", stats->peak_rss_kb);
+        fprintf(output, "pixels_clamped %ld\n", stats->pixels_clamped);
+        for (int i = 0; i < stats->infusion_lengths_size; i++) {
+                if (stats->infusion_lengths[i] > 0) {
+                        fprintf(output, "infusion_length %d %ld\n", i, 
+                                stats->infusion_lengths[i]);
+                }
+        }
+        if (stats->workers_size > 0) {
+                fprintf(output, "batch_files %ld\n", stats->batch_files);
+                fprintf(output, "batch_failures %ld\n", 
+                        stats->batch_failures);
+        }
+        for (int i = 0; i < stats->workers_size; i++) {
+                struct worker_usage *usage = &stats->workers[i];
+                fprintf(output, "worker_tasks %d %ld\n", i, usage->tasks);
+                fprintf(output, "worker_steals %d %ld\n", i, usage->steals);
+                fprintf(output, "worker_utilization %d %.3f\n", i, 
+                        usage->utilization);
+        }
+}
+
+/**************** serve_job *****************
+ *
+ * Job server callback: restore one file in a worker process.
+ *
+ * Parameters:
+ *      const char *input_path:  corrupted PGM to restore
+ *      const char *output_path: file to write the image to
+ *      FILE *reply:             stream back to the client
+ *      void *cl:                the server's restore_options_t
+ *
+ * Return:
+ *      1 if the image was restored, 0 if restoration failed
+ *
+ * Effects:
+ *      Restores with the server's options into output_path and writes
+ *      the job's counters to reply in print_restore_stats format.
+ ************************/
+int serve_job(const char *input_path, const char *output_path, FILE *reply,
+              void *cl)
+{
+        struct restore_options options = *(restore_options_t)cl;
+        struct restore_stats stats = {0};
+        options.output_path = output_path;
+
+        int restored = restore_image_status(input_path, &options, 
+                                            &stats) == RESTORE_OK;
+
+        print_restore_stats(reply, &stats);
+        free_restore_stats(&stats);
+        return restored;
+}
+
+/**************** serve_restorations *****************
+ *
+ * Run restoration as a job server on options->serve_path.
+ *
+ * Parameters:
+ *      restore_options_t options: run options (not NULL); applied to
+ *                                 every job
+ *
+ * Return:
+ *      EXIT_SUCCESS after SIGINT or SIGTERM, EXIT_FAILURE if the server
+ *      could not start.
+ *
+ * Effects:
+ *      Forks options->workers worker processes (one per online CPU if
+ *      0) that run jobs with serve_job; see job_server.h.
+ ************************/
+int serve_restorations(restore_options_t options)
+{
+        int workers = options->workers;
+        if (workers == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                workers = cpus > 0 ? (int)cpus : 1;
+        }
+        if (!serve_jobs(options->serve_path, workers, serve_job, options)) {
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
+
+/*--------------------Batch restoration--------------------*/
+
+/**************** read_batch_list *****************
+ *
+ * Read the list of inputs for --batch.
+ *
+ * Parameters:
+ *      const char *list_path: file with one "INPUT<TAB>OUTPUT" line per
+ *                             input; empty lines are skipped
+ *
+ * Return:
+ *      Seq of batch_file_t, in list order, with no tables yet. Caller
+ *      frees each file, its paths, and the Seq.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the list cannot be read, a line has no tab or an
+ *      empty path, or memory allocation fails.
+ ************************/
+Seq_T read_batch_list(const char *list_path)
+{
+        FILE *list = open_file(list_path, "r");
+        Seq_T files = Seq_new(0);
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t len;
+
+        while ((len = getline(&line, &capacity, list)) > 0) {
+                if (line[len - 1] == '\n') {
+                        line[--len] = '\0';
+                }
+                if (len == 0) {
+                        continue;
+                }
+                char *tab = strchr(line, '\t');
+                if (tab == NULL || tab == line || tab[1] == '\0') {
+                        break;
+                }
+                *tab = '\0';
+                batch_file_t file = calloc(1, sizeof *file);
+                check_if_null(file);
+                file->input_path = strdup(line);
+                file->output_path = strdup(tab + 1);
+                check_if_null(file->input_path);
+                check_if_null(file->output_path);
+                Seq_addhi(files, file);
+        }
+        free(line);
+        int failed = len > 0 || ferror(list);
+        fclose(list);
+        if (failed) {
+                /* A malformed line, or a read error */
+                free_batch_list(&files);
+                RAISE(Checked_Runtime_Error);
+        }
+        return files;
+}
+
+/**************** free_batch_list *****************
+ *
+ * Free a list made by read_batch_list.
+ *
+ * Parameters:
+ *      Seq_T *files: in/out; list to free, set to NULL
+ ************************/
+void free_batch_list(Seq_T *files)
+{
+        for (int i = 0; i < Seq_length(*files); i++) {
+                batch_file_t file = Seq_get(*files, i);
+                free(file->input_path);
+                free(file->output_path);
+                free(file);
+        }
+        Seq_free(files);
+}
+
+/**************** run_batch_task *****************
+ *
+ * Scheduler callback: parse a whole --batch input or one chunk of it.
+ *
+ * Parameters:
+ *      void *task: the batch_task_t to run; freed here
+ *      int worker: index of the running worker
+ *      void *cl:   the restore_batch_t
+ *
+ * Effects:
+ *      A whole-input task may split its input and spawn the other chunks
+ *      (see parse_batch_input). Either way, the task's part of the input
+ *      is in the file's table when it reports to finish_batch_task.
+ *      Raises nothing.
+ ************************/
+void run_batch_task(void *task, int worker, void *cl)
+{
+        restore_batch_t batch = cl;
+        batch_task_t t = task;
+        batch_file_t file = t->file;
+        int parsed;
+
+        if (t->chunk < 0) {
+                parsed = parse_batch_input(batch, t, worker);
+        } else {
+                int fd = open(file->input_path, O_RDONLY | O_CLOEXEC);
+                parsed = fd >= 0 && parse_batch_range(batch, t, fd, worker);
+                if (fd >= 0) {
+                        close(fd);
+                }
+        }
+        free(t);
+        finish_batch_task(batch, file, parsed);
+}
+
+/**************** parse_batch_input *****************
+ *
+ * Parse the first chunk of a --batch input, spawning tasks for the rest.
+ *
+ * Parameters:
+ *      restore_batch_t batch: the batch (not NULL)
+ *      batch_task_t task:     whole-input task; becomes chunk 0
+ *      int worker:            index of the running worker
+ *
+ * Return:
+ *      1 if chunk 0 was parsed, 0 if the input could not be opened, read
+ *      or decompressed, or memory ran out
+ *
+ * Effects:
+ *      A plain regular file larger than options->batch_chunk_bytes
+ *      (BATCH_CHUNK_BYTES if 0) is split into chunks of that size:
+ *      chunks 1 and up are spawned onto this worker's deque for idle
+ *      workers to steal, and the file's chunks_left counts them.
+ *      Compressed inputs and pipes cannot be split and are parsed whole,
+ *      decompressing on their own thread.
+ *      Raises nothing.
+ ************************/
+int parse_batch_input(restore_batch_t batch, batch_task_t task, int worker)
+{
+        batch_file_t file = task->file;
+        int fd = open(file->input_path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return 0;
+        }
+        task->chunk = 0;
+        task->start = 0;
+        task->end = LLONG_MAX;
+
+        unsigned char prefix[COMPRESSION_MAGIC_MAX];
+        size_t prefix_len;
+        compression_t kind = peek_compression(fd, prefix, &prefix_len);
+        if (kind != COMPRESSION_NONE || prefix_len > 0) {
+                FILE *raw = fdopen(fd, "rb");
+                Decompressor *decompressor = NULL;
+                if (raw != NULL) {
+                        decompressor = start_decompressor(raw, 1, kind, 
+                                                          prefix, 
+                                                          prefix_len);
+                }
+                if (decompressor == NULL) {
+                        if (raw != NULL) {
+                                fclose(raw);
+                        } else {
+                                close(fd);
+                        }
+                        return 0;
+                }
+                FILE *stream = decompressor_stream(decompressor);
+                int parsed = parse_batch_range(batch, task, fileno(stream), 
+                                               worker);
+                return finish_decompressor(decompressor) && parsed;
+        }
+
+        struct stat st;
+        long long size = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? 
+                         (long long)st.st_size : 0;
+        long long chunk_bytes = batch->options->batch_chunk_bytes > 0 ?
+                                batch->options->batch_chunk_bytes :
+                                BATCH_CHUNK_BYTES;
+        long chunks = (size + chunk_bytes - 1) / chunk_bytes;
+        if (chunks > 1) {
+                pthread_mutex_lock(&batch->lock);
+                file->chunks_left += chunks - 1;
+                pthread_mutex_unlock(&batch->lock);
+                task->end = chunk_bytes;
+        }
+        for (long c = 1; c < chunks; c++) {
+                struct batch_task chunk = { file, c, c * chunk_bytes,
+                                            c + 1 < chunks ? 
+                                            (c + 1) * chunk_bytes :
+                                            LLONG_MAX };
+                batch_task_t piece = malloc(sizeof *piece);
+                if (piece != NULL) {
+                        *piece = chunk;
+                }
+                if (piece == NULL || 
+                    !scheduler_spawn(batch->scheduler, worker, piece)) {
+                        /* Nobody else will parse it */
+                        free(piece);
+                        int parsed = parse_batch_range(batch, &chunk, fd, 
+                                                       worker);
+                        finish_batch_task(batch, file, parsed);
+                }
+        }
+
+        int parsed = lseek(fd, 0, SEEK_SET) == 0 && 
+                     parse_batch_range(batch, task, fd, worker);
+        close(fd);
+        return parsed;
+}
+
+/**************** parse_batch_range *****************
+ *
+ * Parse the lines of one chunk of a --batch input into its table.
+ *
+ * Parameters:
+ *      restore_batch_t batch: the batch (not NULL)
+ *      batch_task_t task:     chunk to parse
+ *      int fd:                the input, positioned at its start if
+ *                             task->start is 0 (may be a pipe then)
+ *      int worker:            index of the running worker, whose reader
+ *                             is used
+ *
+ * Return:
+ *      1 on success, 0 on a read error or if memory runs out
+ *
+ * Effects:
+ *      A chunk owns the lines that start inside [start, end): the line
+ *      under way at start belongs to the previous chunk, and the last
+ *      line is read past end to its '\n'. Line i of chunk c is numbered
+ *      (c << BATCH_CHUNK_LINE_BITS) + i, which orders the rows of all
+ *      chunks as the input does. Raises nothing.
+ ************************/
+int parse_batch_range(restore_batch_t batch, batch_task_t task, int fd, 
+                      int worker)
+{
+        BlockReader *reader = batch->readers[worker];
+        if (reader == NULL) {
+                /* Readers are reset for every chunk; only plain reads can
+                 * move from one descriptor to the next */
+                read_mode_t mode = batch->options->read_mode == READ_COLD ?
+                                   READ_COLD : READ_BLOCK;
+                reader = create_block_reader(fd, mode, BLOCK_READER_SIZE, 0);
+                if (reader == NULL) {
+                        return 0;
+                }
+                batch->readers[worker] = reader;
+        }
+        if (task->start > 0 && lseek(fd, task->start - 1, SEEK_SET) < 0) {
+                return 0;
+        }
+        if (!block_reader_reset(reader, fd)) {
+                return 0;
+        }
+
+        char *line;
+        size_t line_len;
+        long long offset = task->start;
+        if (task->start > 0) {
+                /* Skip to the end of the line under way at start */
+                line_len = block_reader_next_line(reader, &line);
+                offset += (long long)line_len - 1;
+        }
+        long index = task->chunk << BATCH_CHUNK_LINE_BITS;
+        int parsed = 1;
+        while (parsed && offset < task->end &&
+               (line_len = block_reader_next_line(reader, &line)) > 0) {
+                offset += line_len;
+                parsed = parse_line_at(line, line_len, index++, 
+                                       task->file->table);
+        }
+        return parsed && !block_reader_failed(reader);
+}
+
+/**************** finish_batch_task *****************
+ *
+ * Record that one chunk of a --batch input is done.
+ *
+ * Parameters:
+ *      restore_batch_t batch: the batch (not NULL)
+ *      batch_file_t file:     input the chunk belongs to
+ *      int parsed:            nonzero if the chunk was parsed
+ *
+ * Effects:
+ *      Once every chunk of file is done, queues file for output and wakes
+ *      the thread running restore_batch. Raises nothing.
+ ************************/
+void finish_batch_task(restore_batch_t batch, batch_file_t file, int parsed)
+{
+        pthread_mutex_lock(&batch->lock);
+        if (!parsed) {
+                file->failed = 1;
+        }
+        if (--file->chunks_left == 0) {
+                file->next_done = batch->done;
+                batch->done = file;
+                pthread_cond_signal(&batch->parsed);
+        }
+        pthread_mutex_unlock(&batch->lock);
+}
+
+/**************** admit_batch_file *****************
+ *
+ * Give a --batch input a table and queue it for parsing.
+ *
+ * Parameters:
+ *      restore_batch_t batch: the batch (not NULL)
+ *      batch_file_t file:     input from read_batch_list
+ *
+ * Effects:
+ *      If the table or task cannot be had, the input is queued for output
+ *      as failed instead.
+ ************************/
+void admit_batch_file(restore_batch_t batch, batch_file_t file)
+{
+        file->table = create_table(batch->options,
+                                   batch->options->lazy_digits);
+        file->chunks_left = 1;
+        batch_task_t task = malloc(sizeof *task);
+        if (task != NULL) {
+                *task = (struct batch_task){ file, -1, 0, 0 };
+        }
+        if (file->table == NULL || task == NULL ||
+            !scheduler_submit(batch->scheduler, task)) {
+                free(task);
+                finish_batch_task(batch, file, 0);
+        }
+}
+
+/**************** write_batch_output *****************
+ *
+ * Write the restored image of a parsed --batch input.
+ *
+ * Parameters:
+ *      batch_file_t file:         input whose chunks are all done
+ *      restore_options_t options: run options (not NULL)
+ *      restore_stats_t stats:     in/out; infusion length counts are
+ *                                 added here
+ *
+ * Return:
+ *      RESTORE_OK, RESTORE_ERR_READ if the input failed to parse, or the
+ *      failure of opening or writing the output
+ *
+ * Effects:
+ *      Writes file->output_path through a buffered fd sink. The table is
+ *      left for the caller to free.
+ ************************/
+restore_status_t write_batch_output(batch_file_t file, 
+                                    restore_options_t options, 
+                                    restore_stats_t stats)
+{
+        if (file->failed) {
+                return RESTORE_ERR_READ;
+        }
+        restore_status_t status = record_infusion_lengths_status(stats, 
+                                                                 file->table);
+        int output_fd;
+        if (status == RESTORE_OK) {
+                status = open_output_fd_status(file->output_path, 
+                                               &output_fd);
+        }
+        if (status != RESTORE_OK) {
+                return status;
+        }
+        OutputSink *output = create_fd_sink(output_fd, SINK_BUFFER_SIZE);
+        if (output == NULL) {
+                close(output_fd);
+                return RESTORE_ERR_MEMORY;
+        }
+
+        long clamped;
+        status = write_line_table_status(file->table, options, output,
+                                         &clamped);
+        if (status != RESTORE_OK) {
+                abandon_output_sink(output);
+                close(output_fd);
+                return status;
+        }
+        int written = close_output_sink(output);
+        if (close(output_fd) != 0 || !written) {
+                return RESTORE_ERR_WRITE;
+        }
+        stats->pixels_clamped += clamped;
+        return RESTORE_OK;
+}
+
+/**************** restore_batch *****************
+ *
+ * Restore every input listed in options->batch_path.
+ *
+ * Parameters:
+ *      restore_options_t options: run options (not NULL); options->threads
+ *                                 workers, one per online CPU if 0
+ *      restore_stats_t stats:     in/out; counters, including each
+ *                                 worker's usage
+ *
+ * Return:
+ *      EXIT_SUCCESS if every input was restored, else EXIT_FAILURE
+ *
+ * Effects:
+ *      Parsing runs on a work-stealing Scheduler (see scheduler.h): each
+ *      input is one task, and large inputs split themselves into chunk
+ *      tasks that idle workers steal, so one huge file among many small
+ *      ones does not leave threads idle. Each worker reuses one
+ *      BlockReader for everything it reads. At most
+ *      BATCH_FILES_PER_THREAD inputs per worker are parsed at once, which
+ *      bounds the memory held in tables. This thread writes each image as
+ *      soon as its input is parsed. A failed input is reported on stderr
+ *      and does not stop the others.
+ *      --speculate and --cache do not apply to batch runs.
+ *
+ * Checked Runtime Errors:
+ *      Raises a CRE if the list cannot be read or the workers cannot be
+ *      started.
+ ************************/
+int restore_batch(restore_options_t options, restore_stats_t stats)
+{
+        Seq_T files = read_batch_list(options->batch_path);
+        int threads = options->threads;
+        if (threads == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                threads = cpus > 0 ? (int)cpus : 1;
+        }
+        struct restore_batch batch = {0};
+        batch.options = options;
+        batch.readers = calloc(threads, sizeof *batch.readers);
+        stats->workers = calloc(threads, sizeof *stats->workers);
+        check_if_null(batch.readers);
+        check_if_null(stats->workers);
+        stats->workers_size = threads;
+        pthread_mutex_init(&batch.lock, NULL);
+        pthread_cond_init(&batch.parsed, NULL);
+        batch.scheduler = create_scheduler(threads, options->alloc_mode,
+                                           run_batch_task, &batch);
+        check_if_null(batch.scheduler);
+
+        int total = Seq_length(files);
+        int admitted = 0;
+        int finished = 0;
+        while (finished < total) {
+                while (admitted < total && 
+                       admitted - finished < BATCH_FILES_PER_THREAD * threads) {
+                        admit_batch_file(&batch, Seq_get(files, admitted++));
+                }
+                pthread_mutex_lock(&batch.lock);
+                while (batch.done == NULL) {
+                        pthread_cond_wait(&batch.parsed, &batch.lock);
+                }
+                batch_file_t file = batch.done;
+                batch.done = NULL;
+                pthread_mutex_unlock(&batch.lock);
+
+                while (file != NULL) {
+                        restore_status_t status = 
+                                write_batch_output(file, options, stats);
+                        if (status == RESTORE_OK) {
+                                stats->batch_files++;
+                        } else {
+                                stats->batch_failures++;
+                                fprintf(stderr, 
+                                        "%s: restoration failed (%s)\n",
+                                        file->input_path,
+                                        restore_status_string(status));
+                        }
+                        free_line_table(file->table);
+                        file->table = NULL;
+                        finished++;
+                        file = file->next_done;
+                }
+        }
+
+        close_scheduler(batch.scheduler, stats->workers);
+        for (int i = 0; i < threads; i++) {
+                free_block_reader(batch.readers[i]);
+        }
+        free(batch.readers);
+        pthread_cond_destroy(&batch.parsed);
+        pthread_mutex_destroy(&batch.lock);
+        free_batch_list(&files);
+        record_peak_rss(stats);
+        return stats->batch_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
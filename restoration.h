@@ -12,13 +12,31 @@
  *
  *     Clients should call restore_image(); other functions are provided
  *     to facilitate unit testing and composition within this project.
+ *     Each raising function along the restoration path has a *_status
+ *     twin that returns a restore_status_t instead (see restore_status.h);
+ *     threads and servers should call restore_image_status().
  */
 
 #ifndef RESTORATION_H
 #define RESTORATION_H
 
 #include "readaline.h"
+#include "restore_status.h"
 #include "line_table.h"
+#include "image_cache.h"
+#include "output_sink.h"
+#include "block_reader.h"
+#include "decompress.h"
+#include "image_encoder.h"
+#include "speculation.h"
+#include "parse_pool.h"
+#include "job_server.h"
+#include "scheduler.h"
+#include "narrow.h"
+#include "fingerprint.h"
+#include "row_index.h"
+#include <pthread.h>
+#include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,6 +50,15 @@
 /* Constants */
 #define MAX_LINE_LENGTH 1000
 #define MAXVAL 255
+#define PGM_HEADER_MAX 64
+#define KEY_BUFFER_SIZE 256     /* infusions kept off the heap by split_line */
+#define INSERT_BATCH 32                 /* lines per line table insertion */
+#define BATCH_CHUNK_BYTES (8 << 20)     /* --batch splits larger inputs */
+#define BATCH_CHUNK_LINE_BITS 32        /* line numbers within one chunk */
+#define BATCH_FILES_PER_THREAD 2        /* --batch inputs parsed at once */
+#define POSITIONAL_MIN_BYTES (8 << 20)  /* smaller rasters are written
+                                         * serially */
+#define POSITIONAL_CHUNK (1 << 20)      /* bytes per positional pwrite */
 
 /* Structure to hold digit array for a line */
 typedef struct digit_array {
@@ -46,16 +73,160 @@ typedef struct pgm_header {
         int maxval;
 } *pgm_header_t;
 
-/* Error Definition */
-Except_T Checked_Runtime_Error;
+/* Lines split by batch_line but not yet in the line table */
+typedef struct line_batch {
+        LineTable *table;
+        Speculation *speculation;       /* may be NULL */
+        int size;                       /* lines inserted at once */
+        int count;                      /* lines queued */
+        struct line_table_entry entries[LINE_TABLE_BATCH_MAX];
+        char keys[LINE_TABLE_BATCH_MAX][KEY_BUFFER_SIZE];
+        size_t text_at[LINE_TABLE_BATCH_MAX];   /* offsets into text */
+        char *text;                     /* copies of a lazy table's lines */
+        size_t text_used;
+        size_t text_size;
+} *line_batch_t;
+
+/* One thread's share of a raster written with pwrite */
+typedef struct row_writer {
+        int **rows;                     /* rows of the target */
+        int width;
+        int first;                      /* first row of this share */
+        int last;                       /* one past its last row */
+        int fd;
+        off_t start;                    /* file offset of row 0 */
+        restore_status_t status;
+        long clamped;                   /* pixels outside [0, MAXVAL] */
+} *row_writer_t;
+
+/* A target being box-filtered down by write_thumbnail_status */
+typedef struct thumbnail {
+        int width;                      /* of the thumbnail */
+        int height;
+        int target_width;               /* of the image being shrunk */
+        long target_height;
+        long *sums;                     /* row of boxes being filled */
+        int *pixels;                    /* a text row's parsed pixels */
+        unsigned char **rows;           /* height rows, once finished */
+        int finished;                   /* rows finished so far */
+        restore_status_t status;
+        long clamped;                   /* target pixels above MAXVAL */
+} *thumbnail_t;
+
+/* Where each line read so far starts, for a row index */
+typedef struct line_offsets {
+        long long *starts;              /* byte offset of each line */
+        long count;
+        long size;                      /* room in starts */
+        long long end;                  /* one past the last line read */
+} *line_offsets_t;
+
+/* Structure to hold command-line options for a restoration run */
+typedef struct restore_options {
+        const char *output_path;        /* NULL writes to stdout */
+        output_format_t format;
+        read_mode_t read_mode;
+        int queue_depth;                /* reads in flight, READ_URING */
+        const char *cache_dir;          /* NULL disables the image cache */
+        long cache_max_entries;         /* 0 for unlimited */
+        long long cache_max_bytes;      /* 0 for unlimited */
+        cache_policy_t cache_policy;
+        long speculate_lines;           /* 0 disables speculative output */
+        int threads;                    /* parsing threads; 0 or 1 parses
+                                           on the reading thread */
+        alloc_mode_t alloc_mode;        /* line table and parser memory */
+        int lazy_digits;                /* parse only the target's rows */
+        int thumbnail_width;            /* --thumbnail size; 0 writes the */
+        int thumbnail_height;           /* full image */
+        int insert_batch;               /* lines inserted at once; 0 for
+                                           INSERT_BATCH */
+        int write_index;                /* leave INPUT.fpidx behind */
+        long rows_first;                /* --rows range, first row and */
+        long rows_last;                 /* one past the last; rows_last 0
+                                           writes every row */
+        const char *serve_path;         /* socket for --serve, or NULL */
+        int workers;                    /* --serve processes; 0 for one
+                                           per online CPU */
+        const char *batch_path;         /* list for --batch, or NULL */
+        long long batch_chunk_bytes;    /* --batch chunk size; 0 for
+                                           BATCH_CHUNK_BYTES */
+        long long positional_min_bytes; /* smallest raster written with
+                                           pwrite; 0 for
+                                           POSITIONAL_MIN_BYTES */
+        int print_stats;
+} *restore_options_t;
+
+/* Structure to hold counters reported by --stats */
+typedef struct restore_stats {
+        long cache_hits;
+        long cache_misses;
+        long cache_evictions;
+        long peak_rss_kb;
+        long pixels_clamped;            /* written outside [0, MAXVAL] */
+        long *infusion_lengths;         /* lines per infusion length */
+        int infusion_lengths_size;
+        long batch_files;               /* --batch inputs restored */
+        long batch_failures;            /* --batch inputs that failed */
+        struct worker_usage *workers;   /* one per --batch thread */
+        int workers_size;
+} *restore_stats_t;
+
+/* One input of a --batch run and its progress */
+typedef struct batch_file {
+        char *input_path;
+        char *output_path;
+        LineTable *table;
+        int chunks_left;                /* guarded by the batch lock */
+        int failed;                     /* guarded by the batch lock */
+        struct batch_file *next_done;
+} *batch_file_t;
+
+/* One task of a --batch run: a whole input, or one chunk of it */
+typedef struct batch_task {
+        batch_file_t file;
+        long chunk;                     /* -1 for the whole input */
+        long long start;                /* chunk's first byte */
+        long long end;                  /* one past the chunk's last byte */
+} *batch_task_t;
+
+/* Shared state of a --batch run */
+typedef struct restore_batch {
+        restore_options_t options;
+        Scheduler *scheduler;
+        BlockReader **readers;          /* one per worker, made on first use */
+        pthread_mutex_t lock;
+        pthread_cond_t parsed;
+        batch_file_t done;              /* parsed inputs awaiting output */
+} *restore_batch_t;
+
+/* Error Declaration (defined in restoration.c) */
+extern Except_T Checked_Runtime_Error;
 
                 /* HELPER FUNCTION DECLARATIONS */
 
 /* Digit Array Management */
 digit_array_t create_digit_array(int *digits, int length);
 void write_digit_arrays(FILE *output, Seq_T digit_arrays);
-void write_digit_arrays_from_sequence(FILE *output, Seq_T digit_sequences, 
-                                        int row_width);
+void write_digit_arrays_from_sequence(OutputSink *output, int **rows,
+                                      int height, int row_width);
+restore_status_t write_digit_arrays_from_sequence_status(OutputSink *output,
+                                                         int **rows,
+                                                         int height,
+                                                         int row_width,
+                                                         long *clamped);
+void write_encoded_image(OutputSink *output, output_format_t format,
+                         int **rows, int height, int row_width);
+restore_status_t write_digit_arrays_positional_status(OutputSink *output,
+                                                     int **rows, int height,
+                                                     int row_width, 
+                                                     int threads,
+                                                     long long min_bytes,
+                                                     long *clamped);
+void *write_rows_at(void *arg);
+restore_status_t write_encoded_image_status(OutputSink *output, 
+                                            output_format_t format,
+                                            int **rows, int height,
+                                            int row_width, long *clamped);
 
 /* String parsing utilities */
 int parse_number(const char *line, size_t *i, size_t line_len);
@@ -67,17 +238,145 @@ void extract_digits(const char *line, size_t line_len, int *digits,
 /* PGM header management */
 pgm_header_t create_pgm_header(int width, int height);
 void free_pgm_header(pgm_header_t header);
-void write_pgm_header(FILE *output, pgm_header_t header);
+void write_pgm_header(OutputSink *output, pgm_header_t header);
 
 /* Line processing */
 void break_line_down(const char *line, int line_len, char **char_sequence, 
                     int *char_sequence_len, digit_array_t *digit_array);
+int split_line(const char *line, size_t line_len, char *key_buffer, 
+               char **chars, int *char_count, uint64_t *fp, int **digits, 
+               int *digit_count);
+int *parse_row_text(const char *text, int text_len, int *len);
+LineTable *create_table(restore_options_t options, int lazy);
 
 /* FILE I/O */
 FILE *open_file(const char *filename, const char *mode);
+restore_status_t open_input_status(const char *input_filename, FILE **input,
+                                   Decompressor **decompressor,
+                                   unsigned char *prefix, size_t *prefix_len);
+restore_status_t close_input_status(FILE **input, Decompressor *decompressor);
+restore_status_t open_output_fd_status(const char *output_filename, 
+                                       int *fd);
+
+/* Command line */
+const char *parse_arguments(int argc, char *argv[], restore_options_t options);
+const char *option_value(int argc, char *argv[], int *i);
+long long parse_count(const char *text);
+read_mode_t parse_read_mode(const char *text);
+output_format_t parse_output_format(const char *text);
+void parse_size(const char *text, int *width, int *height);
+void parse_row_range(const char *text, long *first, long *last);
 
 /* Restoration */
-void process_image_file(FILE *input, LineTable *table);
+void process_image_file(FILE *input, LineTable *table, 
+                        Speculation *speculation, int batch_size);
+restore_status_t process_image_file_status(FILE *input, LineTable *table, 
+                                           Speculation *speculation, 
+                                           int batch_size,
+                                           line_offsets_t offsets);
+void process_image_blocks(BlockReader *reader, LineTable *table, 
+                          Speculation *speculation, int batch_size);
+restore_status_t process_image_blocks_status(BlockReader *reader, 
+                                             LineTable *table, 
+                                             Speculation *speculation, 
+                                             int batch_size,
+                                             line_offsets_t offsets);
+restore_status_t record_line_offset(line_offsets_t offsets, 
+                                    size_t line_len);
+void process_line(char *line, size_t line_len, LineTable *table, 
+                  Speculation *speculation);
+restore_status_t process_line_status(char *line, size_t line_len, 
+                                     LineTable *table, 
+                                     Speculation *speculation);
+void init_line_batch(line_batch_t batch, LineTable *table, 
+                     Speculation *speculation, int size);
+restore_status_t batch_line(line_batch_t batch, char *line, size_t line_len);
+restore_status_t flush_line_batch(line_batch_t batch);
+void free_line_batch(line_batch_t batch);
+int parse_line_at(char *line, size_t line_len, long line_index, void *cl);
+void process_image_parallel(FILE *input, BlockReader *reader, 
+                            LineTable *table, restore_options_t options);
+restore_status_t process_image_parallel_status(FILE *input, 
+                                               BlockReader *reader, 
+                                               LineTable *table, 
+                                               restore_options_t options);
+restore_status_t read_line_table(FILE *input, 
+                                 const unsigned char *prefix, 
+                                 size_t prefix_len, LineTable *table, 
+                                 restore_options_t options, 
+                                 Speculation *speculation,
+                                 line_offsets_t offsets);
+void write_restored_image(const char *input_filename, 
+                          restore_options_t options, restore_stats_t stats,
+                          OutputSink *output);
+restore_status_t write_restored_image_status(const char *input_filename, 
+                                             restore_options_t options, 
+                                             restore_stats_t stats,
+                                             OutputSink *output);
+void write_line_table(LineTable *table, restore_options_t options, 
+                      OutputSink *output);
+restore_status_t write_line_table_status(LineTable *table, 
+                                         restore_options_t options, 
+                                         OutputSink *output, long *clamped);
+int **slice_rows(int **rows, int *height, long first, long last);
+int count_numbers(const char *line, size_t line_len);
+int extract_leading_digits(const char *line, size_t line_len, int *digits,
+                           int max);
+int measure_row(long row, const int *digits, const char *text, int len,
+                void *cl);
+long box_edge(long i, long full, long n);
+int add_to_thumbnail(long row, const int *digits, const char *text, int len,
+                     void *cl);
+restore_status_t write_thumbnail_rows_status(OutputSink *output, 
+                                             output_format_t format,
+                                             thumbnail_t thumb);
+restore_status_t write_thumbnail_status(LineTable *table, 
+                                        restore_options_t options, 
+                                        OutputSink *output, long *clamped);
+void save_row_index(const char *input_filename, LineTable *table,
+                    line_offsets_t offsets);
+restore_status_t write_indexed_rows_status(const char *input_filename,
+                                           restore_options_t options,
+                                           OutputSink *output, 
+                                           long *clamped, int *served);
+ImageCache *open_image_cache(const char *input_filename, 
+                             restore_options_t options, uint64_t *key);
 void restore_image(const char *input_filename);
+void restore_image_with_options(const char *input_filename, 
+                                restore_options_t options, 
+                                restore_stats_t stats);
+restore_status_t restore_image_status(const char *input_filename, 
+                                      restore_options_t options, 
+                                      restore_stats_t stats);
+int open_output_fd(const char *output_filename);
+void restore_to_sink(const char *input_filename, restore_options_t options,
+                     restore_stats_t stats, OutputSink *output);
+restore_status_t restore_to_sink_status(const char *input_filename, 
+                                        restore_options_t options,
+                                        restore_stats_t stats, 
+                                        OutputSink *output);
+unsigned char *restore_image_to_memory(const char *input_filename, 
+                                       size_t *length);
+void record_peak_rss(restore_stats_t stats);
+void record_infusion_lengths(restore_stats_t stats, LineTable *table);
+restore_status_t record_infusion_lengths_status(restore_stats_t stats, 
+                                                LineTable *table);
+void free_restore_stats(restore_stats_t stats);
+void print_restore_stats(FILE *output, restore_stats_t stats);
+int serve_job(const char *input_path, const char *output_path, FILE *reply,
+              void *cl);
+int serve_restorations(restore_options_t options);
+Seq_T read_batch_list(const char *list_path);
+void free_batch_list(Seq_T *files);
+void run_batch_task(void *task, int worker, void *cl);
+int parse_batch_input(restore_batch_t batch, batch_task_t task, int worker);
+int parse_batch_range(restore_batch_t batch, batch_task_t task, int fd, 
+                      int worker);
+void admit_batch_file(restore_batch_t batch, batch_file_t file);
+void finish_batch_task(restore_batch_t batch, batch_file_t file, int parsed);
+restore_status_t write_batch_output(batch_file_t file, 
+                                    restore_options_t options, 
+                                    restore_stats_t stats);
+int restore_batch(restore_options_t options, restore_stats_t stats);
 
 #endif /* RESTORATION_H */
\ No newline at end of file
@@ -0,0 +1,220 @@
+/*
+ *     restore_client.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Client for restoration --serve (see job_server.h). Sends each
+ *     INPUT OUTPUT pair as one job over a single connection and copies
+ *     the server's replies to standard output.
+ *
+ *     Usage: restore_client [--pass-fd] SOCKET INPUT OUTPUT [INPUT OUTPUT...]
+ *     With --pass-fd the client opens each input itself and passes the
+ *     descriptor, so the server needs no access to the input's path.
+ *     Relative paths are resolved against the client's directory.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/********** connect_to ********
+ *
+ * Connect to the server's socket.
+ *
+ * Parameters:
+ *      const char *socket_path: socket of restoration --serve
+ *
+ * Return: connected socket, or -1 on failure
+ ************************/
+static int connect_to(const char *socket_path)
+{
+        struct sockaddr_un addr = {0};
+        if (strlen(socket_path) >= sizeof addr.sun_path) {
+                return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 &&
+            connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+                close(fd);
+                fd = -1;
+        }
+        return fd;
+}
+
+/********** absolute ********
+ *
+ * Make a path absolute, since the server runs in its own directory.
+ *
+ * Parameters:
+ *      const char *path: path given on the command line
+ *      char *out:        out; PATH_MAX bytes
+ *
+ * Return: 1 on success, 0 if the result does not fit
+ ************************/
+static int absolute(const char *path, char *out)
+{
+        if (path[0] == '/') {
+                return snprintf(out, PATH_MAX, "%s", path) < PATH_MAX;
+        }
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof cwd) == NULL) {
+                return 0;
+        }
+        return snprintf(out, PATH_MAX, "%s/%s", cwd, path) < PATH_MAX;
+}
+
+/********** send_all ********
+ *
+ * Send bytes, optionally with a descriptor attached to the first one.
+ *
+ * Parameters:
+ *      int sock:         connected socket
+ *      const char *data: bytes to send
+ *      size_t len:       number of bytes
+ *      int pass_fd:      descriptor to pass, or -1
+ *
+ * Return: 1 on success, 0 on a send error
+ ************************/
+static int send_all(int sock, const char *data, size_t len, int pass_fd)
+{
+        union {
+                struct cmsghdr align;
+                char bytes[CMSG_SPACE(sizeof(int))];
+        } control;
+        while (len > 0) {
+                struct iovec iov = { (void *)data, len };
+                struct msghdr msg = {0};
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                if (pass_fd >= 0) {
+                        msg.msg_control = control.bytes;
+                        msg.msg_controllen = sizeof control.bytes;
+                        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+                        c->cmsg_level = SOL_SOCKET;
+                        c->cmsg_type = SCM_RIGHTS;
+                        c->cmsg_len = CMSG_LEN(sizeof(int));
+                        memcpy(CMSG_DATA(c), &pass_fd, sizeof(int));
+                }
+                ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+                if (n <= 0) {
+                        return 0;
+                }
+                data += n;
+                len -= n;
+                pass_fd = -1;
+        }
+        return 1;
+}
+
+/********** read_reply ********
+ *
+ * Copy one job's reply to standard output.
+ *
+ * Parameters:
+ *      FILE *replies: stream of server replies
+ *
+ * Return: 1 if the job succeeded, 0 if it failed or the server hung up
+ ************************/
+static int read_reply(FILE *replies)
+{
+        char line[256];
+        while (fgets(line, sizeof line, replies) != NULL) {
+                fputs(line, stdout);
+                if (strcmp(line, "ok\n") == 0) {
+                        return 1;
+                }
+                if (strcmp(line, "error\n") == 0) {
+                        return 0;
+                }
+        }
+        return 0;
+}
+
+/********** run_job ********
+ *
+ * Send one job and wait for its reply.
+ *
+ * Parameters:
+ *      int sock:           connected socket
+ *      FILE *replies:      stream of server replies
+ *      const char *input:  input path
+ *      const char *output: output path
+ *      int pass_fd:        open the input here and pass its descriptor
+ *
+ * Return: 1 if the job succeeded, else 0
+ ************************/
+static int run_job(int sock, FILE *replies, const char *input,
+                   const char *output, int pass_fd)
+{
+        char path[PATH_MAX];
+        char request[2 * PATH_MAX + 32];
+        int fd = -1;
+        int sent;
+
+        if (!absolute(output, path)) {
+                return 0;
+        }
+        if (pass_fd) {
+                fd = open(input, O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                        perror(input);
+                        return 0;
+                }
+                snprintf(request, sizeof request, "input-fd\noutput %s\n",
+                         path);
+                sent = send_all(sock, request, strlen(request), fd);
+                close(fd);
+        } else {
+                char input_path[PATH_MAX];
+                if (!absolute(input, input_path)) {
+                        return 0;
+                }
+                snprintf(request, sizeof request, "input %s\noutput %s\n",
+                         input_path, path);
+                sent = send_all(sock, request, strlen(request), -1);
+        }
+        return sent && read_reply(replies);
+}
+
+/**************** main *****************
+ *
+ * Send every INPUT OUTPUT pair to the server as a job.
+ *
+ * Return:
+ *      EXIT_SUCCESS if every job succeeded, else EXIT_FAILURE.
+ ************************/
+int main(int argc, char *argv[])
+{
+        int pass_fd = argc > 1 && strcmp(argv[1], "--pass-fd") == 0;
+        int first = 1 + pass_fd;
+        if (argc - first < 3 || (argc - first - 1) % 2 != 0) {
+                fprintf(stderr, "usage: %s [--pass-fd] SOCKET INPUT OUTPUT "
+                        "[INPUT OUTPUT...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        int sock = connect_to(argv[first]);
+        FILE *replies = sock >= 0 ? fdopen(dup(sock), "r") : NULL;
+        if (replies == NULL) {
+                perror(argv[first]);
+                return EXIT_FAILURE;
+        }
+        int ok = 1;
+        for (int i = first + 1; i + 1 < argc; i += 2) {
+                ok = run_job(sock, replies, argv[i], argv[i + 1], pass_fd) &&
+                     ok;
+        }
+        fclose(replies);
+        close(sock);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,47 @@
+/*
+ *     restore_status.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Status codes for the reentrant restoration API. readaline and the
+ *     restoration functions report failures by raising CII exceptions,
+ *     whose handler stack is one global setjmp chain: only one thread may
+ *     use it, and a raise unwinds past whatever the frames in between had
+ *     allocated. The *_status variants raise nothing and return one of
+ *     these codes instead, so worker threads and long-running servers can
+ *     call them; the raising functions are now thin wrappers over them.
+ */
+
+#ifndef RESTORE_STATUS_H
+#define RESTORE_STATUS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/********** restore_status_t ********
+ * Outcome of a *_status call.
+ *      RESTORE_OK:           success
+ *      RESTORE_ERR_ARGUMENT: a NULL or otherwise unusable argument
+ *      RESTORE_ERR_MEMORY:   memory (or a thread) could not be had
+ *      RESTORE_ERR_OPEN:     the input or output could not be opened
+ *      RESTORE_ERR_READ:     reading or decompressing the input failed
+ *      RESTORE_ERR_WRITE:    writing or encoding the output failed
+ ************************/
+typedef enum restore_status {
+        RESTORE_OK = 0,
+        RESTORE_ERR_ARGUMENT,
+        RESTORE_ERR_MEMORY,
+        RESTORE_ERR_OPEN,
+        RESTORE_ERR_READ,
+        RESTORE_ERR_WRITE
+} restore_status_t;
+
+/* Functions */
+const char *restore_status_string(restore_status_t status);
+
+/* readaline without exceptions (readaline.h is the course's interface) */
+restore_status_t readaline_status(FILE *inputfd, char **datapp,
+                                  size_t *length);
+
+#endif /* RESTORE_STATUS_H */
@@ -0,0 +1,401 @@
+/*
+ *     row_index.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements RowIndex. An index file is a fixed header followed by
+ *     two arrays of one entry per target row, in row order: the byte
+ *     offset where the row's line starts (uint64_t), then the line's
+ *     length including its '\n' (uint32_t). Keeping them apart lets a
+ *     reader pread just the entries of the rows it wants. Numbers are in
+ *     the writer's byte order; an index is a cache for the machine that
+ *     made it, like the image cache.
+ *
+ *     Indexes are written to a temporary file and renamed into place, so
+ *     a reader never sees a partial one.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "row_index.h"
+
+/* First bytes of every index; bump the last one when the layout changes */
+static const char INDEX_MAGIC[8] = { 'F', 'P', 'I', 'D', 'X', 0, 0, 1 };
+
+/* Start of an index file */
+struct index_header {
+        char magic[8];
+        uint64_t input_size;            /* of the input it was made from */
+        int64_t input_mtime_sec;
+        int64_t input_mtime_nsec;
+        uint64_t fingerprint;           /* of the target infusion */
+        uint64_t rows;
+        uint32_t width;
+        uint32_t unused;                /* zero */
+};
+
+/* Mode an ordinary create would give an index; see create_mode */
+static pthread_once_t create_mode_once = PTHREAD_ONCE_INIT;
+static mode_t index_mode;
+
+/* Struct Definition */
+struct RowIndex {
+        int fd;
+        int input_fd;           /* the input, checked against header */
+        struct index_header header;
+};
+
+/*------------------------Helpers-------------------------*/
+
+/********** index_path ********
+ *
+ * Name the index of an input.
+ *
+ * Parameters:
+ *      const char *input_path: path to the input (not NULL)
+ *      const char *suffix:     appended after ROW_INDEX_SUFFIX
+ *
+ * Return: malloc'd path, or NULL if memory runs out
+ ************************/
+static char *index_path(const char *input_path, const char *suffix)
+{
+        size_t len = strlen(input_path);
+        char *path = malloc(len + sizeof ROW_INDEX_SUFFIX + strlen(suffix));
+        if (path != NULL) {
+                memcpy(path, input_path, len);
+                strcpy(path + len, ROW_INDEX_SUFFIX);
+                strcat(path, suffix);
+        }
+        return path;
+}
+
+/********** describe_input ********
+ *
+ * Fill the fields of a header that identify the input.
+ *
+ * Parameters:
+ *      const struct stat *st:       status of the input
+ *      struct index_header *header: out; size and modification time set
+ *
+ * Return: 1 on success, 0 if the input is not a regular file
+ ************************/
+static int describe_input(const struct stat *st,
+                          struct index_header *header)
+{
+        if (!S_ISREG(st->st_mode)) {
+                return 0;
+        }
+        header->input_size = st->st_size;
+        header->input_mtime_sec = st->st_mtim.tv_sec;
+        header->input_mtime_nsec = st->st_mtim.tv_nsec;
+        return 1;
+}
+
+/********** read_create_mode ********
+ *
+ * Record 0666 less the umask in index_mode; run once by create_mode.
+ ************************/
+static void read_create_mode(void)
+{
+        mode_t mask = umask(0);
+        umask(mask);
+        index_mode = 0666 & ~mask;
+}
+
+/********** create_mode ********
+ *
+ * Mode for a new index. mkstemp makes files 0600, which would keep
+ * other users from an index of an input they can read.
+ *
+ * Return: 0666 less the process umask
+ *
+ * Notes:
+ *      The umask can only be read by setting it, so it is read once,
+ *      on the first index write, rather than on every one.
+ ************************/
+static mode_t create_mode(void)
+{
+        pthread_once(&create_mode_once, read_create_mode);
+        return index_mode;
+}
+
+/********** write_all ********
+ *
+ * Write every byte of a buffer, retrying writes cut short by a signal.
+ *
+ * Parameters:
+ *      int fd:           file to write
+ *      const void *data: bytes to write
+ *      size_t len:       number of bytes
+ *
+ * Return: 1 on success, 0 on a write error
+ ************************/
+static int write_all(int fd, const void *data, size_t len)
+{
+        const char *p = data;
+        while (len > 0) {
+                ssize_t n = write(fd, p, len);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return 0;
+                }
+                p += n;
+                len -= n;
+        }
+        return 1;
+}
+
+/********** read_at ********
+ *
+ * Read exactly len bytes at an offset, retrying reads cut short by a
+ * signal.
+ *
+ * Parameters:
+ *      int fd:       file to read
+ *      void *data:   out; len bytes
+ *      size_t len:   number of bytes
+ *      off_t offset: where to read
+ *
+ * Return: 1 on success, 0 on a read error or early end of file
+ ************************/
+static int read_at(int fd, void *data, size_t len, off_t offset)
+{
+        char *p = data;
+        while (len > 0) {
+                ssize_t n = pread(fd, p, len, offset);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return 0;
+                }
+                p += n;
+                len -= n;
+                offset += n;
+        }
+        return 1;
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** write_row_index ********
+ *
+ * Write the index of an input, replacing any older one.
+ *
+ * Parameters:
+ *      const char *input_path: input the rows were read from (not NULL)
+ *      uint64_t fingerprint:   fingerprint of the target infusion
+ *      int width:              pixels per row
+ *      long rows:              number of target rows (> 0)
+ *      const long long *starts: byte offset of each row's line
+ *      const int *lengths:     bytes in each row's line
+ *
+ * Return: 1 if the index was written, 0 otherwise
+ *
+ * Notes:
+ *      The input must not have changed since its rows were read, or the
+ *      index will describe the wrong file.
+ ************************/
+int write_row_index(const char *input_path, uint64_t fingerprint,
+                    int width, long rows, const long long *starts,
+                    const int *lengths)
+{
+        struct index_header header = {{0}, 0, 0, 0, 0, 0, 0, 0};
+        memcpy(header.magic, INDEX_MAGIC, sizeof header.magic);
+        header.fingerprint = fingerprint;
+        header.rows = rows;
+        header.width = width;
+        char *path = index_path(input_path, "");
+        char *tmp_path = index_path(input_path, ".tmp-XXXXXX");
+        uint64_t *offsets = malloc(rows * sizeof *offsets);
+        uint32_t *sizes = malloc(rows * sizeof *sizes);
+        struct stat st;
+        int fd = -1;
+        int written = 0;
+        if (path != NULL && tmp_path != NULL && offsets != NULL &&
+            sizes != NULL && stat(input_path, &st) == 0 &&
+            describe_input(&st, &header)) {
+                fd = mkstemp(tmp_path);
+        }
+        if (fd >= 0) {
+                for (long i = 0; i < rows; i++) {
+                        offsets[i] = starts[i];
+                        sizes[i] = lengths[i];
+                }
+                written = fchmod(fd, create_mode()) == 0 &&
+                          write_all(fd, &header, sizeof header) &&
+                          write_all(fd, offsets, rows * sizeof *offsets) &&
+                          write_all(fd, sizes, rows * sizeof *sizes);
+                close(fd);
+                written = written && rename(tmp_path, path) == 0;
+                if (!written) {
+                        unlink(tmp_path);
+                }
+        }
+        free(path);
+        free(tmp_path);
+        free(offsets);
+        free(sizes);
+        return written;
+}
+
+/********** open_row_index ********
+ *
+ * Open an input and its index, if the index is still current.
+ *
+ * Parameters:
+ *      const char *input_path: path to the input (not NULL)
+ *
+ * Return:
+ *      New RowIndex, or NULL if the input cannot be opened, there is no
+ *      index, it is damaged, or the input has changed since it was
+ *      written. Caller must close it with close_row_index.
+ ************************/
+RowIndex *open_row_index(const char *input_path)
+{
+        char *path = index_path(input_path, "");
+        RowIndex *index = path != NULL ? malloc(sizeof *index) : NULL;
+        if (index == NULL) {
+                free(path);
+                return NULL;
+        }
+        index->input_fd = open(input_path, O_RDONLY | O_CLOEXEC);
+        index->fd = open(path, O_RDONLY | O_CLOEXEC);
+        free(path);
+
+        /* Compare against the input as opened, so it cannot change
+         * between the check and the reads */
+        struct index_header current;
+        struct index_header *h = &index->header;
+        struct stat input_st, st;
+        int usable = index->input_fd >= 0 && index->fd >= 0 &&
+                     fstat(index->input_fd, &input_st) == 0 &&
+                     describe_input(&input_st, &current) &&
+                     fstat(index->fd, &st) == 0 &&
+                     read_at(index->fd, h, sizeof *h, 0) &&
+                     memcmp(h->magic, INDEX_MAGIC, sizeof h->magic) == 0 &&
+                     h->input_size == current.input_size &&
+                     h->input_mtime_sec == current.input_mtime_sec &&
+                     h->input_mtime_nsec == current.input_mtime_nsec &&
+                     h->rows > 0 && h->rows <= (uint64_t)st.st_size &&
+                     (uint64_t)st.st_size == sizeof *h + h->rows *
+                     (sizeof(uint64_t) + sizeof(uint32_t));
+        if (!usable) {
+                close_row_index(index);
+                return NULL;
+        }
+        return index;
+}
+
+/********** row_index_fingerprint ********
+ *
+ * Return: fingerprint of the target infusion the index was made for
+ ************************/
+uint64_t row_index_fingerprint(RowIndex *index)
+{
+        return index->header.fingerprint;
+}
+
+/********** row_index_width ********
+ *
+ * Return: pixels per row of the indexed image
+ ************************/
+int row_index_width(RowIndex *index)
+{
+        return index->header.width;
+}
+
+/********** row_index_rows ********
+ *
+ * Return: number of rows of the indexed image (> 0)
+ ************************/
+long row_index_rows(RowIndex *index)
+{
+        return index->header.rows;
+}
+
+/********** row_index_read ********
+ *
+ * Look up where a range of rows lies in the input.
+ *
+ * Parameters:
+ *      RowIndex *index:    open index (not NULL)
+ *      long first:         first row wanted
+ *      long last:          one past the last row wanted (first < last <=
+ *                          row_index_rows)
+ *      long long *starts:  out; last - first byte offsets
+ *      int *lengths:       out; last - first line lengths
+ *
+ * Return: 1 on success, 0 if the index cannot be read
+ ************************/
+int row_index_read(RowIndex *index, long first, long last,
+                   long long *starts, int *lengths)
+{
+        long count = last - first;
+        uint64_t *offsets = malloc(count * sizeof *offsets);
+        uint32_t *sizes = malloc(count * sizeof *sizes);
+        off_t sizes_at = sizeof index->header +
+                         index->header.rows * sizeof *offsets;
+        int ok = offsets != NULL && sizes != NULL &&
+                 read_at(index->fd, offsets, count * sizeof *offsets,
+                         sizeof index->header + first * sizeof *offsets) &&
+                 read_at(index->fd, sizes, count * sizeof *sizes,
+                         sizes_at + first * sizeof *sizes);
+        for (long i = 0; ok && i < count; i++) {
+                starts[i] = offsets[i];
+                lengths[i] = sizes[i];
+        }
+        free(offsets);
+        free(sizes);
+        return ok;
+}
+
+/********** row_index_read_line ********
+ *
+ * Read one line of the input.
+ *
+ * Parameters:
+ *      RowIndex *index:  open index (not NULL)
+ *      long long start:  byte offset of the line, from row_index_read
+ *      int length:       bytes in the line, from row_index_read
+ *      char *line:       out; length bytes
+ *
+ * Return: 1 on success, 0 on a read error or early end of file
+ ************************/
+int row_index_read_line(RowIndex *index, long long start, int length,
+                        char *line)
+{
+        return read_at(index->input_fd, line, length, start);
+}
+
+/********** close_row_index ********
+ *
+ * Close an index and its input.
+ *
+ * Parameters:
+ *      RowIndex *index: index to close (may be NULL)
+ ************************/
+void close_row_index(RowIndex *index)
+{
+        if (index == NULL) {
+                return;
+        }
+        if (index->fd >= 0) {
+                close(index->fd);
+        }
+        if (index->input_fd >= 0) {
+                close(index->input_fd);
+        }
+        free(index);
+}
@@ -0,0 +1,47 @@
+/*
+ *     row_index.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for sidecar row indexes. A restoration run can leave
+ *     INPUT.fpidx next to its input, recording the target infusion's
+ *     fingerprint, the image width, and where each target row lies in the
+ *     input. A later run that wants only some rows reads them straight
+ *     from those offsets instead of scanning the whole input again.
+ *
+ *     An index remembers the size and modification time of the input it
+ *     was made from and is ignored once either changes. Like the image
+ *     cache, an index that cannot be written or read is never fatal: the
+ *     caller falls back to a full restoration.
+ */
+
+#ifndef ROW_INDEX_H
+#define ROW_INDEX_H
+
+#include <stdint.h>
+
+/* Appended to the input's path to name its index */
+#define ROW_INDEX_SUFFIX ".fpidx"
+
+/********** RowIndex ********
+ * Abstract type representing an open, current index of one input, and
+ * the input itself.
+ ************************/
+typedef struct RowIndex RowIndex;
+
+/* Functions */
+int write_row_index(const char *input_path, uint64_t fingerprint,
+                    int width, long rows, const long long *starts,
+                    const int *lengths);
+RowIndex *open_row_index(const char *input_path);
+uint64_t row_index_fingerprint(RowIndex *index);
+int row_index_width(RowIndex *index);
+long row_index_rows(RowIndex *index);
+int row_index_read(RowIndex *index, long first, long last,
+                   long long *starts, int *lengths);
+int row_index_read_line(RowIndex *index, long long start, int length,
+                        char *line);
+void close_row_index(RowIndex *index);
+
+#endif /* ROW_INDEX_H */
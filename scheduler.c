@@ -0,0 +1,406 @@
+/*
+ *     scheduler.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements Scheduler. Each deque is a growable ring under its own
+ *     mutex: the owner pushes and pops at the tail, thieves take from the
+ *     head, so a worker keeps working on what it just split while others
+ *     take the oldest, largest-grained leftovers. One more mutex guards
+ *     the count of queued tasks, which idle workers sleep on.
+ *
+ *     Tasks are expected to be coarse (a whole small file or a chunk of
+ *     megabytes), so plain mutexes cost nothing measurable here.
+ *
+ *     In ALLOC_HUGE mode each worker binds itself to a NUMA node before
+ *     running tasks, as ParsePool workers do.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "scheduler.h"
+
+/* Initial capacity of a worker's deque */
+#define DEQUE_CAPACITY 64
+
+/* A worker's tasks, oldest at head */
+struct deque {
+        pthread_mutex_t lock;
+        void **tasks;           /* ring of capacity */
+        int capacity;
+        int head;
+        int count;
+};
+
+/* Struct Definition */
+struct Scheduler {
+        task_fn run;
+        void *cl;
+        alloc_mode_t mode;
+        int nworkers;
+        pthread_t *threads;
+        struct deque *deques;           /* one per worker */
+        struct worker_usage *usage;     /* written by its worker only */
+        struct timespec started_at;
+        int next_submit;                /* deque for the next submit */
+        int started;                    /* workers that have an index */
+
+        /* Guarded by lock */
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        long queued;                    /* tasks in all deques, counted
+                                           before they are pushed */
+        int sleeping;                   /* workers waiting for tasks */
+        int closing;                    /* no more tasks will be submitted */
+};
+
+/*------------------------Helpers-------------------------*/
+
+/********** seconds_since ********
+ *
+ * Monotonic time elapsed since a start time.
+ *
+ * Parameters:
+ *      const struct timespec *start: earlier CLOCK_MONOTONIC reading
+ *
+ * Return: elapsed seconds
+ ************************/
+static double seconds_since(const struct timespec *start)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (double)(now.tv_sec - start->tv_sec) +
+               (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/********** push_task ********
+ *
+ * Add a task at the tail of a deque and wake a sleeping worker.
+ *
+ * Parameters:
+ *      Scheduler *s:    scheduler (not NULL)
+ *      struct deque *d: deque to add to
+ *      void *task:      task to add
+ *
+ * Return: 1 on success, 0 if the deque cannot grow
+ *
+ * Notes:
+ *      The task is counted before it is published, so a thief can never
+ *      take it while s->queued still leaves it out; s->queued is then
+ *      never below the number of tasks in the deques.
+ ************************/
+static int push_task(Scheduler *s, struct deque *d, void *task)
+{
+        pthread_mutex_lock(&s->lock);
+        s->queued++;
+        pthread_mutex_unlock(&s->lock);
+
+        pthread_mutex_lock(&d->lock);
+        if (d->count == d->capacity) {
+                void **tasks = malloc(2 * d->capacity * sizeof *tasks);
+                if (tasks == NULL) {
+                        pthread_mutex_unlock(&d->lock);
+                        pthread_mutex_lock(&s->lock);
+                        s->queued--;
+                        pthread_mutex_unlock(&s->lock);
+                        return 0;
+                }
+                for (int i = 0; i < d->count; i++) {
+                        tasks[i] = d->tasks[(d->head + i) % d->capacity];
+                }
+                free(d->tasks);
+                d->tasks = tasks;
+                d->capacity *= 2;
+                d->head = 0;
+        }
+        d->tasks[(d->head + d->count) % d->capacity] = task;
+        d->count++;
+        pthread_mutex_unlock(&d->lock);
+
+        pthread_mutex_lock(&s->lock);
+        if (s->sleeping > 0) {
+                pthread_cond_signal(&s->changed);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return 1;
+}
+
+/********** take_task ********
+ *
+ * Take a task: the newest of the worker's own, else the oldest of the
+ * first other worker that has one.
+ *
+ * Parameters:
+ *      Scheduler *s: scheduler (not NULL)
+ *      int worker:   index of the calling worker
+ *
+ * Return: a task, or NULL if every deque was empty
+ ************************/
+static void *take_task(Scheduler *s, int worker)
+{
+        void *task = NULL;
+        struct deque *own = &s->deques[worker];
+        pthread_mutex_lock(&own->lock);
+        if (own->count > 0) {
+                own->count--;
+                task = own->tasks[(own->head + own->count) % own->capacity];
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        for (int i = 1; task == NULL && i < s->nworkers; i++) {
+                struct deque *victim = &s->deques[(worker + i) % s->nworkers];
+                pthread_mutex_lock(&victim->lock);
+                if (victim->count > 0) {
+                        task = victim->tasks[victim->head];
+                        victim->head = (victim->head + 1) % victim->capacity;
+                        victim->count--;
+                        s->usage[worker].steals++;
+                }
+                pthread_mutex_unlock(&victim->lock);
+        }
+
+        if (task != NULL) {
+                pthread_mutex_lock(&s->lock);
+                s->queued--;
+                pthread_mutex_unlock(&s->lock);
+        }
+        return task;
+}
+
+/********** wait_for_tasks ********
+ *
+ * Sleep until some deque may hold a task.
+ *
+ * Parameters:
+ *      Scheduler *s: scheduler (not NULL)
+ *
+ * Return: 1 to look for tasks again, 0 once the scheduler is closing and
+ *         nothing is queued
+ *
+ * Notes:
+ *      A task counted but not yet published sends the caller back to
+ *      look again; it shows up in its deque moments later.
+ ************************/
+static int wait_for_tasks(Scheduler *s)
+{
+        pthread_mutex_lock(&s->lock);
+        while (s->queued <= 0 && !s->closing) {
+                s->sleeping++;
+                pthread_cond_wait(&s->changed, &s->lock);
+                s->sleeping--;
+        }
+        int more = !(s->closing && s->queued <= 0);
+        pthread_mutex_unlock(&s->lock);
+        return more;
+}
+
+/********** worker_thread ********
+ *
+ * Thread body: run tasks until the scheduler closes and all are done.
+ *
+ * Parameters:
+ *      void *arg: the Scheduler
+ *
+ * Return: NULL
+ *
+ * Notes:
+ *      A worker only leaves once nothing is queued anywhere; a task still
+ *      running elsewhere may spawn more, but its own worker runs those.
+ ************************/
+static void *worker_thread(void *arg)
+{
+        Scheduler *s = arg;
+        pthread_mutex_lock(&s->lock);
+        int worker = s->started++;
+        pthread_mutex_unlock(&s->lock);
+        page_alloc_bind_worker(worker, s->mode);
+
+        for (;;) {
+                void *task = take_task(s, worker);
+                if (task == NULL) {
+                        if (!wait_for_tasks(s)) {
+                                break;
+                        }
+                        continue;
+                }
+                struct timespec start;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                s->run(task, worker, s->cl);
+                s->usage[worker].busy_seconds += seconds_since(&start);
+                s->usage[worker].tasks++;
+        }
+        return NULL;
+}
+
+/********** free_scheduler ********
+ *
+ * Free a scheduler's deques and the scheduler itself.
+ *
+ * Parameters:
+ *      Scheduler *s:    scheduler whose threads are not running
+ *      int initialized: deques whose mutex was initialized
+ ************************/
+static void free_scheduler(Scheduler *s, int initialized)
+{
+        for (int i = 0; s->deques != NULL && i < s->nworkers; i++) {
+                if (i < initialized) {
+                        pthread_mutex_destroy(&s->deques[i].lock);
+                }
+                free(s->deques[i].tasks);
+        }
+        free(s->deques);
+        free(s->usage);
+        free(s->threads);
+        free(s);
+}
+
+/********** stop_workers ********
+ *
+ * Let the workers finish what is queued and wait for them.
+ *
+ * Parameters:
+ *      Scheduler *s: scheduler (not NULL)
+ *      int started:  number of workers running
+ ************************/
+static void stop_workers(Scheduler *s, int started)
+{
+        pthread_mutex_lock(&s->lock);
+        s->closing = 1;
+        pthread_cond_broadcast(&s->changed);
+        pthread_mutex_unlock(&s->lock);
+        for (int i = 0; i < started; i++) {
+                pthread_join(s->threads[i], NULL);
+        }
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** create_scheduler ********
+ *
+ * Start worker threads that run every task submitted or spawned.
+ *
+ * Parameters:
+ *      int workers:       number of workers (> 0)
+ *      alloc_mode_t mode: ALLOC_HUGE to spread workers over NUMA nodes
+ *      task_fn run:       callback for each task (not NULL)
+ *      void *cl:          passed to run
+ *
+ * Return:
+ *      new scheduler, or NULL if memory or the threads cannot be had
+ *
+ * Notes:
+ *      run executes on several threads at once. Caller must close the
+ *      scheduler with close_scheduler.
+ ************************/
+Scheduler *create_scheduler(int workers, alloc_mode_t mode, task_fn run,
+                            void *cl)
+{
+        if (workers <= 0) {
+                return NULL;
+        }
+        Scheduler *s = calloc(1, sizeof *s);
+        if (s == NULL) {
+                return NULL;
+        }
+        s->run = run;
+        s->cl = cl;
+        s->mode = mode;
+        s->nworkers = workers;
+        s->threads = malloc(workers * sizeof *s->threads);
+        s->deques = calloc(workers, sizeof *s->deques);
+        s->usage = calloc(workers, sizeof *s->usage);
+        int ok = s->threads != NULL && s->deques != NULL && s->usage != NULL;
+        int initialized = 0;
+        for (int i = 0; ok && i < workers; i++) {
+                struct deque *d = &s->deques[i];
+                d->tasks = malloc(DEQUE_CAPACITY * sizeof *d->tasks);
+                d->capacity = DEQUE_CAPACITY;
+                ok = d->tasks != NULL;
+                pthread_mutex_init(&d->lock, NULL);
+                initialized++;
+        }
+        if (!ok) {
+                free_scheduler(s, initialized);
+                return NULL;
+        }
+
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->changed, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &s->started_at);
+        for (int i = 0; i < workers; i++) {
+                if (pthread_create(&s->threads[i], NULL, worker_thread,
+                                   s) != 0) {
+                        stop_workers(s, i);
+                        pthread_cond_destroy(&s->changed);
+                        pthread_mutex_destroy(&s->lock);
+                        free_scheduler(s, workers);
+                        return NULL;
+                }
+        }
+        return s;
+}
+
+/********** scheduler_submit ********
+ *
+ * Queue a task from outside the pool.
+ *
+ * Parameters:
+ *      Scheduler *s: scheduler (not NULL)
+ *      void *task:   task to run
+ *
+ * Return: 1 if the task was queued, 0 if memory runs out
+ *
+ * Notes:
+ *      Submitted tasks are dealt to the workers in turn; whoever is idle
+ *      steals from the rest. Only one thread may submit.
+ ************************/
+int scheduler_submit(Scheduler *s, void *task)
+{
+        int worker = s->next_submit;
+        s->next_submit = (worker + 1) % s->nworkers;
+        return push_task(s, &s->deques[worker], task);
+}
+
+/********** scheduler_spawn ********
+ *
+ * Queue a task from inside a running task.
+ *
+ * Parameters:
+ *      Scheduler *s: scheduler (not NULL)
+ *      int worker:   worker running the calling task
+ *      void *task:   task to run
+ *
+ * Return: 1 if the task was queued, 0 if memory runs out (the caller
+ *         may then run the task itself)
+ ************************/
+int scheduler_spawn(Scheduler *s, int worker, void *task)
+{
+        return push_task(s, &s->deques[worker], task);
+}
+
+/********** close_scheduler ********
+ *
+ * Run every remaining task, stop the workers, and free the scheduler.
+ *
+ * Parameters:
+ *      Scheduler *s:              scheduler to close (not NULL)
+ *      struct worker_usage *usage: out; one entry per worker (may be
+ *                                  NULL)
+ ************************/
+void close_scheduler(Scheduler *s, struct worker_usage *usage)
+{
+        stop_workers(s, s->nworkers);
+        double lifetime = seconds_since(&s->started_at);
+        for (int i = 0; usage != NULL && i < s->nworkers; i++) {
+                usage[i] = s->usage[i];
+                usage[i].utilization = lifetime > 0 ?
+                                       usage[i].busy_seconds / lifetime : 0;
+        }
+        pthread_cond_destroy(&s->changed);
+        pthread_mutex_destroy(&s->lock);
+        free_scheduler(s, s->nworkers);
+}
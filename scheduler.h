@@ -0,0 +1,49 @@
+/*
+ *     scheduler.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for Scheduler, a work-stealing pool of threads. Every
+ *     worker owns a deque of tasks: it runs its own newest task first and,
+ *     once its deque is empty, steals the oldest task of another worker.
+ *     Tasks may spawn further tasks onto their worker's deque, so a task
+ *     that turns out to be large can split itself and let idle workers
+ *     take the pieces.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "page_alloc.h"
+
+/********** task_fn ********
+ * Callback run on a worker thread for every task.
+ *      void *task: the task, as submitted or spawned
+ *      int worker: index of the running worker, from 0
+ *      void *cl:   closure given to create_scheduler
+ * Must not raise exceptions (the CII exception stack is not per thread).
+ ************************/
+typedef void (*task_fn)(void *task, int worker, void *cl);
+
+/* What one worker did over the scheduler's life */
+struct worker_usage {
+        long tasks;             /* tasks run */
+        long steals;            /* tasks taken from another worker */
+        double busy_seconds;    /* time spent running tasks */
+        double utilization;     /* busy_seconds over the scheduler's life */
+};
+
+/********** Scheduler ********
+ * Abstract type representing a pool of work-stealing threads.
+ ************************/
+typedef struct Scheduler Scheduler;
+
+/* Functions */
+Scheduler *create_scheduler(int workers, alloc_mode_t mode, task_fn run,
+                            void *cl);
+int scheduler_submit(Scheduler *s, void *task);
+int scheduler_spawn(Scheduler *s, int worker, void *task);
+void close_scheduler(Scheduler *s, struct worker_usage *usage);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,462 @@
+/*
+ *     speculation.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Implements Speculation. The first sample_lines lines are kept aside;
+ *     the infusion repeated most often among them (ties going to the group
+ *     that repeated last, like the exact rule) becomes the provisional
+ *     target. Its rows are written at once, behind a P5 header whose
+ *     height is a fixed-width, space-padded field, and later rows of the
+ *     group are written as they are parsed.
+ *
+ *     When the input is done, the provisional target is checked against
+ *     the LineTable's exact target. A match only needs the real height
+ *     written over the placeholder with pwrite; a mismatch truncates the
+ *     output back to where the image started so the caller can write the
+ *     exact result. Only seekable, non-append fd sinks can be patched, so
+ *     other outputs never speculate.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "speculation.h"
+#include "narrow.h"
+
+/* Pixels are single bytes */
+#define SPECULATION_MAXVAL 255
+
+/* Characters reserved for the height: enough for any int */
+#define HEIGHT_FIELD 10
+
+/* Room for the padded P5 header */
+#define SPECULATION_HEADER_MAX 64
+
+/* A line kept from the sample */
+struct sampled_line {
+        char *key;
+        int key_len;
+        const int *digits;      /* owned by the LineTable */
+        int len;
+};
+
+/* Progress of a speculation */
+typedef enum speculation_state {
+        SPECULATION_SAMPLING,
+        SPECULATION_STREAMING,
+        SPECULATION_ABANDONED
+} speculation_state_t;
+
+/* Struct Definition */
+struct Speculation {
+        speculation_state_t state;
+        OutputSink *output;
+        int fd;                 /* output's descriptor */
+        off_t start;            /* offset of the image in fd */
+        off_t height_offset;    /* offset of the height placeholder */
+        int wrote;              /* bytes of a guess reached output */
+
+        long sample_lines;
+        long sampled;
+        struct sampled_line *sample;
+
+        char *key;              /* provisional target */
+        int key_len;
+        int width;
+        long rows;              /* rows written so far */
+        long clamped;           /* pixels of those rows outside [0, 255] */
+        unsigned char *row;
+};
+
+/*------------------------Helpers-------------------------*/
+
+/********** compare_sampled ********
+ *
+ * qsort comparison: order sampled lines by key, then by position.
+ *
+ * Parameters:
+ *      const void *a, *b: pointers to struct sampled_line pointers
+ *
+ * Return: negative, zero or positive like strcmp
+ ************************/
+static int compare_sampled(const void *a, const void *b)
+{
+        const struct sampled_line *x = *(const struct sampled_line *const *)a;
+        const struct sampled_line *y = *(const struct sampled_line *const *)b;
+        if (x->key_len != y->key_len) {
+                return x->key_len < y->key_len ? -1 : 1;
+        }
+        int order = memcmp(x->key, y->key, x->key_len);
+        if (order != 0) {
+                return order;
+        }
+        /* Lines come from one array, so this is sample order */
+        return x < y ? -1 : (x > y);
+}
+
+/********** same_key ********
+ *
+ * Check whether a key equals the provisional target.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation with a target (not NULL)
+ *      const char *key:          key to compare
+ *      int key_len:              length of key
+ *
+ * Return: 1 if equal, 0 otherwise
+ ************************/
+static int same_key(Speculation *speculation, const char *key, int key_len)
+{
+        return key_len == speculation->key_len &&
+               memcmp(key, speculation->key, key_len) == 0;
+}
+
+/********** guess_target ********
+ *
+ * Pick the provisional target from the sample.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation with a full sample
+ *
+ * Return:
+ *      1 if a target was chosen (key, key_len and width set), 0 if no
+ *      key repeats in the sample, its rows differ in length, or memory
+ *      runs out
+ ************************/
+static int guess_target(Speculation *speculation)
+{
+        long n = speculation->sampled;
+        struct sampled_line **order = malloc(n * sizeof *order);
+        if (order == NULL) {
+                return 0;
+        }
+        for (long i = 0; i < n; i++) {
+                order[i] = &speculation->sample[i];
+        }
+        qsort(order, n, sizeof *order, compare_sampled);
+
+        /* Longest run of equal keys; ties go to the latest repeat */
+        long best_start = 0, best_count = 1;
+        struct sampled_line *best_last = NULL;
+        for (long start = 0, end; start < n; start = end) {
+                end = start + 1;
+                while (end < n &&
+                       order[start]->key_len == order[end]->key_len &&
+                       memcmp(order[start]->key, order[end]->key,
+                              order[start]->key_len) == 0) {
+                        end++;
+                }
+                long count = end - start;
+                struct sampled_line *last = order[end - 1];
+                if (count >= 2 && (count > best_count ||
+                                   (count == best_count && last > best_last))) {
+                        best_start = start;
+                        best_count = count;
+                        best_last = last;
+                }
+        }
+
+        int chosen = best_last != NULL;
+        for (long i = best_start; chosen && i < best_start + best_count; i++) {
+                /* The exact writer uses the last repeat's length */
+                chosen = order[i]->len == best_last->len;
+        }
+        if (chosen) {
+                speculation->key = malloc(best_last->key_len + 1);
+                chosen = speculation->key != NULL;
+        }
+        if (chosen) {
+                memcpy(speculation->key, best_last->key, best_last->key_len);
+                speculation->key_len = best_last->key_len;
+                speculation->width = best_last->len;
+        }
+        free(order);
+        return chosen;
+}
+
+/********** write_row ********
+ *
+ * Write one row of the provisional target as single-byte pixels,
+ * clamped like the exact writer's.
+ *
+ * Parameters:
+ *      Speculation *speculation: streaming speculation (not NULL)
+ *      const int *digits:        width pixel values
+ ************************/
+static void write_row(Speculation *speculation, const int *digits)
+{
+        speculation->clamped += narrow_row(speculation->row, digits,
+                                           speculation->width);
+        sink_write(speculation->output, speculation->row, speculation->width);
+        speculation->rows++;
+}
+
+/********** start_streaming ********
+ *
+ * Write the header with a placeholder height and the sampled rows of
+ * the provisional target.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation with a target (not NULL)
+ *
+ * Return: 1 if streaming started, 0 if the row buffer cannot be had
+ ************************/
+static int start_streaming(Speculation *speculation)
+{
+        speculation->row = malloc(speculation->width > 0 ?
+                                  speculation->width : 1);
+        if (speculation->row == NULL) {
+                return 0;
+        }
+
+        char header[SPECULATION_HEADER_MAX];
+        int prefix = snprintf(header, sizeof header, "P5\n%d ",
+                              speculation->width);
+        int len = prefix + snprintf(header + prefix, sizeof header - prefix,
+                                    "%-*d\n%d\n", HEIGHT_FIELD, 0,
+                                    SPECULATION_MAXVAL);
+        speculation->height_offset = speculation->start + prefix;
+        sink_write(speculation->output, header, len);
+        speculation->wrote = 1;
+
+        for (long i = 0; i < speculation->sampled; i++) {
+                struct sampled_line *line = &speculation->sample[i];
+                if (same_key(speculation, line->key, line->key_len)) {
+                        write_row(speculation, line->digits);
+                }
+        }
+        return 1;
+}
+
+/********** free_sample ********
+ *
+ * Free the sampled lines.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation (not NULL)
+ ************************/
+static void free_sample(Speculation *speculation)
+{
+        if (speculation->sample == NULL) {
+                return;
+        }
+        for (long i = 0; i < speculation->sampled; i++) {
+                free(speculation->sample[i].key);
+        }
+        free(speculation->sample);
+        speculation->sample = NULL;
+}
+
+/********** end_sampling ********
+ *
+ * Guess the target from the full sample and start streaming its rows.
+ *
+ * Parameters:
+ *      Speculation *speculation: sampling speculation (not NULL)
+ ************************/
+static void end_sampling(Speculation *speculation)
+{
+        if (guess_target(speculation) && start_streaming(speculation)) {
+                speculation->state = SPECULATION_STREAMING;
+        } else {
+                speculation->state = SPECULATION_ABANDONED;
+        }
+        free_sample(speculation);
+}
+
+/********** patch_height ********
+ *
+ * Write the real height over the placeholder.
+ *
+ * Parameters:
+ *      Speculation *speculation: streaming speculation (not NULL)
+ *
+ * Return: 1 on success, 0 if the output could not be written
+ ************************/
+static int patch_height(Speculation *speculation)
+{
+        char field[HEIGHT_FIELD + 1];
+        snprintf(field, sizeof field, "%-*ld", HEIGHT_FIELD,
+                 speculation->rows);
+        return sink_flush(speculation->output) &&
+               pwrite(speculation->fd, field, HEIGHT_FIELD,
+                      speculation->height_offset) == HEIGHT_FIELD;
+}
+
+/********** discard_output ********
+ *
+ * Remove everything written for a wrong guess.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation that wrote output (not NULL)
+ *
+ * Return: 1 if the output is back at the image start, 0 otherwise
+ ************************/
+static int discard_output(Speculation *speculation)
+{
+        /* Staged bytes must land before the truncation, not after it */
+        return sink_flush(speculation->output) &&
+               ftruncate(speculation->fd, speculation->start) == 0 &&
+               lseek(speculation->fd, speculation->start, SEEK_SET) ==
+               speculation->start;
+}
+
+/*------------------------Interface-------------------------*/
+
+/********** create_speculation ********
+ *
+ * Start a speculative restoration into output.
+ *
+ * Parameters:
+ *      OutputSink *output: sink the image will be written to (not NULL);
+ *                          nothing else may write to it until
+ *                          close_speculation
+ *      long sample_lines:  lines to sample before guessing (> 0)
+ *
+ * Return:
+ *      new speculation, or NULL if output cannot be patched in place (not
+ *      an fd sink on a regular file, or opened for appending) or memory
+ *      runs out; restoration then runs without speculating
+ ************************/
+Speculation *create_speculation(OutputSink *output, long sample_lines)
+{
+        int fd = sink_fd(output);
+        struct stat st;
+        if (sample_lines <= 0 || fd < 0 || fstat(fd, &st) != 0 ||
+            !S_ISREG(st.st_mode)) {
+                return NULL;
+        }
+        /* pwrite ignores its offset on O_APPEND descriptors */
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || (flags & O_APPEND) || !sink_flush(output)) {
+                return NULL;
+        }
+        off_t start = lseek(fd, 0, SEEK_CUR);
+        if (start < 0) {
+                return NULL;
+        }
+
+        Speculation *speculation = calloc(1, sizeof *speculation);
+        if (speculation == NULL) {
+                return NULL;
+        }
+        speculation->sample = calloc(sample_lines,
+                                     sizeof *speculation->sample);
+        if (speculation->sample == NULL) {
+                free(speculation);
+                return NULL;
+        }
+        speculation->state = SPECULATION_SAMPLING;
+        speculation->output = output;
+        speculation->fd = fd;
+        speculation->start = start;
+        speculation->sample_lines = sample_lines;
+        return speculation;
+}
+
+/********** speculation_observe ********
+ *
+ * Tell the speculation about one parsed line, in input order.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation (not NULL)
+ *      const char *key:          the line's infusion
+ *      int key_len:              length of key
+ *      const int *digits:        the line's pixels, already owned by the
+ *                                LineTable (must outlive the speculation)
+ *      int len:                  number of pixels
+ *
+ * Effects:
+ *      Samples the line, or writes it if it belongs to the provisional
+ *      target. A target row of the wrong length abandons the guess.
+ ************************/
+void speculation_observe(Speculation *speculation, const char *key,
+                         int key_len, const int *digits, int len)
+{
+        if (speculation->state == SPECULATION_SAMPLING) {
+                struct sampled_line *line =
+                        &speculation->sample[speculation->sampled];
+                line->key = malloc(key_len + 1);
+                if (line->key == NULL) {
+                        speculation->state = SPECULATION_ABANDONED;
+                        free_sample(speculation);
+                        return;
+                }
+                memcpy(line->key, key, key_len);
+                line->key_len = key_len;
+                line->digits = digits;
+                line->len = len;
+                speculation->sampled++;
+                if (speculation->sampled == speculation->sample_lines) {
+                        end_sampling(speculation);
+                }
+        } else if (speculation->state == SPECULATION_STREAMING &&
+                   same_key(speculation, key, key_len)) {
+                if (len != speculation->width) {
+                        speculation->state = SPECULATION_ABANDONED;
+                        return;
+                }
+                write_row(speculation, digits);
+        }
+}
+
+/********** close_speculation ********
+ *
+ * Check the guess against the exact target and free the speculation.
+ *
+ * Parameters:
+ *      Speculation *speculation: speculation to close (may be NULL)
+ *      LineTable *table:         table holding every line of the input, or
+ *                                NULL to drop the guess after a failed
+ *                                read
+ *      long *clamped:            out; pixels a confirmed image clamped to
+ *                                [0, 255] (0 unless 1 is returned)
+ *
+ * Return:
+ *       1 if the guess was right and output holds the finished image,
+ *       0 if the caller must write the exact image (output is back where
+ *         it was when the speculation was created),
+ *      -1 if a wrong guess could not be removed from output
+ *
+ * Notes:
+ *      A confirmed image differs from the exact writer's only in the
+ *      spaces padding its height field.
+ ************************/
+int close_speculation(Speculation *speculation, LineTable *table, 
+                      long *clamped)
+{
+        *clamped = 0;
+        if (speculation == NULL) {
+                return 0;
+        }
+        int result = 0;
+        if (speculation->state == SPECULATION_STREAMING && table != NULL &&
+            line_table_target_matches(table, speculation->key,
+                                      speculation->key_len)) {
+                int width, height;
+                get_reconstructed_digits(table, &width, &height);
+                if (width == speculation->width &&
+                    height == speculation->rows &&
+                    patch_height(speculation)) {
+                        result = 1;
+                        *clamped = speculation->clamped;
+                }
+        }
+        if (result == 0 && speculation->wrote &&
+            !discard_output(speculation)) {
+                result = -1;
+        }
+
+        free_sample(speculation);
+        free(speculation->key);
+        free(speculation->row);
+        free(speculation);
+        return result;
+}
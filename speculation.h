@@ -0,0 +1,32 @@
+/*
+ *     speculation.h
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Interface for Speculation, which starts writing the P5 raster before
+ *     the whole input has been grouped. It samples the first lines, guesses
+ *     the target infusion, and streams that group's rows as they arrive;
+ *     once the exact target is known it either confirms the guess (and
+ *     fills in the image height) or discards what it wrote.
+ */
+
+#ifndef SPECULATION_H
+#define SPECULATION_H
+
+#include "line_table.h"
+#include "output_sink.h"
+
+/********** Speculation ********
+ * Abstract type representing one speculative restoration.
+ ************************/
+typedef struct Speculation Speculation;
+
+/* Functions */
+Speculation *create_speculation(OutputSink *output, long sample_lines);
+void speculation_observe(Speculation *speculation, const char *key,
+                         int key_len, const int *digits, int len);
+int close_speculation(Speculation *speculation, LineTable *table, 
+                      long *clamped);
+
+#endif /* SPECULATION_H */
@@ -305,25 +305,18 @@ void test_pgm_header() {
     TEST_ASSERT(header->height == 75, "Height modification");
     TEST_ASSERT(header->maxval == 128, "Maxval modification");
     
-    // Test header writing to file
-    FILE *test_file = fopen("test_header.pgm", "w");
-    if (test_file != NULL) {
-        write_pgm_header(test_file, header);
-        fclose(test_file);
-        
-        // Verify file contents
-        FILE *read_file = fopen("test_header.pgm", "r");
-        if (read_file != NULL) {
-            char buffer[100];
-            fgets(buffer, sizeof(buffer), read_file);
-            TEST_ASSERT(strcmp(buffer, "P5\n") == 0, "PGM format header");
-            fgets(buffer, sizeof(buffer), read_file);
-            TEST_ASSERT(strcmp(buffer, "50 75\n") == 0, "Width and height");
-            fgets(buffer, sizeof(buffer), read_file);
-            TEST_ASSERT(strcmp(buffer, "128\n") == 0, "Max value");
-            fclose(read_file);
-        }
-        remove("test_header.pgm");
+    // Test header writing to a memory sink
+    OutputSink *sink = create_memory_sink();
+    if (sink != NULL) {
+        write_pgm_header(sink, header);
+        size_t len;
+        unsigned char *bytes = sink_memory_data(sink, &len);
+        TEST_ASSERT(len == strlen("P5\n50 75\n128\n"), "Header length");
+        TEST_ASSERT(bytes != NULL && 
+                    memcmp(bytes, "P5\n50 75\n128\n", len) == 0, 
+                    "PGM format header");
+        free(bytes);
+        close_output_sink(sink);
     }
     
     free_pgm_header(header);
@@ -375,26 +368,26 @@ void test_get_reconstructed_digits() {
     add_to_line_table(table, "target", digits3, 3);
     
     // Test reconstruction
-    int row_width;
-    Seq_T sequences = get_reconstructed_digits(table, &row_width);
+    int row_width, height;
+    int **sequences = get_reconstructed_digits(table, &row_width, &height);
     TEST_ASSERT(sequences != NULL, "Reconstructed sequences not null");
     TEST_ASSERT(row_width == 3, "Correct row width");
-    TEST_ASSERT(Seq_length(sequences) == 3, "Correct number of sequences");
+    TEST_ASSERT(height == 3, "Correct number of sequences");
     
     // Verify first sequence
-    int *first_seq = Seq_get(sequences, 0);
+    int *first_seq = sequences[0];
     TEST_ASSERT(first_seq[0] == 10, "First sequence first element");
     TEST_ASSERT(first_seq[1] == 20, "First sequence second element");
     TEST_ASSERT(first_seq[2] == 30, "First sequence third element");
     
     // Verify second sequence
-    int *second_seq = Seq_get(sequences, 1);
+    int *second_seq = sequences[1];
     TEST_ASSERT(second_seq[0] == 40, "Second sequence first element");
     TEST_ASSERT(second_seq[1] == 50, "Second sequence second element");
     TEST_ASSERT(second_seq[2] == 60, "Second sequence third element");
     
     // Verify third sequence
-    int *third_seq = Seq_get(sequences, 2);
+    int *third_seq = sequences[2];
     TEST_ASSERT(third_seq[0] == 70, "Third sequence first element");
     TEST_ASSERT(third_seq[1] == 80, "Third sequence second element");
     TEST_ASSERT(third_seq[2] == 90, "Third sequence third element");
@@ -454,41 +447,36 @@ void test_restore_image_integration() {
 void test_write_digit_arrays_from_sequence() {
     printf("\nTesting write_digit_arrays_from_sequence\n");
     
-    // Create test sequence
-    Seq_T test_seq = Seq_new(0);
+    // Create test rows
+    int *test_rows[2];
     
     // Add test digit arrays
     int *digits1 = malloc(3 * sizeof(int));
     digits1[0] = 10; digits1[1] = 20; digits1[2] = 30;
-    Seq_addhi(test_seq, digits1);
+    test_rows[0] = digits1;
     
     int *digits2 = malloc(3 * sizeof(int));
     digits2[0] = 40; digits2[1] = 50; digits2[2] = 60;
-    Seq_addhi(test_seq, digits2);
+    test_rows[1] = digits2;
     
-    // Write to file
-    FILE *output = fopen("test_sequence.pgm", "wb");
+    // Write to a memory sink
+    OutputSink *output = create_memory_sink();
     if (output != NULL) {
-        write_digit_arrays_from_sequence(output, test_seq, 3);
-        fclose(output);
+        write_digit_arrays_from_sequence(output, test_rows, 2, 3);
         
-        // Verify file size (3 ints * 2 sequences * sizeof(int))
-        FILE *input = fopen("test_sequence.pgm", "rb");
-        if (input != NULL) {
-            fseek(input, 0, SEEK_END);
-            long file_size = ftell(input);
-            fclose(input);
-            TEST_ASSERT(file_size == 3 * 2 * sizeof(int), "Correct file size");
-        }
-        
-        remove("test_sequence.pgm");
+        // Verify raster size (3 pixels * 2 rows, one byte each)
+        size_t len;
+        unsigned char *bytes = sink_memory_data(output, &len);
+        TEST_ASSERT(len == 3 * 2, "Correct raster size");
+        TEST_ASSERT(bytes != NULL && bytes[0] == 10 && bytes[5] == 60, 
+                    "Correct raster bytes");
+        free(bytes);
+        close_output_sink(output);
     }
     
-    // Cleanup sequence
-    for (int i = 0; i < Seq_length(test_seq); i++) {
-        free(Seq_get(test_seq, i));
-    }
-    Seq_free(&test_seq);
+    // Cleanup rows
+    free(digits1);
+    free(digits2);
 }
 
 void test_edge_cases() {
@@ -566,10 +554,10 @@ void test_memory_management() {
     target_digits[0] = 100; target_digits[1] = 101; target_digits[2] = 102;
     add_to_line_table(table, "key0", target_digits, 3);
     
-    int width;
-    Seq_T sequences = get_reconstructed_digits(table, &width);
+    int width, height;
+    int **sequences = get_reconstructed_digits(table, &width, &height);
     TEST_ASSERT(sequences != NULL, "Large table reconstruction");
-    TEST_ASSERT(Seq_length(sequences) == 2, "Correct sequence count");
+    TEST_ASSERT(height == 2, "Correct sequence count");
     
     free_line_table(table);
 }
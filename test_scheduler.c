@@ -0,0 +1,120 @@
+/*
+ *     test_scheduler.c
+ *     Authors: Sabeeh Iftikhar (siftik01), Nahuel Gomez (agomez08)
+ *     filesofpix
+ *     10/18/2026
+ *
+ *     Stress test for Scheduler. Each round starts a small pool, submits
+ *     a burst of tasks that do almost nothing (some spawn a child), and
+ *     waits for all of them to run before closing the pool, the way
+ *     restore_batch waits for its inputs. Tiny tasks keep workers going
+ *     idle and stealing all the time, which is where a worker could miss
+ *     a task or leave the pool early; a round that stalls fails.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "scheduler.h"
+
+#define ROUNDS 20000
+#define TASKS_PER_ROUND 200
+#define MAX_WORKERS 4
+#define STALL_SECONDS 5         /* a round this slow has lost its workers */
+
+/* Tasks run so far in the current round */
+struct progress {
+        Scheduler *scheduler;
+        pthread_mutex_t lock;
+        pthread_cond_t ran;
+        long done;
+};
+
+/* Distinct task pointers; a task's value says whether it spawns */
+static char tasks[2 * TASKS_PER_ROUND];
+
+/********** run_task ********
+ *
+ * task_fn: count the task, spawning a child for every other one.
+ ************************/
+static void run_task(void *task, int worker, void *cl)
+{
+        struct progress *progress = cl;
+        char *t = task;
+        if (t < tasks + TASKS_PER_ROUND && (t - tasks) % 2 == 0 &&
+            !scheduler_spawn(progress->scheduler, worker,
+                             t + TASKS_PER_ROUND)) {
+                run_task(t + TASKS_PER_ROUND, worker, cl);
+        }
+        pthread_mutex_lock(&progress->lock);
+        progress->done++;
+        pthread_cond_signal(&progress->ran);
+        pthread_mutex_unlock(&progress->lock);
+}
+
+/********** run_round ********
+ *
+ * Run one round on a new pool.
+ *
+ * Parameters:
+ *      int workers: pool size
+ *
+ * Return: 1 if every task ran, 0 if the round stalled or failed
+ ************************/
+static int run_round(int workers)
+{
+        struct progress progress;
+        long expected = TASKS_PER_ROUND + TASKS_PER_ROUND / 2;
+        progress.done = 0;
+        pthread_mutex_init(&progress.lock, NULL);
+        pthread_cond_init(&progress.ran, NULL);
+        progress.scheduler = create_scheduler(workers, ALLOC_DEFAULT,
+                                              run_task, &progress);
+        if (progress.scheduler == NULL) {
+                return 0;
+        }
+        int ok = 1;
+        for (int i = 0; i < TASKS_PER_ROUND && ok; i++) {
+                ok = scheduler_submit(progress.scheduler, &tasks[i]);
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += STALL_SECONDS;
+        pthread_mutex_lock(&progress.lock);
+        while (ok && progress.done < expected) {
+                ok = pthread_cond_timedwait(&progress.ran, &progress.lock,
+                                            &deadline) == 0;
+        }
+        pthread_mutex_unlock(&progress.lock);
+
+        /* A stalled pool still drains once closing, so this returns */
+        close_scheduler(progress.scheduler, NULL);
+        pthread_cond_destroy(&progress.ran);
+        pthread_mutex_destroy(&progress.lock);
+        return ok;
+}
+
+/**************** main *****************
+ *
+ * Run every round, on pools of 1 to MAX_WORKERS workers.
+ *
+ * Return:
+ *      EXIT_SUCCESS if every round finished, EXIT_FAILURE otherwise.
+ ************************/
+int main(void)
+{
+        for (int round = 0; round < ROUNDS; round++) {
+                int workers = 1 + round % MAX_WORKERS;
+                if (!run_round(workers)) {
+                        fprintf(stderr, "test_scheduler: round %d on %d "
+                                "workers stalled\n", round, workers);
+                        return EXIT_FAILURE;
+                }
+        }
+        printf("%d rounds of %d tasks ran\n", ROUNDS, TASKS_PER_ROUND);
+        return EXIT_SUCCESS;
+}
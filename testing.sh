@@ -53,4 +53,91 @@ echo "diffed special characters"
 # echo "readaline: input line too long" > expected.txt
 # ./test_readaline < long_no_newline.txt > actual.txt 2>&1
 # diff expected.txt actual.txt
-# echo "diffed long line without newline"
\ No newline at end of file
+# echo "diffed long line without newline"
+
+# Testing the work-stealing scheduler: bursts of tiny tasks must all run
+# on every pool size, or a round stalls and the test fails
+make test_scheduler
+timeout 300 ./test_scheduler
+echo "ran scheduler stress test"
+
+# Testing the image cache: entries beyond --cache-max-entries or
+# --cache-max-bytes are evicted in --cache-evict order, and a failed run
+# publishes nothing. Eviction goes by modification time in seconds, so
+# runs whose order matters are a second apart.
+printf 'a1b2c3\na4b5c6\nx7y8z9\n' > cache1.txt
+printf 'a9b8c7\na6b5c4\nx3y2z1\n' > cache2.txt
+printf 'a2b4c6\na8b1c3\nx5y7z9\n' > cache3.txt
+for policy in lru fifo; do
+        rm -rf cache_dir
+        mkdir cache_dir
+        cache="--cache cache_dir --cache-max-entries 2 --cache-evict $policy"
+        ./restoration $cache cache1.txt > /dev/null
+        sleep 1
+        ./restoration $cache cache2.txt > /dev/null
+        sleep 1
+        # A hit refreshes cache1's entry only under lru
+        ./restoration $cache cache1.txt > /dev/null
+        sleep 1
+        ./restoration -s $cache cache3.txt 2>&1 > /dev/null | 
+                grep cache_evictions > actual.txt
+        echo "cache_evictions 1" > expected.txt
+        diff expected.txt actual.txt
+        ls cache_dir | wc -l | tr -d ' ' > actual.txt
+        echo 2 > expected.txt
+        diff expected.txt actual.txt
+        if [ $policy = lru ]; then
+                echo "cache_hits 1" > expected.txt
+        else
+                echo "cache_hits 0" > expected.txt
+        fi
+        ./restoration -s --cache cache_dir cache1.txt 2>&1 > /dev/null |
+                grep cache_hits > actual.txt
+        diff expected.txt actual.txt
+        echo "diffed $policy eviction by entries"
+done
+
+# Each entry is an 11-byte header and 6 pixels, so 40 bytes hold two
+rm -rf cache_dir
+mkdir cache_dir
+for input in cache1.txt cache2.txt cache3.txt; do
+        ./restoration --cache cache_dir --cache-max-bytes 40 $input \
+                > /dev/null
+done
+ls cache_dir | wc -l | tr -d ' ' > actual.txt
+echo 2 > expected.txt
+diff expected.txt actual.txt
+echo "diffed eviction by bytes"
+
+# A gzip stream that cannot be inflated fails after the cache missed
+rm -rf cache_dir
+mkdir cache_dir
+printf '\037\213\010\000garbage' > cache_bad.txt
+./restoration --cache cache_dir cache_bad.txt > /dev/null 2>&1 &&
+        echo "restored a gzip stream that cannot be inflated"
+ls -A cache_dir | wc -l | tr -d ' ' > actual.txt
+echo 0 > expected.txt
+diff expected.txt actual.txt
+echo "diffed failed run publishing nothing"
+
+# A cache directory that cannot take the entry (here, past a file size
+# limit; pipes are exempt) must not cost the output: the run falls back
+# to writing it uncached and publishes nothing
+awk 'BEGIN {
+        for (r = 0; r < 40; r++) {
+                line = ""
+                for (c = 0; c < 200; c++) {
+                        line = line "a" (r + c) % 256
+                }
+                print line
+        }
+}' > cache_big.txt
+./restoration cache_big.txt > cache_big.pgm
+rm -rf cache_dir
+mkdir cache_dir
+(trap '' XFSZ; ulimit -f 4; ./restoration --cache cache_dir cache_big.txt ||
+        echo "restoration failed with a full cache" >&2) | cmp - cache_big.pgm
+ls -A cache_dir | wc -l | tr -d ' ' > actual.txt
+echo 0 > expected.txt
+diff expected.txt actual.txt
+echo "diffed full cache falling back to uncached output"